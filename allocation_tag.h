@@ -0,0 +1,200 @@
+#pragma once
+
+#include "block_profile.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nonstd
+{
+  //! Counters of a tag at one point in time
+  struct tag_stats
+  {
+    std::string name;
+    std::size_t bytes;   //! live bytes
+    std::size_t peak;    //! most live bytes at once
+    std::uint64_t count; //! allocations made so far
+  };
+
+  class allocation_tag;
+
+  namespace details
+  {
+    //! Innermost scoped tag of the calling thread, nullptr outside of any scope
+    inline allocation_tag *& thread_allocation_tag() noexcept
+    {
+      static thread_local allocation_tag * tag = nullptr;
+      return tag;
+    }
+  } // details
+
+  /**
+   * @class allocation_tag
+   * @brief Named account the memory blocks charge their allocations to.
+   *
+   * A block takes the calling thread's current tag upon construction, see
+   * scoped_allocation_tag, a humble allocator may be given one explicitly.
+   * The counters are relaxed atomics shared by every block of the tag, so
+   * they hold across resources and threads. report() lists the live tags.
+   * Blocks retiring record their high-water marks to the tag's profile().
+   */
+  class allocation_tag
+  {
+    public:
+      explicit allocation_tag(std::string name)
+	: _name(std::move(name))
+	, _profile(&block_profile::global()[_name])
+      {
+	tag_list& l = list();
+	std::lock_guard<std::mutex> lock(l.mutex);
+	_next = l.head;
+	if (_next)
+	  _next->_prev = this;
+	l.head = this;
+      }
+
+      allocation_tag(const allocation_tag&) = delete;
+      allocation_tag& operator=(const allocation_tag&) = delete;
+
+      //! No block may charge the tag by now
+      ~allocation_tag()
+      {
+	tag_list& l = list();
+	std::lock_guard<std::mutex> lock(l.mutex);
+	if (_prev)
+	  _prev->_next = _next;
+	else
+	  l.head = _next;
+	if (_next)
+	  _next->_prev = _prev;
+      }
+
+      const std::string& name() const
+      {
+	return _name;
+      }
+
+      std::size_t bytes() const
+      {
+	return _bytes.load(std::memory_order_relaxed);
+      }
+
+      std::size_t peak() const
+      {
+	return _peak.load(std::memory_order_relaxed);
+      }
+
+      std::uint64_t count() const
+      {
+	return _count.load(std::memory_order_relaxed);
+      }
+
+      //! High-water marks of the blocks charging the tag
+      block_profile::entry& profile() const
+      {
+	return *_profile;
+      }
+
+      tag_stats stats() const
+      {
+	return tag_stats{_name, bytes(), peak(), count()};
+      }
+
+      //! Accounts for count allocations of bytes in total
+      void charge(std::size_t bytes, std::size_t count = 1) noexcept
+      {
+	_count.fetch_add(count, std::memory_order_relaxed);
+	const std::size_t live = _bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	std::size_t peak = _peak.load(std::memory_order_relaxed);
+	while (live > peak && !_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+	  ;
+      }
+
+      //! Accounts for bytes given back
+      void credit(std::size_t bytes) noexcept
+      {
+	_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+      }
+
+      //! Tag of the allocations made outside of any scope, never destroyed
+      static allocation_tag& untagged()
+      {
+	static allocation_tag& tag = *new allocation_tag("untagged");
+	return tag;
+      }
+
+      //! Calling thread's innermost scoped tag, untagged() outside of any scope
+      static allocation_tag& current()
+      {
+	allocation_tag * tag = details::thread_allocation_tag();
+	return tag ? *tag : untagged();
+      }
+
+      //! Counters of every live tag, most recently created first
+      static std::vector<tag_stats> report()
+      {
+	tag_list& l = list();
+	std::vector<tag_stats> stats;
+	std::lock_guard<std::mutex> lock(l.mutex);
+	for (const allocation_tag * t = l.head; t; t = t->_next)
+	  stats.push_back(t->stats());
+	return stats;
+      }
+
+    private:
+      struct tag_list
+      {
+	std::mutex mutex;
+	allocation_tag * head = nullptr;
+      };
+
+      //! Never destroyed so tags outliving the static destruction still unlink
+      static tag_list& list()
+      {
+	static tag_list& l = *new tag_list;
+	return l;
+      }
+
+      const std::string _name;
+      block_profile::entry * const _profile;
+      std::atomic<std::size_t> _bytes{0};
+      std::atomic<std::size_t> _peak{0};
+      std::atomic<std::uint64_t> _count{0};
+      allocation_tag * _prev = nullptr;
+      allocation_tag * _next = nullptr;
+  };
+
+  /**
+   * @class scoped_allocation_tag
+   * @brief Makes tag the calling thread's current one until the scope ends.
+   *
+   * Scopes nest, blocks constructed within the scope charge the tag for
+   * their whole life.
+   */
+  class scoped_allocation_tag
+  {
+    public:
+      explicit scoped_allocation_tag(allocation_tag& tag) noexcept
+	: _previous(details::thread_allocation_tag())
+      {
+	details::thread_allocation_tag() = &tag;
+      }
+
+      scoped_allocation_tag(const scoped_allocation_tag&) = delete;
+      scoped_allocation_tag& operator=(const scoped_allocation_tag&) = delete;
+
+      ~scoped_allocation_tag()
+      {
+	details::thread_allocation_tag() = _previous;
+      }
+
+    private:
+      allocation_tag * const _previous;
+  };
+} // nonstd
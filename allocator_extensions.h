@@ -0,0 +1,288 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#if __cplusplus > 201402L
+#include <memory_resource>
+#endif
+
+namespace nonstd
+{
+  //! Result of allocate_at_least: the memory and the number of objects it actually fits
+  template<typename Pointer, typename SizeType = std::size_t>
+    struct allocation_result
+    {
+      Pointer ptr;
+      SizeType count;
+    };
+
+#if __cplusplus > 201402L
+  namespace pmr
+  {
+    //! Resource resizing its allocations in place, which polymorphic_allocator's try_expand looks for
+    class expandable_resource
+    {
+      public:
+	//! Resizes the allocation at p in place, false where unsupported or there is no room
+	virtual bool try_expand(void * p, std::size_t old_size, std::size_t new_size) noexcept = 0;
+
+      protected:
+	~expandable_resource() = default;
+    };
+  } // pmr
+#endif
+
+  namespace details
+  {
+    //! Bump allocation granted for n units out of left: n, or all of left when the tail past n can't fit another n
+    inline std::size_t bump_grant(std::size_t n, std::size_t left)
+    {
+      return (left - n < n ? left : n);
+    }
+
+    template<typename... Ts>
+      struct make_void
+      {
+	using type = void;
+      };
+
+    //! std::void_t replacement for C++14
+    template<typename... Ts>
+      using void_t = typename make_void<Ts...>::type;
+
+    template<typename Alloc, typename = void>
+      struct has_allocate_bulk : std::false_type {};
+
+    template<typename Alloc>
+      struct has_allocate_bulk<
+	Alloc
+	, void_t<decltype(std::declval<Alloc&>().allocate_bulk(
+	      std::size_t{}
+	      , std::declval<typename std::allocator_traits<Alloc>::pointer *>()
+	      ))>
+	> : std::true_type {};
+
+    template<typename Alloc, typename = void>
+      struct has_try_allocate : std::false_type {};
+
+    template<typename Alloc>
+      struct has_try_allocate<
+	Alloc
+	, void_t<decltype(std::declval<Alloc&>().try_allocate(std::size_t{}))>
+	> : std::true_type {};
+
+    template<typename Alloc, typename = void>
+      struct has_allocate_at_least : std::false_type {};
+
+    template<typename Alloc>
+      struct has_allocate_at_least<
+	Alloc
+	, void_t<decltype(std::declval<Alloc&>().allocate_at_least(std::size_t{}))>
+	> : std::true_type {};
+
+    template<typename Alloc, typename = void>
+      struct has_try_expand : std::false_type {};
+
+    template<typename Alloc>
+      struct has_try_expand<
+	Alloc
+	, void_t<decltype(std::declval<Alloc&>().try_expand(
+	      std::declval<typename std::allocator_traits<Alloc>::pointer>()
+	      , std::size_t{}
+	      , std::size_t{}
+	      ))>
+	> : std::true_type {};
+
+    //! Resizing in place for allocators without a try_expand member, specialized where they reach one otherwise
+    template<typename Alloc, typename = void>
+      struct try_expand_fallback
+      {
+	static bool try_expand(Alloc&, typename std::allocator_traits<Alloc>::pointer, std::size_t, std::size_t) noexcept
+	{
+	  return false;
+	}
+      };
+
+#if __cplusplus > 201402L
+    //! polymorphic_allocator resizes in place where its resource is expandable
+    template<typename T>
+      struct try_expand_fallback<std::pmr::polymorphic_allocator<T>>
+      {
+	static bool try_expand(std::pmr::polymorphic_allocator<T>& alloc, T * p, std::size_t old_n, std::size_t new_n) noexcept
+	{
+	  auto resource = dynamic_cast<pmr::expandable_resource *>(alloc.resource());
+	  return (resource && resource->try_expand(p, old_n * sizeof(T), new_n * sizeof(T)));
+	}
+      };
+#endif
+
+    template<typename Alloc, typename = void>
+      struct has_prepare : std::false_type {};
+
+    template<typename Alloc>
+      struct has_prepare<
+	Alloc
+	, void_t<decltype(std::declval<Alloc&>().prepare())>
+	> : std::true_type {};
+
+    template<typename Alloc, typename = void>
+      struct has_release : std::false_type {};
+
+    template<typename Alloc>
+      struct has_release<
+	Alloc
+	, void_t<decltype(std::declval<Alloc&>().release())>
+	> : std::true_type {};
+  } // details
+
+  /**
+   * @struct allocator_extensions
+   * @brief Uniform access to the project's allocator extensions.
+   *
+   * Like std::allocator_traits dispatches to the allocator's own member
+   * where there is one and falls back to the standard interface otherwise.
+   */
+  template<typename Alloc>
+    struct allocator_extensions
+    {
+      using traits = std::allocator_traits<Alloc>;
+      using pointer = typename traits::pointer;
+      using size_type = typename traits::size_type;
+
+      //! Allocates count single objects, either all of them or none
+      static void allocate_bulk(Alloc& alloc, size_type count, pointer * out)
+      {
+	allocate_bulk(alloc, count, out, details::has_allocate_bulk<Alloc>{});
+      }
+
+      //! Deallocates count single objects allocated by allocate_bulk or allocate(1)
+      static void deallocate_bulk(Alloc& alloc, pointer * ptrs, size_type count)
+      {
+	deallocate_bulk(alloc, ptrs, count, details::has_allocate_bulk<Alloc>{});
+      }
+
+      //! Returns nullptr instead of throwing when the allocator is exhausted
+      static pointer try_allocate(Alloc& alloc, size_type n) noexcept
+      {
+	return try_allocate(alloc, n, details::has_try_allocate<Alloc>{});
+      }
+
+      //! Drops all the objects at once where the allocator owns its storage exclusively, false otherwise
+      static bool release(Alloc& alloc) noexcept
+      {
+	return release(alloc, details::has_release<Alloc>{});
+      }
+
+      //! Sets up the lazily initialized allocators upfront, false if out of memory
+      static bool prepare(Alloc& alloc) noexcept
+      {
+	return prepare(alloc, details::has_prepare<Alloc>{});
+      }
+
+      //! Allocates room for n objects or more, to be deallocated with the count returned
+      static allocation_result<pointer, size_type> allocate_at_least(Alloc& alloc, size_type n)
+      {
+	return allocate_at_least(alloc, n, details::has_allocate_at_least<Alloc>{});
+      }
+
+      //! Resizes the allocation of old_n objects to new_n in place, false where unsupported or impossible
+      static bool try_expand(Alloc& alloc, pointer p, size_type old_n, size_type new_n) noexcept
+      {
+	return try_expand(alloc, p, old_n, new_n, details::has_try_expand<Alloc>{});
+      }
+
+    private:
+      static allocation_result<pointer, size_type> allocate_at_least(Alloc& alloc, size_type n, std::true_type)
+      {
+	auto result = alloc.allocate_at_least(n);
+	return {result.ptr, result.count};
+      }
+
+      static allocation_result<pointer, size_type> allocate_at_least(Alloc& alloc, size_type n, std::false_type)
+      {
+	return {traits::allocate(alloc, n), n};
+      }
+
+      static bool try_expand(Alloc& alloc, pointer p, size_type old_n, size_type new_n, std::true_type) noexcept
+      {
+	return alloc.try_expand(p, old_n, new_n);
+      }
+
+      static bool try_expand(Alloc& alloc, pointer p, size_type old_n, size_type new_n, std::false_type) noexcept
+      {
+	return details::try_expand_fallback<Alloc>::try_expand(alloc, p, old_n, new_n);
+      }
+
+      static bool prepare(Alloc& alloc, std::true_type) noexcept
+      {
+	return alloc.prepare();
+      }
+
+      static bool prepare(Alloc&, std::false_type) noexcept
+      {
+	return true;
+      }
+
+      static bool release(Alloc& alloc, std::true_type) noexcept
+      {
+	alloc.release();
+	return true;
+      }
+
+      static bool release(Alloc&, std::false_type) noexcept
+      {
+	return false;
+      }
+
+      static pointer try_allocate(Alloc& alloc, size_type n, std::true_type) noexcept
+      {
+	return alloc.try_allocate(n);
+      }
+
+      static pointer try_allocate(Alloc& alloc, size_type n, std::false_type) noexcept
+      {
+	try
+	{
+	  return traits::allocate(alloc, n);
+	}
+	catch(...)
+	{
+	  return nullptr;
+	}
+      }
+
+      static void allocate_bulk(Alloc& alloc, size_type count, pointer * out, std::true_type)
+      {
+	alloc.allocate_bulk(count, out);
+      }
+
+      static void allocate_bulk(Alloc& alloc, size_type count, pointer * out, std::false_type)
+      {
+	size_type i = 0;
+	try
+	{
+	  for (; i < count; ++i)
+	    out[i] = traits::allocate(alloc, 1);
+	}
+	catch(...)
+	{
+	  deallocate_bulk(alloc, out, i, std::false_type{});
+	  throw;
+	}
+      }
+
+      static void deallocate_bulk(Alloc& alloc, pointer * ptrs, size_type count, std::true_type)
+      {
+	alloc.deallocate_bulk(ptrs, count);
+      }
+
+      static void deallocate_bulk(Alloc& alloc, pointer * ptrs, size_type count, std::false_type)
+      {
+	for (size_type i = 0; i < count; ++i)
+	  traits::deallocate(alloc, ptrs[i], 1);
+      }
+    };
+} // nonstd
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+
+// Manual poisoning of the arena space for AddressSanitizer builds. The blocks
+// poison their free space and the redzones between allocations, unpoisoning
+// the chunks they hand out, so ASan reports use-after-free and overflows
+// within a block. Outside of ASan builds everything compiles away.
+// NONSTD_ASAN_REDZONE overrides the redzone size, 0 keeps the blocks' layout.
+
+#if defined(__SANITIZE_ADDRESS__)
+#define NONSTD_ASAN_ENABLED 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define NONSTD_ASAN_ENABLED 1
+#endif
+#endif
+
+#ifdef NONSTD_ASAN_ENABLED
+#include <sanitizer/asan_interface.h>
+#define NONSTD_ASAN_POISON(p, n) ASAN_POISON_MEMORY_REGION((p), (n))
+#define NONSTD_ASAN_UNPOISON(p, n) ASAN_UNPOISON_MEMORY_REGION((p), (n))
+#else
+#define NONSTD_ASAN_POISON(p, n) ((void)(p), (void)(n))
+#define NONSTD_ASAN_UNPOISON(p, n) ((void)(p), (void)(n))
+#endif
+
+namespace nonstd
+{
+  namespace details
+  {
+#ifdef NONSTD_ASAN_ENABLED
+    constexpr bool asan_enabled = true;
+#else
+    constexpr bool asan_enabled = false;
+#endif
+
+#ifdef NONSTD_ASAN_REDZONE
+    constexpr std::size_t asan_redzone = asan_enabled ? NONSTD_ASAN_REDZONE : 0;
+#else
+    //! Poisoned gap a bump block leaves after every allocation, none outside of ASan builds
+    constexpr std::size_t asan_redzone = asan_enabled ? 16 : 0;
+#endif
+
+    //! Room for bytes worth of chunk sized allocations along with their redzones
+    constexpr std::size_t asan_padded(std::size_t bytes, std::size_t chunk) noexcept
+    {
+      return asan_redzone && chunk ? (bytes + chunk - 1) / chunk * (chunk + asan_redzone) : bytes;
+    }
+
+    //! Whether ASan would report an access to p, always false outside of ASan builds
+    inline bool asan_poisoned(const void * p) noexcept
+    {
+#ifdef NONSTD_ASAN_ENABLED
+      return __asan_address_is_poisoned(p);
+#else
+      (void)p;
+      return false;
+#endif
+    }
+  } // details
+} // nonstd
@@ -0,0 +1,183 @@
+#include "legacy_memory_block.h"
+#include "vector.h"
+#include "benchmark.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <numeric>
+#include <memory>
+#include <new>
+#include <string>
+
+// Reallocations a push_back-heavy nonstd::vector does on a bump block: the
+// vector starts from an odd-sized range and grows by push_back, first with an
+// allocator granting exactly what is asked, then taking the slack allocate_at_least
+// hands out, then expanding in place on top of that.
+//
+// allocate_at_least grants the block's tail only when another request of the
+// same size couldn't fit in it, so on a roomy block it saves nothing. The
+// second table runs near the tail, on a block just as big as the capacity the
+// exact vector ends up with: the exact vector runs out, taking the tail saves
+// the last growth.
+
+namespace
+{
+  constexpr size_t roomy = 1 << 20; // ints per block of the first table
+  constexpr size_t rounds = 64;
+
+  //! Bump block of a given number of ints, the extensions under test hidden from allocator_extensions
+  template<typename T, bool at_least, bool expand>
+    struct bounded
+    {
+      using value_type = T;
+      using block = nonstd::legacy::memory_block;
+
+      template<typename U>
+	struct rebind
+	{
+	  using other = bounded<U, at_least, expand>;
+	};
+
+      //! Redzones of the three buffers in ASan builds on top
+      explicit bounded(size_t ints)
+	: storage(std::make_shared<block>(ints * sizeof(int) + 3 * nonstd::details::asan_redzone))
+      {}
+
+      template<typename U>
+	bounded(const bounded<U, at_least, expand>& other)
+	: storage(other.storage)
+	{}
+
+      T * allocate(size_t n)
+      {
+	void * p = storage->allocate(n * sizeof(T));
+	if (!p)
+	  throw std::bad_alloc();
+	return static_cast<T *>(p);
+      }
+
+      void deallocate(T * p, size_t n) noexcept
+      {
+	storage->deallocate(p, n * sizeof(T));
+      }
+
+      template<bool enabled = at_least, typename = std::enable_if_t<enabled>>
+	nonstd::allocation_result<T *> allocate_at_least(size_t n)
+	{
+	  const auto result = storage->allocate_at_least(n, sizeof(T));
+	  if (!result.ptr)
+	    throw std::bad_alloc();
+	  return {static_cast<T *>(result.ptr), result.count};
+	}
+
+      template<bool enabled = expand, typename = std::enable_if_t<enabled>>
+	bool try_expand(T * p, size_t old_n, size_t new_n) noexcept
+	{
+	  return storage->try_expand(p, old_n * sizeof(T), new_n * sizeof(T));
+	}
+
+      std::shared_ptr<block> storage;
+    };
+
+  template<typename T, bool at_least, bool expand>
+    bool operator==(const bounded<T, at_least, expand>& lhs, const bounded<T, at_least, expand>& rhs)
+    {
+      return (lhs.storage == rhs.storage);
+    }
+
+  template<typename T, bool at_least, bool expand>
+    bool operator!=(const bounded<T, at_least, expand>& lhs, const bounded<T, at_least, expand>& rhs)
+    {
+      return !(lhs == rhs);
+    }
+
+  struct result
+  {
+    size_t growths = 0; //! capacity changes after the initial range
+    size_t moves = 0;   //! growths relocating the elements
+    bool exhausted = false; //! the block ran out before the vector reached its size
+    double seconds = 0;
+  };
+
+  //! Capacity a vector growing by doubling from the initial range ends up with
+  size_t final_capacity(size_t size)
+  {
+    size_t capacity = size / 3 + 1;
+    while (capacity < size)
+      capacity *= 2;
+    return capacity;
+  }
+
+  template<typename Allocator>
+    result run(size_t size, size_t block_ints)
+    {
+      std::vector<int> source(size / 3 + 1);
+      std::iota(source.begin(), source.end(), 0);
+
+      result r;
+      const auto start = nonstd::bench::clock_type::now();
+      for (size_t round = 0; round < rounds && !r.exhausted; ++round)
+      {
+	nonstd::vector<int, Allocator> v{Allocator(block_ints)};
+	v.reserve(source.size());
+	for (int value : source)
+	  v.push_back(int(value));
+	try
+	{
+	  for (size_t i = v.size(); i < size; ++i)
+	  {
+	    const size_t capacity = v.capacity();
+	    const int * data = v.data();
+	    v.push_back(static_cast<int>(i));
+	    r.growths += (v.capacity() != capacity);
+	    r.moves += (v.data() != data);
+	  }
+	}
+	catch(const std::bad_alloc&)
+	{
+	  r.exhausted = true;
+	  return r;
+	}
+	nonstd::bench::do_not_optimize(v.back());
+      }
+      r.seconds = std::chrono::duration<double>(nonstd::bench::clock_type::now() - start).count();
+      r.growths /= rounds;
+      r.moves /= rounds;
+      return r;
+    }
+
+  //! growths/moves, or where the block ran out
+  std::string counts(const result& r)
+  {
+    return r.exhausted ? std::string("out of room") : std::to_string(r.growths) + '/' + std::to_string(r.moves);
+  }
+
+  template<typename BlockInts>
+    void table(const char * title, BlockInts block_ints)
+    {
+      std::cout << title << '\n'
+	<< "   size   exact: growths/moves   at_least: growths/moves   at_least+expand: growths/moves   ms exact/at_least/expand\n";
+      for (size_t size : {100, 1000, 10000, 100000})
+      {
+	const result exact = run<bounded<int, false, false>>(size, block_ints(size));
+	const result at_least = run<bounded<int, true, false>>(size, block_ints(size));
+	const result expand = run<bounded<int, true, true>>(size, block_ints(size));
+	std::cout << std::setw(7) << size
+	  << std::setw(23) << counts(exact)
+	  << std::setw(26) << counts(at_least)
+	  << std::setw(33) << counts(expand)
+	  << std::fixed << std::setprecision(2)
+	  << std::setw(11) << exact.seconds * 1e3
+	  << '/' << at_least.seconds * 1e3
+	  << '/' << expand.seconds * 1e3 << '\n';
+      }
+    }
+}
+
+int main(int, char **)
+{
+  table("roomy block", [](size_t) { return roomy; });
+  table("block as big as the exact vector's final capacity", [](size_t size) { return final_capacity(size); });
+  return 0;
+}
@@ -0,0 +1,153 @@
+#include "pmr_memory_block.h"
+#include "pmr_sharded_memory_block.h"
+#include "pmr_reserved_memory_block.h"
+#include "pmr_humble_allocator.h"
+#include "benchmark.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <thread>
+#include <string>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include <memory_resource>
+
+// Per-allocation latency percentiles of the project's allocators, sweeping
+// thread counts and chunk sizes. Every thread times each allocate() call on its
+// own histogram, deallocation is left out of the measure. The op counts are fixed
+// and a warm-up pass precedes each run so the tables compare run to run.
+
+namespace
+{
+  constexpr size_t allocations = 1 << 12; // per thread
+  constexpr size_t warm_up = 1 << 9;      // per thread, not recorded
+  constexpr size_t max_threads = 16;
+  constexpr size_t batch = 64;            // chunks held before freeing, where freeing is possible
+  constexpr size_t sizes[] = {16, 64, 256, 1024};
+  constexpr size_t capacity = (allocations + warm_up) * max_threads; // chunks per shared block
+
+  using nonstd::bench::histogram;
+
+  //! Times allocate(size) on every thread, returns the merged histogram
+  template<typename ThreadBody>
+    histogram measure(size_t threads, ThreadBody body)
+    {
+      std::vector<histogram> histograms(threads);
+      nonstd::bench::run_threads(threads, [&](size_t t) { body(histograms[t]); });
+      histogram merged;
+      for (const auto& h : histograms)
+	merged.merge(h);
+      return merged;
+    }
+
+  //! Bump resources can't rewind while other threads hold chunks, so they only allocate
+  histogram allocate_only(std::pmr::memory_resource& resource, size_t threads, size_t size)
+  {
+    return measure(threads, [&](histogram& h)
+	{
+	  for (size_t i = 0; i < warm_up; ++i)
+	    nonstd::bench::do_not_optimize(resource.allocate(size));
+	  for (size_t i = 0; i < allocations; ++i)
+	  {
+	    const auto start = nonstd::bench::now_ns();
+	    void * p = resource.allocate(size);
+	    h.record(nonstd::bench::now_ns() - start);
+	    nonstd::bench::do_not_optimize(p);
+	  }
+	});
+  }
+
+  //! General purpose resources free their chunks in batches
+  histogram allocate_free(std::pmr::memory_resource& resource, size_t threads, size_t size)
+  {
+    return measure(threads, [&](histogram& h)
+	{
+	  void * held[batch];
+	  for (size_t i = 0; i < warm_up + allocations; ++i)
+	  {
+	    const auto start = nonstd::bench::now_ns();
+	    held[i % batch] = resource.allocate(size);
+	    if (i >= warm_up)
+	      h.record(nonstd::bench::now_ns() - start);
+	    if (i % batch == batch - 1)
+	      for (void * p : held)
+		resource.deallocate(p, size);
+	  }
+	});
+  }
+
+  //! Every thread owns a humble allocator, fetching its block during the warm-up
+  template<size_t Size>
+    histogram humble(size_t threads)
+    {
+      return measure(threads, [&](histogram& h)
+	  {
+	    nonstd::pmr::humble<std::byte, (allocations + warm_up) * Size> a;
+	    for (size_t i = 0; i < allocations + warm_up; ++i)
+	    {
+	      const auto start = nonstd::bench::now_ns();
+	      std::byte * p = a.allocate(Size);
+	      if (i >= warm_up)
+		h.record(nonstd::bench::now_ns() - start);
+	      nonstd::bench::do_not_optimize(p);
+	    }
+	  });
+    }
+
+  template<size_t... Sizes>
+    histogram humble(size_t threads, size_t size, std::index_sequence<Sizes...>)
+    {
+      histogram h;
+      ((size == sizes[Sizes] ? (void)(h = humble<sizes[Sizes]>(threads)) : (void)0), ...);
+      return h;
+    }
+
+  void report(const std::string& name, size_t threads, size_t size, const histogram& h)
+  {
+    std::cout << std::left << std::setw(16) << name << std::right
+      << std::setw(8) << threads
+      << std::setw(7) << size
+      << std::setw(9) << h.percentile(50)
+      << std::setw(9) << h.percentile(99)
+      << std::setw(9) << h.percentile(99.9)
+      << std::setw(11) << h.max() << '\n';
+  }
+}
+
+int main(int, char **)
+{
+  const size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+  // oversubscribe a little, convoys show once threads outnumber the CPUs
+  const size_t threads_max = std::min(std::max<size_t>(2 * cpus, 4), max_threads);
+
+  std::cout << "allocator        threads   size   p50 ns   p99 ns p99.9 ns     max ns\n";
+  for (size_t threads : nonstd::bench::thread_counts(threads_max))
+    for (size_t size : sizes)
+    {
+      report("new_delete", threads, size, allocate_free(*std::pmr::new_delete_resource(), threads, size));
+
+      {
+	nonstd::pmr::memory_block<capacity> b;
+	report("memory_block", threads, size, allocate_only(b, threads, size));
+      }
+      {
+	// a shard per thread at most, each fitting two threads' worth of chunks
+	nonstd::pmr::sharded_memory_block<capacity / max_threads * 2> b(size, threads_max);
+	report("sharded_block", threads, size, allocate_only(b, threads, size));
+      }
+      {
+	nonstd::pmr::reserved_memory_block b(capacity * size);
+	report("reserved_block", threads, size, allocate_only(b, threads, size));
+      }
+      {
+	std::pmr::synchronized_pool_resource pool;
+	report("sync_pool", threads, size, allocate_free(pool, threads, size));
+      }
+
+      report("humble", threads, size, humble(threads, size, std::make_index_sequence<std::size(sizes)>{}));
+    }
+
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include "pmr_humble_allocator.h"
+#include "btree_map.h"
+#include "benchmark.h"
+
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <vector>
+#include <random>
+#include <string>
+#include <algorithm>
+
+// std::map against nonstd::btree_map, each on std::allocator and on a humble
+// block: random insertions, lookups of present keys, an in-order walk and a
+// load of sorted input (hinted at the end for std::map), in ns per value.
+
+namespace
+{
+  constexpr size_t capacity = 1 << 20; // values per humble block
+  constexpr size_t rounds = 4;
+
+  using value_type = std::pair<const int, int>;
+  using humble = nonstd::pmr::humble<value_type, capacity>;
+
+  struct result
+  {
+    double insert = 0;
+    double find = 0;
+    double walk = 0;
+    double load = 0;
+  };
+
+  double elapsed_ns(nonstd::bench::clock_type::time_point start, size_t count)
+  {
+    return std::chrono::duration<double, std::nano>(nonstd::bench::clock_type::now() - start).count() / static_cast<double>(count);
+  }
+
+  template<typename Map>
+    void load(Map& m, const std::vector<value_type>& sorted)
+    {
+      for (const auto& v : sorted)
+	m.emplace_hint(m.end(), v);
+    }
+
+  template<typename K, typename V, typename C, typename A, size_t B>
+    void load(nonstd::btree_map<K, V, C, A, B>& m, const std::vector<value_type>& sorted)
+    {
+      m.insert(nonstd::sorted_unique, sorted.begin(), sorted.end());
+    }
+
+  template<typename Map>
+    result run(const std::vector<int>& keys, const std::vector<value_type>& sorted)
+    {
+      result r;
+      for (size_t round = 0; round < rounds; ++round)
+      {
+	Map m;
+	auto start = nonstd::bench::clock_type::now();
+	for (int k : keys)
+	  m.emplace(k, k);
+	r.insert += elapsed_ns(start, keys.size());
+
+	start = nonstd::bench::clock_type::now();
+	long sum = 0;
+	for (int k : keys)
+	  sum += m.find(k)->second;
+	r.find += elapsed_ns(start, keys.size());
+
+	start = nonstd::bench::clock_type::now();
+	for (const auto& v : m)
+	  sum += v.second;
+	r.walk += elapsed_ns(start, keys.size());
+	nonstd::bench::do_not_optimize(sum);
+
+	Map s;
+	start = nonstd::bench::clock_type::now();
+	load(s, sorted);
+	r.load += elapsed_ns(start, sorted.size());
+	nonstd::bench::do_not_optimize(s.size());
+      }
+      r.insert /= rounds;
+      r.find /= rounds;
+      r.walk /= rounds;
+      r.load /= rounds;
+      return r;
+    }
+
+  void print(const char * name, const result& r)
+  {
+    std::cout << "  " << std::setw(28) << std::left << name << std::right << std::fixed << std::setprecision(1)
+      << std::setw(9) << r.insert
+      << std::setw(9) << r.find
+      << std::setw(9) << r.walk
+      << std::setw(9) << r.load << '\n';
+  }
+}
+
+int main(int, char **)
+{
+  std::mt19937 random(42);
+  for (size_t size : {1000, 10000, 100000, 1000000})
+  {
+    std::vector<int> keys(size);
+    for (size_t i = 0; i < size; ++i)
+      keys[i] = static_cast<int>(i);
+    std::shuffle(keys.begin(), keys.end(), random);
+    std::vector<value_type> sorted;
+    sorted.reserve(size);
+    for (size_t i = 0; i < size; ++i)
+      sorted.emplace_back(static_cast<int>(i), static_cast<int>(i));
+
+    std::cout << size << " values, ns per value:   insert     find     walk     load\n";
+    print("std::map", run<std::map<int, int>>(keys, sorted));
+    print("std::map + humble", run<std::map<int, int, std::less<int>, humble>>(keys, sorted));
+    print("nonstd::btree_map", run<nonstd::btree_map<int, int>>(keys, sorted));
+    print("nonstd::btree_map + humble", run<nonstd::btree_map<int, int, std::less<int>, humble>>(keys, sorted));
+  }
+
+  return 0;
+}
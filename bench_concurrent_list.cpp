@@ -0,0 +1,71 @@
+#include "concurrent_list.h"
+#include "list.h"
+#include "benchmark.h"
+
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+
+// Job-queue style churn: every thread pushes a value and pops one,
+// the lock-free concurrent_list against nonstd::list behind a mutex.
+
+namespace
+{
+  constexpr size_t operations = 1 << 16; // push/pop pairs per thread
+  constexpr size_t max_threads = 32;
+
+  struct locked_list
+  {
+    void push_front(int value)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      list.push_front(value);
+    }
+
+    bool try_pop_front(int& value)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (list.empty())
+	return false;
+      value = list.front();
+      list.pop_front();
+      return true;
+    }
+
+    std::mutex mutex;
+    nonstd::list<int> list;
+  };
+
+  template<typename List>
+    double mops(size_t threads)
+    {
+      List list;
+      const double seconds = nonstd::bench::run_threads(threads, [&](size_t t)
+	  {
+	    int value = 0;
+	    for (size_t i = 0; i < operations; ++i)
+	    {
+	      list.push_front(static_cast<int>(t * operations + i));
+	      list.try_pop_front(value);
+	      nonstd::bench::do_not_optimize(value);
+	    }
+	  });
+      return static_cast<double>(threads * operations) / seconds / 1e6;
+    }
+}
+
+int main(int, char **)
+{
+  std::cout << "threads   locked Mops/s   lock-free Mops/s   speedup\n";
+  for (size_t threads : nonstd::bench::thread_counts(max_threads))
+  {
+    const double a = mops<locked_list>(threads);
+    const double b = mops<nonstd::concurrent_list<int>>(threads);
+    std::cout << std::setw(7) << threads
+      << std::setw(16) << std::fixed << std::setprecision(2) << a
+      << std::setw(19) << b
+      << std::setw(10) << b / a << '\n';
+  }
+
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include "pmr_humble_allocator.h"
+#include "flat_hash_map.h"
+#include "benchmark.h"
+
+#include <iostream>
+#include <iomanip>
+#include <unordered_map>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+// std::unordered_map against nonstd::flat_hash_map on std::allocator and on a
+// humble block: random insertions, then lookups of present keys (hit) and of
+// absent ones (miss) as a cache would see them, in ns per value.
+// std::unordered_map can't take a humble, libstdc++ frees its buckets through
+// a rebound copy of the allocator, which owns a block of its own.
+
+namespace
+{
+  constexpr size_t capacity = 1 << 22; // objects per humble block
+  constexpr size_t rounds = 4;
+
+  using value_type = std::pair<const int, int>;
+  using humble = nonstd::pmr::humble<value_type, capacity>;
+
+  struct result
+  {
+    double insert = 0;
+    double hit = 0;
+    double miss = 0;
+  };
+
+  double elapsed_ns(nonstd::bench::clock_type::time_point start, size_t count)
+  {
+    return std::chrono::duration<double, std::nano>(nonstd::bench::clock_type::now() - start).count() / static_cast<double>(count);
+  }
+
+  template<typename Map>
+    result run(const std::vector<int>& keys, const std::vector<int>& absent)
+    {
+      result r;
+      for (size_t round = 0; round < rounds; ++round)
+      {
+	Map m;
+	auto start = nonstd::bench::clock_type::now();
+	for (int k : keys)
+	  m.emplace(k, k);
+	r.insert += elapsed_ns(start, keys.size());
+
+	start = nonstd::bench::clock_type::now();
+	long sum = 0;
+	for (int k : keys)
+	  sum += m.find(k)->second;
+	r.hit += elapsed_ns(start, keys.size());
+
+	start = nonstd::bench::clock_type::now();
+	for (int k : absent)
+	  sum += m.find(k) == m.end();
+	r.miss += elapsed_ns(start, absent.size());
+	nonstd::bench::do_not_optimize(sum);
+      }
+      r.insert /= rounds;
+      r.hit /= rounds;
+      r.miss /= rounds;
+      return r;
+    }
+
+  void print(const char * name, const result& r)
+  {
+    std::cout << "  " << std::setw(32) << std::left << name << std::right << std::fixed << std::setprecision(1)
+      << std::setw(9) << r.insert
+      << std::setw(9) << r.hit
+      << std::setw(9) << r.miss << '\n';
+  }
+}
+
+int main(int, char **)
+{
+  std::mt19937 random(42);
+  for (size_t size : {1000, 10000, 100000, 1000000})
+  {
+    std::vector<int> keys(size), absent(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+      keys[i] = static_cast<int>(2 * i);
+      absent[i] = static_cast<int>(2 * i + 1);
+    }
+    std::shuffle(keys.begin(), keys.end(), random);
+    std::shuffle(absent.begin(), absent.end(), random);
+
+    std::cout << size << " values, ns per value:       insert      hit     miss\n";
+    print("std::unordered_map", run<std::unordered_map<int, int>>(keys, absent));
+    print("nonstd::flat_hash_map", run<nonstd::flat_hash_map<int, int>>(keys, absent));
+    print("nonstd::flat_hash_map + humble", run<nonstd::flat_hash_map<int, int, std::hash<int>, std::equal_to<int>, humble>>(keys, absent));
+  }
+
+  return 0;
+}
@@ -0,0 +1,75 @@
+#include "pmr_humble_allocator.h"
+#include "list.h"
+#include "pmr_list.h"
+#include "benchmark.h"
+
+#include <iostream>
+#include <iomanip>
+#include <forward_list>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <numeric>
+
+// std::forward_list::sort against the relinking merge sort of nonstd::list and
+// nonstd::pmr::list, on std::allocator and on memory blocks, in ms per sort of
+// 1M shuffled nodes. The lists are filled outside of the timing.
+
+namespace
+{
+  constexpr size_t size = 1000000;
+  constexpr size_t rounds = 5;
+
+  using humble = nonstd::pmr::humble<int, 1 << 20>;
+
+  template<typename List, typename Make>
+    double run(const std::vector<int>& values, Make make)
+    {
+      double ms = 0;
+      for (size_t round = 0; round < rounds; ++round)
+      {
+	List l = make(values);
+	const auto start = nonstd::bench::clock_type::now();
+	l.sort();
+	ms += std::chrono::duration<double, std::milli>(nonstd::bench::clock_type::now() - start).count();
+	nonstd::bench::do_not_optimize(l.front());
+      }
+      return ms / rounds;
+    }
+
+  void print(const char * name, double ms)
+  {
+    std::cout << "  " << std::setw(36) << std::left << name << std::right << std::fixed << std::setprecision(1)
+      << std::setw(9) << ms << '\n';
+  }
+}
+
+int main(int, char **)
+{
+  std::vector<int> values(size);
+  std::iota(values.begin(), values.end(), 0);
+  std::shuffle(values.begin(), values.end(), std::mt19937(42));
+
+  std::cout << size << " shuffled nodes, ms per sort\n";
+  print("std::forward_list", run<std::forward_list<int>>(values,
+	[](const std::vector<int>& v) { return std::forward_list<int>(v.begin(), v.end()); }));
+  print("nonstd::list", run<nonstd::list<int>>(values,
+	[](const std::vector<int>& v) { return nonstd::list<int>(v.begin(), v.end()); }));
+  print("nonstd::list + humble", run<nonstd::list<int, humble>>(values,
+	[](const std::vector<int>& v) { return nonstd::list<int, humble>(v.begin(), v.end()); }));
+
+  double ms = 0;
+  for (size_t round = 0; round < rounds; ++round)
+  {
+    constexpr size_t node_size = sizeof(nonstd::list_details::node<int>);
+    nonstd::pmr::memory_block<1> block(nonstd::details::asan_padded(size * node_size, node_size));
+    nonstd::pmr::list<int> l(values.begin(), values.end(), &block);
+    const auto start = nonstd::bench::clock_type::now();
+    l.sort();
+    ms += std::chrono::duration<double, std::milli>(nonstd::bench::clock_type::now() - start).count();
+    nonstd::bench::do_not_optimize(l.front());
+  }
+  print("nonstd::pmr::list + memory_block", ms / rounds);
+
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include "pmr_memory_block.h"
+#include "pmr_sharded_memory_block.h"
+#include "benchmark.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <thread>
+
+// Allocation throughput of a single shared memory_block against the per-CPU
+// sharded one, every thread bump-allocates its share of small chunks.
+
+namespace
+{
+  constexpr size_t chunk = 32;
+  constexpr size_t allocations = 1 << 16; // per thread
+  constexpr size_t max_threads = 64;
+
+  template<typename Resource>
+    double mops(Resource& resource, size_t threads)
+    {
+      const double seconds = nonstd::bench::run_threads(threads, [&](size_t)
+	  {
+	    for (size_t i = 0; i < allocations; ++i)
+	      nonstd::bench::do_not_optimize(resource.allocate(chunk));
+	  });
+      return static_cast<double>(threads * allocations) / seconds / 1e6;
+    }
+}
+
+int main(int, char **)
+{
+  const size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+
+  std::cout << "threads   shared Mops/s   sharded Mops/s   speedup\n";
+  for (size_t threads : nonstd::bench::thread_counts(std::min(cpus, max_threads)))
+  {
+    // each shard fits two threads' worth of chunks to absorb migrations
+    nonstd::pmr::memory_block<allocations * max_threads> shared;
+    nonstd::pmr::sharded_memory_block<allocations * 2> sharded(chunk, cpus);
+    const double a = mops(shared, threads);
+    const double b = mops(sharded, threads);
+    std::cout << std::setw(7) << threads
+      << std::setw(16) << std::fixed << std::setprecision(2) << a
+      << std::setw(17) << b
+      << std::setw(10) << b / a << '\n';
+  }
+
+  return 0;
+}
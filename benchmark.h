@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace nonstd
+{
+  namespace bench
+  {
+    using clock_type = std::chrono::steady_clock;
+
+    //! Keeps the compiler from optimizing the value away
+    template<typename T>
+      inline void do_not_optimize(const T& value)
+      {
+#ifdef __GNUC__
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static volatile const void * sink;
+	sink = &value;
+#endif
+      }
+
+    //! Runs f(thread_index) on all the threads at once, returns the wall time in seconds
+    template<typename F>
+      double run_threads(std::size_t threads, F f)
+      {
+	std::atomic<std::size_t> ready{0};
+	std::atomic<bool> go{false};
+	std::vector<std::thread> pool;
+	pool.reserve(threads);
+	for (std::size_t i = 0; i < threads; ++i)
+	  pool.emplace_back([&, i]()
+	      {
+		++ready;
+		while (!go.load(std::memory_order_acquire))
+		  std::this_thread::yield();
+		f(i);
+	      });
+
+	while (ready.load() != threads)
+	  std::this_thread::yield();
+
+	const auto start = clock_type::now();
+	go.store(true, std::memory_order_release);
+	for (auto& t : pool)
+	  t.join();
+	return std::chrono::duration<double>(clock_type::now() - start).count();
+      }
+
+    //! 1, 2, 4, ... up to and including max
+    inline std::vector<std::size_t> thread_counts(std::size_t max)
+    {
+      std::vector<std::size_t> counts;
+      for (std::size_t n = 1; n < max; n *= 2)
+	counts.push_back(n);
+      counts.push_back(max);
+      return counts;
+    }
+
+    //! Monotonic nanoseconds, clock_gettime(CLOCK_MONOTONIC) with the usual libstdc++
+    inline std::uint64_t now_ns()
+    {
+      return static_cast<std::uint64_t>(
+	  std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now().time_since_epoch()).count()
+	  );
+    }
+
+    /**
+     * @class histogram
+     * @brief HDR-style log-linear histogram of 64-bit values.
+     *
+     * Every power of two range is split into 2^sub_bits buckets, so any value is
+     * recorded with a relative error under 2^-sub_bits at a fixed memory cost.
+     */
+    class histogram
+    {
+      public:
+	static constexpr unsigned sub_bits = 5;
+	static constexpr std::size_t sub_count = std::size_t{1} << sub_bits;
+	static constexpr std::size_t bucket_count = (64 - sub_bits + 1) * sub_count;
+
+	void record(std::uint64_t value)
+	{
+	  ++_counts[index(value)];
+	  ++_total;
+	  if (value > _max)
+	    _max = value;
+	}
+
+	void merge(const histogram& other)
+	{
+	  for (std::size_t i = 0; i < bucket_count; ++i)
+	    _counts[i] += other._counts[i];
+	  _total += other._total;
+	  if (other._max > _max)
+	    _max = other._max;
+	}
+
+	std::uint64_t count() const
+	{
+	  return _total;
+	}
+
+	std::uint64_t max() const
+	{
+	  return _max;
+	}
+
+	//! Highest value of the bucket holding the given percentile, never above max()
+	std::uint64_t percentile(double p) const
+	{
+	  const std::uint64_t rank = static_cast<std::uint64_t>(p / 100.0 * static_cast<double>(_total) + 0.5);
+	  std::uint64_t seen = 0;
+	  for (std::size_t i = 0; i < bucket_count; ++i)
+	  {
+	    seen += _counts[i];
+	    if (seen && seen >= rank)
+	      return highest(i) < _max ? highest(i) : _max;
+	  }
+	  return _max;
+	}
+
+      private:
+	static std::size_t index(std::uint64_t value)
+	{
+	  if (value < sub_count)
+	    return static_cast<std::size_t>(value);
+	  const unsigned shift = log2(value) - sub_bits;
+	  return ((shift + 1) << sub_bits) + static_cast<std::size_t>((value >> shift) - sub_count);
+	}
+
+	static std::uint64_t highest(std::size_t i)
+	{
+	  if (i < sub_count)
+	    return i;
+	  const unsigned shift = static_cast<unsigned>(i >> sub_bits) - 1;
+	  const std::uint64_t mantissa = (i & (sub_count - 1)) + sub_count;
+	  return ((mantissa + 1) << shift) - 1;
+	}
+
+	static unsigned log2(std::uint64_t value)
+	{
+#ifdef __GNUC__
+	  return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#else
+	  unsigned e = 0;
+	  while (value >>= 1)
+	    ++e;
+	  return e;
+#endif
+	}
+
+	std::vector<std::uint64_t> _counts = std::vector<std::uint64_t>(bucket_count);
+	std::uint64_t _total = 0;
+	std::uint64_t _max = 0;
+    };
+  } // bench
+} // nonstd
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "legacy_memory_block.h"
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+namespace nonstd
+{
+  /**
+   * @class block_cache
+   * @brief Process-wide recycler of memory blocks of Size bytes.
+   *
+   * Released blocks are reset and kept in a small thread-local magazine, a full
+   * magazine spills half of its blocks to the shared depot and an empty one
+   * refills from it, so acquire() and release() take no lock most of the time.
+   * Blocks beyond the depot's capacity go back to malloc. Once a thread's
+   * magazine is destroyed (blocks released late in its exit or during the
+   * static destruction) the thread goes to the depot directly. Neither the
+   * magazines nor the depot allocate, so the noexcept paths can't throw.
+   */
+  template<size_t Size>
+    class block_cache
+    {
+      public:
+	using block = nonstd::legacy::memory_block;
+
+	static constexpr size_t magazine_size = 8;
+	static constexpr size_t depot_size = 64;
+
+	//! Recycled or new block with a single reference, nullptr if out of memory
+	static block * acquire() noexcept
+	{
+	  if (magazine * m = local())
+	  {
+	    if (!m->count)
+	      m->refill();
+	    if (m->count)
+	      return m->blocks[--m->count];
+	  }
+	  else if (block * b = take_shared())
+	    return b;
+
+	  block * b = new(std::nothrow) block(Size);
+	  if (b && !b->initialized())
+	  {
+	    delete b;
+	    return nullptr;
+	  }
+	  return b;
+	}
+
+	//! Takes back a block no one refers to anymore
+	static void release(block * b) noexcept
+	{
+	  if (!b)
+	    return;
+
+	  b->reset();
+	  magazine * m = local();
+	  if (!m)
+	  {
+	    if (!give_shared(b))
+	      delete b;
+	    return;
+	  }
+	  if (m->count == magazine_size)
+	    m->flush(magazine_size / 2);
+	  m->blocks[m->count++] = b;
+	}
+
+	//! Blocks held by the shared depot
+	static size_t cached()
+	{
+	  depot& d = shared();
+	  std::lock_guard<std::mutex> lock(d.mutex);
+	  return d.count;
+	}
+
+      private:
+	struct depot
+	{
+	  std::mutex mutex;
+	  block * blocks[depot_size];
+	  size_t count = 0;
+	};
+
+	struct magazine
+	{
+	  ~magazine()
+	  {
+	    flush(count);
+	    dead() = true;
+	  }
+
+	  //! Moves n blocks to the depot, freeing those it has no room for
+	  void flush(size_t n)
+	  {
+	    depot& d = shared();
+	    size_t moved = 0;
+	    {
+	      std::lock_guard<std::mutex> lock(d.mutex);
+	      for (; moved < n && d.count < depot_size; ++moved)
+		d.blocks[d.count++] = blocks[--count];
+	    }
+	    for (; moved < n; ++moved)
+	      delete blocks[--count];
+	  }
+
+	  //! Takes up to half a magazine of blocks from the depot
+	  void refill()
+	  {
+	    depot& d = shared();
+	    std::lock_guard<std::mutex> lock(d.mutex);
+	    while (count < magazine_size / 2 && d.count)
+	      blocks[count++] = d.blocks[--d.count];
+	  }
+
+	  block * blocks[magazine_size];
+	  size_t count = 0;
+	};
+
+	//! Calling thread's magazine, nullptr once destroyed at the thread's exit
+	static magazine * local() noexcept
+	{
+	  if (dead())
+	    return nullptr;
+	  static thread_local magazine m;
+	  return &m;
+	}
+
+	//! Set by the magazine's destructor, trivially destructible so still readable after it
+	static bool& dead() noexcept
+	{
+	  static thread_local bool d = false;
+	  return d;
+	}
+
+	//! A block of the depot, nullptr when empty
+	static block * take_shared() noexcept
+	{
+	  depot& d = shared();
+	  std::lock_guard<std::mutex> lock(d.mutex);
+	  if (!d.count)
+	    return nullptr;
+	  return d.blocks[--d.count];
+	}
+
+	//! Puts the block to the depot, false when it is full
+	static bool give_shared(block * b) noexcept
+	{
+	  depot& d = shared();
+	  std::lock_guard<std::mutex> lock(d.mutex);
+	  if (d.count >= depot_size)
+	    return false;
+	  d.blocks[d.count++] = b;
+	  return true;
+	}
+
+	//! Never destroyed so blocks released during the static destruction still have a place to go
+	static depot& shared() noexcept
+	{
+	  alignas(depot) static unsigned char storage[sizeof(depot)];
+	  static depot& d = *new(storage) depot;
+	  return d;
+	}
+    };
+} // nonstd
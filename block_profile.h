@@ -0,0 +1,192 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+namespace nonstd
+{
+  //! Constructor tag of the blocks sized from the learned profile
+  struct adaptive_t
+  {
+    explicit adaptive_t() = default;
+  };
+
+  constexpr adaptive_t adaptive{};
+
+  /**
+   * @class block_profile
+   * @brief Process-wide high-water marks of the blocks, per allocation tag.
+   *
+   * A block records the most bytes it ever held once it retires, to the
+   * entry of its tag. Adaptive blocks ask the entry for the high-water mark at
+   * percentile() so the sizes converge to the actual demand. The profile may be
+   * saved and loaded again at startup, NONSTD_BLOCK_PROFILE names a file loaded
+   * upon first use and saved at exit.
+   */
+  class block_profile
+  {
+    public:
+      //! Log-linear histogram of high-water marks, 2^sub_bits buckets per power of two
+      class entry
+      {
+	public:
+	  static constexpr unsigned sub_bits = 3;
+	  static constexpr std::size_t sub_count = std::size_t{1} << sub_bits;
+	  static constexpr std::size_t bucket_count = (64 - sub_bits + 1) * sub_count;
+
+	  void record(std::size_t high_water) noexcept
+	  {
+	    _counts[index(high_water)].fetch_add(1, std::memory_order_relaxed);
+	  }
+
+	  std::uint64_t samples() const
+	  {
+	    std::uint64_t total = 0;
+	    for (const auto& c : _counts)
+	      total += c.load(std::memory_order_relaxed);
+	    return total;
+	  }
+
+	  //! Upper bound of the bucket holding percentile p, 0 without samples
+	  std::size_t percentile(double p) const
+	  {
+	    const std::uint64_t total = samples();
+	    const std::uint64_t rank = static_cast<std::uint64_t>(p / 100.0 * static_cast<double>(total) + 0.5);
+	    std::uint64_t seen = 0;
+	    for (std::size_t i = 0; i < bucket_count; ++i)
+	    {
+	      seen += _counts[i].load(std::memory_order_relaxed);
+	      if (seen && seen >= rank)
+		return static_cast<std::size_t>(highest(i));
+	    }
+	    return 0;
+	  }
+
+	  //! Block size at the profile's percentile, fallback until a sample is in
+	  std::size_t suggest(std::size_t fallback) const
+	  {
+	    const std::size_t size = percentile(global().percentile());
+	    return size ? size : fallback;
+	  }
+
+	private:
+	  friend class block_profile;
+
+	  static std::size_t index(std::uint64_t value)
+	  {
+	    if (value < sub_count)
+	      return static_cast<std::size_t>(value);
+	    const unsigned shift = 63 - static_cast<unsigned>(__builtin_clzll(value)) - sub_bits;
+	    return ((shift + 1) << sub_bits) + static_cast<std::size_t>((value >> shift) - sub_count);
+	  }
+
+	  static std::uint64_t highest(std::size_t i)
+	  {
+	    if (i < sub_count)
+	      return i;
+	    const unsigned shift = static_cast<unsigned>(i >> sub_bits) - 1;
+	    const std::uint64_t mantissa = (i & (sub_count - 1)) + sub_count;
+	    return ((mantissa + 1) << shift) - 1;
+	  }
+
+	  std::atomic<std::uint64_t> _counts[bucket_count] = {};
+      };
+
+      //! The profile the blocks record to, never destroyed
+      static block_profile& global()
+      {
+	static block_profile& p = *new block_profile(std::getenv("NONSTD_BLOCK_PROFILE"));
+	return p;
+      }
+
+      //! Entry of a key, created empty on first use and never removed
+      entry& operator[](const std::string& key)
+      {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _entries[key];
+      }
+
+      //! Percentile adaptive blocks are sized at, 95 by default
+      double percentile() const
+      {
+	return _percentile.load(std::memory_order_relaxed);
+      }
+
+      void set_percentile(double p)
+      {
+	_percentile.store(p, std::memory_order_relaxed);
+      }
+
+      //! Writes every entry as its key, a tab and the non-empty buckets
+      bool save(const std::string& path) const
+      {
+	std::ofstream out(path, std::ios::trunc);
+	out << header() << ' ' << entry::sub_bits << '\n';
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (const auto& e : _entries)
+	{
+	  out << e.first << '\t';
+	  for (std::size_t i = 0; i < entry::bucket_count; ++i)
+	    if (const std::uint64_t n = e.second._counts[i].load(std::memory_order_relaxed))
+	      out << i << ':' << n << ' ';
+	  out << '\n';
+	}
+	return static_cast<bool>(out.flush());
+      }
+
+      //! Adds the samples saved to path, false if it's missing or not a profile
+      bool load(const std::string& path)
+      {
+	std::ifstream in(path);
+	std::string magic;
+	unsigned bits = 0;
+	if (!(in >> magic >> bits) || magic != header() || bits != entry::sub_bits)
+	  return false;
+
+	std::string line;
+	std::getline(in, line);
+	while (std::getline(in, line))
+	{
+	  const auto tab = line.find('\t');
+	  if (tab == std::string::npos)
+	    continue;
+	  entry& e = (*this)[line.substr(0, tab)];
+	  std::istringstream buckets(line.substr(tab + 1));
+	  std::size_t i;
+	  char colon;
+	  std::uint64_t n;
+	  while (buckets >> i >> colon >> n)
+	    if (i < entry::bucket_count)
+	      e._counts[i].fetch_add(n, std::memory_order_relaxed);
+	}
+	return true;
+      }
+
+    private:
+      static const char * header()
+      {
+	return "nonstd_block_profile";
+      }
+
+      explicit block_profile(const char * path)
+      {
+	if (!path || !*path)
+	  return;
+	_path = path;
+	load(_path);
+	std::atexit([]() { global().save(global()._path); });
+      }
+
+      mutable std::mutex _mutex;
+      std::map<std::string, entry> _entries;
+      std::atomic<double> _percentile{95.0};
+      std::string _path;
+  };
+} // nonstd
@@ -0,0 +1,1041 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <tuple>
+#include <initializer_list>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+
+namespace nonstd
+{
+  //! Constructor and insert tag of the ranges already sorted by the key, without duplicates
+  struct sorted_unique_t
+  {
+    explicit sorted_unique_t() = default;
+  };
+
+  constexpr sorted_unique_t sorted_unique{};
+
+  namespace btree_details
+  {
+    template<typename V, std::size_t Slots>
+      struct inner_node;
+
+    //! Leaf node, the values live in raw slots constructed through the map's allocator
+    template<typename V, std::size_t Slots>
+      struct node
+      {
+	using slot_type = typename std::aligned_storage<sizeof(V), alignof(V)>::type;
+
+	explicit node(bool is_leaf)
+	  : leaf(is_leaf)
+	{}
+
+	V * slot(std::size_t i)
+	{
+	  return reinterpret_cast<V *>(&slots[i]);
+	}
+
+	V& value(std::size_t i)
+	{
+	  return *slot(i);
+	}
+
+	inner_node<V, Slots> * parent = nullptr;
+	std::uint16_t position = 0; //! index among the parent's children
+	std::uint16_t count = 0;    //! values held
+	const bool leaf;
+	slot_type slots[Slots];
+      };
+
+    //! Inner node, children[i] holds the values ordered before value(i)
+    template<typename V, std::size_t Slots>
+      struct inner_node : node<V, Slots>
+      {
+	inner_node()
+	  : node<V, Slots>(false)
+	{}
+
+	node<V, Slots> * children[Slots + 1];
+      };
+
+    template<typename V, std::size_t Slots>
+      inner_node<V, Slots> * inner(node<V, Slots> * n)
+      {
+	return static_cast<inner_node<V, Slots> *>(n);
+      }
+
+    //! Bidirectional iterator over the values in order, end() is past the root's last value
+    template<typename V, std::size_t Slots, bool Const>
+      struct iterator
+      {
+	using value_type = V;
+	using reference = typename std::conditional<Const, const V&, V&>::type;
+	using pointer = typename std::conditional<Const, const V*, V*>::type;
+	using iterator_category = std::bidirectional_iterator_tag;
+	using difference_type = std::ptrdiff_t;
+	using node_type = node<V, Slots>;
+
+	iterator() = default;
+
+	iterator(node_type * n, std::size_t i)
+	  : _node(n)
+	  , _position(i)
+	{}
+
+	//! Mutable to constant conversion
+	template<bool C = Const, typename = typename std::enable_if<C>::type>
+	  iterator(const iterator<V, Slots, false>& other)
+	    : _node(other._node)
+	    , _position(other._position)
+	  {}
+
+	reference operator*() const
+	{
+	  return _node->value(_position);
+	}
+
+	pointer operator->() const
+	{
+	  return _node->slot(_position);
+	}
+
+	iterator& operator++()
+	{
+	  if (!_node->leaf)
+	  {
+	    _node = inner(_node)->children[_position + 1];
+	    while (!_node->leaf)
+	      _node = inner(_node)->children[0];
+	    _position = 0;
+	    return *this;
+	  }
+	  ++_position;
+	  while (_position == _node->count && _node->parent)
+	  {
+	    _position = _node->position;
+	    _node = _node->parent;
+	  }
+	  return *this;
+	}
+
+	iterator operator++(int)
+	{
+	  iterator it = *this;
+	  ++(*this);
+	  return it;
+	}
+
+	iterator& operator--()
+	{
+	  if (!_node->leaf)
+	  {
+	    _node = inner(_node)->children[_position];
+	    while (!_node->leaf)
+	      _node = inner(_node)->children[_node->count];
+	    _position = _node->count - 1u;
+	    return *this;
+	  }
+	  while (!_position && _node->parent)
+	  {
+	    _position = _node->position;
+	    _node = _node->parent;
+	  }
+	  --_position;
+	  return *this;
+	}
+
+	iterator operator--(int)
+	{
+	  iterator it = *this;
+	  --(*this);
+	  return it;
+	}
+
+	friend bool operator==(const iterator& lhs, const iterator& rhs)
+	{
+	  return (lhs._node == rhs._node && lhs._position == rhs._position);
+	}
+
+	friend bool operator!=(const iterator& lhs, const iterator& rhs)
+	{
+	  return !(lhs == rhs);
+	}
+
+	node_type * _node = nullptr;
+	std::size_t _position = 0;
+      };
+  } // btree_details
+
+  /**
+   * @class btree_map
+   * @brief Ordered map keeping many values per node, a std::map alternative.
+   *
+   * Every node holds as many values as fit in NodeBytes, so a lookup touches
+   * a few cache lines per level instead of one node per comparison, and the
+   * allocator is asked for a node every so many insertions only. Leaves and
+   * inner nodes come from the allocator rebound to their types, a humble
+   * allocator thus keeps each kind in its own block. Ranges sorted by the key
+   * load in O(n), packing the nodes full.
+   *
+   * Unlike std::map, insertion and erasure invalidate all the iterators.
+   */
+  template <
+    typename Key
+    , typename T
+    , typename Compare = std::less<Key>
+    , typename Allocator = std::allocator<std::pair<const Key, T>>
+    , std::size_t NodeBytes = 256
+    >
+  class btree_map
+  {
+    public:
+      using key_type = Key;
+      using mapped_type = T;
+      using value_type = std::pair<const Key, T>;
+      using reference = value_type&;
+      using const_reference = const value_type&;
+      using difference_type = std::ptrdiff_t;
+      using size_type = size_t;
+      using key_compare = Compare;
+      using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<value_type>;
+
+    private:
+      struct header
+      {
+	void * parent;
+	std::uint16_t position;
+	std::uint16_t count;
+	bool leaf;
+      };
+
+    public:
+      //! Values per node, as many as fit in NodeBytes next to the node's header
+      static constexpr size_type slot_count = (NodeBytes - sizeof(header)) / sizeof(value_type) > 3
+	? (NodeBytes - sizeof(header)) / sizeof(value_type) : 3;
+      static_assert(slot_count < 65536, "node positions are 16 bits wide");
+
+      using iterator = btree_details::iterator<value_type, slot_count, false>;
+      using const_iterator = btree_details::iterator<value_type, slot_count, true>;
+      using reverse_iterator = std::reverse_iterator<iterator>;
+      using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    private:
+      using node_type = btree_details::node<value_type, slot_count>;
+      using inner_type = btree_details::inner_node<value_type, slot_count>;
+      using allocator_traits = std::allocator_traits<allocator_type>;
+      using leaf_allocator_type = typename allocator_traits::template rebind_alloc<node_type>;
+      using inner_allocator_type = typename allocator_traits::template rebind_alloc<inner_type>;
+      using leaf_allocator_traits = std::allocator_traits<leaf_allocator_type>;
+      using inner_allocator_traits = std::allocator_traits<inner_allocator_type>;
+
+      //! Fewest values a node but the root holds, merging two such nodes still fits
+      static constexpr size_type min_count = (slot_count - 1) / 2;
+
+      //! Value followed through the rebalancing, count() of its node stands for the next one up the tree
+      struct cursor
+      {
+	node_type * node;
+	size_type position;
+      };
+
+    public:
+
+      btree_map() = default;
+
+      explicit btree_map(const Compare& compare, const allocator_type& alloc = allocator_type())
+	: _compare(compare)
+	, _allocator(alloc)
+	, _leaf_allocator(alloc)
+	, _inner_allocator(alloc)
+      {}
+
+      explicit btree_map(const allocator_type& alloc)
+	: btree_map(Compare(), alloc)
+      {}
+
+      btree_map(std::initializer_list<value_type> l, const Compare& compare = Compare(), const allocator_type& alloc = allocator_type())
+	: btree_map(compare, alloc)
+      {
+	insert(l);
+      }
+
+      template<typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+	btree_map(InputIt first, InputIt last, const Compare& compare = Compare(), const allocator_type& alloc = allocator_type())
+	  : btree_map(compare, alloc)
+	{
+	  insert(first, last);
+	}
+
+      //! Bulk load of a range sorted by the key without duplicates, in O(n)
+      template<typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+	btree_map(sorted_unique_t, InputIt first, InputIt last, const Compare& compare = Compare(), const allocator_type& alloc = allocator_type())
+	  : btree_map(compare, alloc)
+	{
+	  insert(sorted_unique, first, last);
+	}
+
+      btree_map(const btree_map& other)
+	: btree_map(other._compare, allocator_traits::select_on_container_copy_construction(other._allocator))
+      {
+	insert(sorted_unique, other.begin(), other.end());
+      }
+
+      btree_map(btree_map&& other)
+	: _compare(std::move(other._compare))
+	, _allocator(std::move(other._allocator))
+	, _leaf_allocator(std::move(other._leaf_allocator))
+	, _inner_allocator(std::move(other._inner_allocator))
+      {
+	swap(other);
+      }
+
+      btree_map& operator=(const btree_map& other)
+      {
+	if (&other != this)
+	{
+	  clear();
+	  _compare = other._compare;
+	  insert(sorted_unique, other.begin(), other.end());
+	}
+	return *this;
+      }
+
+      btree_map& operator=(btree_map&& other)
+      {
+	if (&other != this)
+	{
+	  clear();
+	  if (_allocator == other._allocator)
+	    swap(other);
+	  else
+	  {
+	    _compare = other._compare;
+	    insert(sorted_unique, std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+	  }
+	}
+	return *this;
+      }
+
+      ~btree_map()
+      {
+	clear();
+      }
+
+      allocator_type get_allocator() const
+      {
+	return _allocator;
+      }
+
+      key_compare key_comp() const
+      {
+	return _compare;
+      }
+
+      //! Swaps the trees only, the allocators are expected to be equal
+      void swap(btree_map& other)
+      {
+	using std::swap;
+	swap(other._compare, _compare);
+	swap(other._root, _root);
+	swap(other._size, _size);
+      }
+
+      friend void swap(btree_map& lhs, btree_map& rhs)
+      {
+	lhs.swap(rhs);
+      }
+
+      friend bool operator==(const btree_map& lhs, const btree_map& rhs)
+      {
+	return (lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin()));
+      }
+
+      friend bool operator!=(const btree_map& lhs, const btree_map& rhs)
+      {
+	return !(lhs == rhs);
+      }
+
+      iterator begin()
+      {
+	if (!_root)
+	  return end();
+	node_type * n = _root;
+	while (!n->leaf)
+	  n = btree_details::inner(n)->children[0];
+	return iterator(n, 0);
+      }
+
+      const_iterator begin() const
+      {
+	return const_cast<btree_map *>(this)->begin();
+      }
+
+      iterator end()
+      {
+	return iterator(_root, _root ? _root->count : 0);
+      }
+
+      const_iterator end() const
+      {
+	return const_cast<btree_map *>(this)->end();
+      }
+
+      const_iterator cbegin() const
+      {
+	return begin();
+      }
+
+      const_iterator cend() const
+      {
+	return end();
+      }
+
+      reverse_iterator rbegin()
+      {
+	return reverse_iterator(end());
+      }
+
+      const_reverse_iterator rbegin() const
+      {
+	return const_reverse_iterator(end());
+      }
+
+      reverse_iterator rend()
+      {
+	return reverse_iterator(begin());
+      }
+
+      const_reverse_iterator rend() const
+      {
+	return const_reverse_iterator(begin());
+      }
+
+      bool empty() const
+      {
+	return (_size == 0);
+      }
+
+      size_type size() const
+      {
+	return _size;
+      }
+
+      size_type max_size() const
+      {
+	return allocator_traits::max_size(_allocator);
+      }
+
+      //! Levels from the root down to the leaves, 0 when empty
+      size_type height() const
+      {
+	size_type levels = 0;
+	for (node_type * n = _root; n; n = n->leaf ? nullptr : btree_details::inner(n)->children[0])
+	  ++levels;
+	return levels;
+      }
+
+      void clear()
+      {
+	if (_root)
+	  destroy(_root);
+	_root = nullptr;
+	_size = 0;
+      }
+
+      iterator find(const key_type& key)
+      {
+	iterator it = lower_bound(key);
+	return (it != end() && !_compare(key, it->first)) ? it : end();
+      }
+
+      const_iterator find(const key_type& key) const
+      {
+	return const_cast<btree_map *>(this)->find(key);
+      }
+
+      size_type count(const key_type& key) const
+      {
+	return (find(key) != end());
+      }
+
+      //! First value not ordered before key
+      iterator lower_bound(const key_type& key)
+      {
+	iterator result = end();
+	for (node_type * n = _root; n; )
+	{
+	  const size_type i = lower_index(n, key);
+	  if (i < n->count)
+	  {
+	    result = iterator(n, i);
+	    if (!_compare(key, n->value(i).first))
+	      break;
+	  }
+	  n = n->leaf ? nullptr : btree_details::inner(n)->children[i];
+	}
+	return result;
+      }
+
+      const_iterator lower_bound(const key_type& key) const
+      {
+	return const_cast<btree_map *>(this)->lower_bound(key);
+      }
+
+      //! First value ordered after key
+      iterator upper_bound(const key_type& key)
+      {
+	iterator it = lower_bound(key);
+	if (it != end() && !_compare(key, it->first))
+	  ++it;
+	return it;
+      }
+
+      const_iterator upper_bound(const key_type& key) const
+      {
+	return const_cast<btree_map *>(this)->upper_bound(key);
+      }
+
+      std::pair<iterator, iterator> equal_range(const key_type& key)
+      {
+	return {lower_bound(key), upper_bound(key)};
+      }
+
+      std::pair<const_iterator, const_iterator> equal_range(const key_type& key) const
+      {
+	return {lower_bound(key), upper_bound(key)};
+      }
+
+      mapped_type& at(const key_type& key)
+      {
+	iterator it = find(key);
+	if (it == end())
+	  throw std::out_of_range("btree_map key not found");
+	return it->second;
+      }
+
+      const mapped_type& at(const key_type& key) const
+      {
+	return const_cast<btree_map *>(this)->at(key);
+      }
+
+      mapped_type& operator[](const key_type& key)
+      {
+	return try_emplace(key).first->second;
+      }
+
+      mapped_type& operator[](key_type&& key)
+      {
+	return try_emplace(std::move(key)).first->second;
+      }
+
+      std::pair<iterator, bool> insert(const value_type& value)
+      {
+	return emplace_key(value.first, value);
+      }
+
+      std::pair<iterator, bool> insert(value_type&& value)
+      {
+	return emplace_key(value.first, std::move(value));
+      }
+
+      //! The hint is ignored, a lookup costs about as much as checking it
+      iterator insert(const_iterator, const value_type& value)
+      {
+	return insert(value).first;
+      }
+
+      iterator insert(const_iterator, value_type&& value)
+      {
+	return insert(std::move(value)).first;
+      }
+
+      template<typename... Args>
+	iterator emplace_hint(const_iterator, Args&&... args)
+	{
+	  return emplace(std::forward<Args>(args)...).first;
+	}
+
+      template<typename InputIt>
+	void insert(InputIt first, InputIt last)
+	{
+	  for (; first != last; ++first)
+	    insert(*first);
+	}
+
+      void insert(std::initializer_list<value_type> l)
+      {
+	insert(l.begin(), l.end());
+      }
+
+      /**
+       * Loads a range sorted by the key without duplicates into an empty map
+       * in O(n), packing the nodes full. A map holding values already gets the
+       * range inserted value by value.
+       */
+      template<typename InputIt>
+	void insert(sorted_unique_t, InputIt first, InputIt last)
+	{
+	  if (_root)
+	  {
+	    insert(first, last);
+	    return;
+	  }
+
+	  node_type * leaf = nullptr;
+	  try
+	  {
+	    for (; first != last; ++first)
+	      append(leaf, *first);
+	  }
+	  catch(...)
+	  {
+	    repair_right_spine();
+	    throw;
+	  }
+	  repair_right_spine();
+	}
+
+      template<typename... Args>
+	std::pair<iterator, bool> emplace(Args&&... args)
+	{
+	  value_type value(std::forward<Args>(args)...);
+	  return emplace_key(value.first, std::move(value));
+	}
+
+      template<typename... Args>
+	std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args)
+	{
+	  return emplace_key(key, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+	}
+
+      template<typename... Args>
+	std::pair<iterator, bool> try_emplace(key_type&& key, Args&&... args)
+	{
+	  return emplace_key(key, std::piecewise_construct, std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+	}
+
+      //! Returns the iterator following the erased value
+      iterator erase(const_iterator pos)
+      {
+	node_type * n = pos._node;
+	size_type i = pos._position;
+	const bool inner = !n->leaf;
+	destroy_value(n, i);
+	if (inner)
+	{
+	  // the predecessor from the rightmost leaf on the left takes the erased value's place
+	  node_type * leaf = btree_details::inner(n)->children[i];
+	  while (!leaf->leaf)
+	    leaf = btree_details::inner(leaf)->children[leaf->count];
+	  transfer(n, i, leaf, leaf->count - 1u);
+	  n = leaf;
+	  i = leaf->count - 1u;
+	}
+	else
+	{
+	  for (size_type j = i + 1; j < n->count; ++j)
+	    transfer(n, j - 1, n, j);
+	}
+	--n->count;
+	--_size;
+
+	// the value after the leaf's last is the predecessor, once moved up
+	cursor next{n, inner ? n->count : i};
+	while (n != _root && n->count < min_count)
+	  n = rebalance(n, next);
+	shrink_root(next);
+
+	iterator it(next.node, next.position);
+	while (it._node && it._position == it._node->count && it._node->parent)
+	{
+	  it._position = it._node->position;
+	  it._node = it._node->parent;
+	}
+	if (inner)
+	  ++it;
+	return it;
+      }
+
+      iterator erase(iterator pos)
+      {
+	return erase(const_iterator(pos));
+      }
+
+      iterator erase(const_iterator first, const_iterator last)
+      {
+	// every erasure invalidates last, so count the values upfront
+	for (difference_type n = std::distance(first, last); n > 0; --n)
+	  first = erase(first);
+	return iterator(first._node, first._position);
+      }
+
+      size_type erase(const key_type& key)
+      {
+	iterator it = find(key);
+	if (it == end())
+	  return 0;
+	erase(it);
+	return 1;
+      }
+
+    private:
+      //! First slot of n not ordered before key, by binary search
+      size_type lower_index(node_type * n, const key_type& key) const
+      {
+	size_type first = 0;
+	size_type count = n->count;
+	while (count)
+	{
+	  const size_type half = count / 2;
+	  if (_compare(n->value(first + half).first, key))
+	  {
+	    first += half + 1;
+	    count -= half + 1;
+	  }
+	  else
+	    count = half;
+	}
+	return first;
+      }
+
+      node_type * new_leaf()
+      {
+	node_type * n = leaf_allocator_traits::allocate(_leaf_allocator, 1);
+	return new(n) node_type(true);
+      }
+
+      inner_type * new_inner()
+      {
+	inner_type * n = inner_allocator_traits::allocate(_inner_allocator, 1);
+	return new(n) inner_type();
+      }
+
+      void delete_node(node_type * n)
+      {
+	if (n->leaf)
+	{
+	  n->~node_type();
+	  leaf_allocator_traits::deallocate(_leaf_allocator, n, 1);
+	}
+	else
+	{
+	  inner_type * i = btree_details::inner(n);
+	  i->~inner_type();
+	  inner_allocator_traits::deallocate(_inner_allocator, i, 1);
+	}
+      }
+
+      //! Frees the subtree of n along with its values
+      void destroy(node_type * n)
+      {
+	for (size_type i = 0; i < n->count; ++i)
+	  destroy_value(n, i);
+	if (!n->leaf)
+	  for (size_type i = 0; i <= n->count; ++i)
+	    destroy(btree_details::inner(n)->children[i]);
+	delete_node(n);
+      }
+
+      template<typename... Args>
+	void construct_value(node_type * n, size_type i, Args&&... args)
+	{
+	  allocator_traits::construct(_allocator, n->slot(i), std::forward<Args>(args)...);
+	}
+
+      void destroy_value(node_type * n, size_type i)
+      {
+	allocator_traits::destroy(_allocator, n->slot(i));
+      }
+
+      //! Moves the value of slot si of src into the empty slot di of dst, leaving si empty
+      void transfer(node_type * dst, size_type di, node_type * src, size_type si)
+      {
+	construct_value(dst, di, std::move(src->value(si)));
+	destroy_value(src, si);
+      }
+
+      void set_child(inner_type * p, size_type i, node_type * child)
+      {
+	p->children[i] = child;
+	child->parent = p;
+	child->position = static_cast<std::uint16_t>(i);
+      }
+
+      //! Opens an empty slot at i in n, along with an empty child slot at i + 1 in an inner node
+      void open_slot(node_type * n, size_type i)
+      {
+	for (size_type j = n->count; j > i; --j)
+	  transfer(n, j, n, j - 1);
+	if (!n->leaf)
+	  for (size_type j = n->count + 1u; j > i + 1; --j)
+	    set_child(btree_details::inner(n), j, btree_details::inner(n)->children[j - 1]);
+	++n->count;
+      }
+
+      //! Closes the empty slot at i in n, along with the child slot at i + 1 in an inner node
+      void close_slot(node_type * n, size_type i)
+      {
+	for (size_type j = i + 1; j < n->count; ++j)
+	  transfer(n, j - 1, n, j);
+	if (!n->leaf)
+	  for (size_type j = i + 2; j <= n->count; ++j)
+	    set_child(btree_details::inner(n), j - 1, btree_details::inner(n)->children[j]);
+	--n->count;
+      }
+
+      template<typename... Args>
+	std::pair<iterator, bool> emplace_key(const key_type& key, Args&&... args)
+	{
+	  if (!_root)
+	    _root = new_leaf();
+
+	  node_type * n = _root;
+	  for (;;)
+	  {
+	    const size_type i = lower_index(n, key);
+	    if (i < n->count && !_compare(key, n->value(i).first))
+	      return {iterator(n, i), false};
+	    if (n->leaf)
+	      return {insert_at(n, i, std::forward<Args>(args)...), true};
+	    n = btree_details::inner(n)->children[i];
+	  }
+	}
+
+      //! Constructs a value at slot i of leaf n, splitting the full nodes on the way up
+      template<typename... Args>
+	iterator insert_at(node_type * n, size_type i, Args&&... args)
+	{
+	  if (n->count == slot_count)
+	  {
+	    node_type * sibling = split(n);
+	    if (i > n->count)
+	    {
+	      i -= n->count + 1u;
+	      n = sibling;
+	    }
+	  }
+	  open_slot(n, i);
+	  try
+	  {
+	    construct_value(n, i, std::forward<Args>(args)...);
+	  }
+	  catch(...)
+	  {
+	    close_slot(n, i);
+	    throw;
+	  }
+	  ++_size;
+	  return iterator(n, i);
+	}
+
+      //! Moves the upper half of the full node n to a new right sibling, the median goes up
+      node_type * split(node_type * n)
+      {
+	if (!n->parent)
+	{
+	  inner_type * root = new_inner();
+	  set_child(root, 0, n);
+	  _root = root;
+	}
+	else if (n->parent->count == slot_count)
+	  split(n->parent);
+
+	inner_type * p = n->parent;
+	node_type * sibling = n->leaf ? new_leaf() : new_inner();
+	const size_type mid = slot_count / 2;
+	for (size_type j = mid + 1; j < slot_count; ++j)
+	  transfer(sibling, j - mid - 1, n, j);
+	if (!n->leaf)
+	  for (size_type j = mid + 1; j <= slot_count; ++j)
+	    set_child(btree_details::inner(sibling), j - mid - 1, btree_details::inner(n)->children[j]);
+	sibling->count = static_cast<std::uint16_t>(slot_count - mid - 1);
+
+	const size_type k = n->position;
+	open_slot(p, k);
+	transfer(p, k, n, mid);
+	set_child(p, k + 1, sibling);
+	n->count = static_cast<std::uint16_t>(mid);
+	return sibling;
+      }
+
+      /**
+       * Appends a value ordered after all the others to the rightmost leaf.
+       * Once the leaf is full the value goes up to the lowest ancestor with
+       * room, followed by a fresh right spine of empty nodes down to a new
+       * rightmost leaf, so every node but the spine is packed full.
+       */
+      template<typename Arg>
+	void append(node_type *& leaf, Arg&& arg)
+	{
+	  if (!leaf)
+	    _root = leaf = new_leaf();
+	  if (leaf->count < slot_count)
+	  {
+	    construct_value(leaf, leaf->count, std::forward<Arg>(arg));
+	    ++leaf->count;
+	    ++_size;
+	    return;
+	  }
+
+	  node_type * n = leaf;
+	  while (n->parent && n->parent->count == slot_count)
+	    n = n->parent;
+	  if (!n->parent)
+	  {
+	    inner_type * root = new_inner();
+	    set_child(root, 0, n);
+	    _root = root;
+	  }
+	  inner_type * p = n->parent;
+	  construct_value(p, p->count, std::forward<Arg>(arg));
+	  ++p->count;
+	  ++_size;
+
+	  inner_type * parent = p;
+	  for (node_type * level = n; ; level = btree_details::inner(level)->children[level->count])
+	  {
+	    node_type * spine = level->leaf ? new_leaf() : new_inner();
+	    set_child(parent, parent->count, spine);
+	    if (spine->leaf)
+	    {
+	      leaf = spine;
+	      break;
+	    }
+	    parent = btree_details::inner(spine);
+	  }
+	}
+
+      //! Tops the right spine the appends left short up from the full left siblings, root first
+      void repair_right_spine()
+      {
+	cursor unused{nullptr, 0};
+	for (node_type * n = _root; n && !n->leaf; )
+	{
+	  inner_type * p = btree_details::inner(n);
+	  node_type * child = p->children[p->count];
+	  while (child->count < min_count)
+	    borrow_from_left(p->children[p->count - 1u], child, unused);
+	  n = child;
+	}
+	shrink_root(unused);
+      }
+
+      /**
+       * Refills the short node n from a sibling with values to spare, or merges
+       * it with one. Returns n if it borrowed, the parent, which lost a value,
+       * if it merged.
+       */
+      node_type * rebalance(node_type * n, cursor& c)
+      {
+	inner_type * p = n->parent;
+	const size_type k = n->position;
+	node_type * left = k ? p->children[k - 1] : nullptr;
+	node_type * right = k < p->count ? p->children[k + 1] : nullptr;
+
+	if (left && left->count > min_count)
+	{
+	  borrow_from_left(left, n, c);
+	  return n;
+	}
+	if (right && right->count > min_count)
+	{
+	  borrow_from_right(n, right);
+	  return n;
+	}
+	if (left)
+	  merge(left, n, c);
+	else
+	  merge(n, right, c);
+	return p;
+      }
+
+      //! Rotates the left sibling's last value up, the separator down to the front of n
+      void borrow_from_left(node_type * left, node_type * n, cursor& c)
+      {
+	inner_type * p = n->parent;
+	const size_type k = n->position;
+	for (size_type j = n->count; j > 0; --j)
+	  transfer(n, j, n, j - 1);
+	if (!n->leaf)
+	  for (size_type j = n->count + 1u; j > 0; --j)
+	    set_child(btree_details::inner(n), j, btree_details::inner(n)->children[j - 1]);
+	transfer(n, 0, p, k - 1);
+	transfer(p, k - 1, left, left->count - 1u);
+	if (!n->leaf)
+	  set_child(btree_details::inner(n), 0, btree_details::inner(left)->children[left->count]);
+	--left->count;
+	++n->count;
+	if (c.node == n)
+	  ++c.position;
+      }
+
+      //! Rotates the right sibling's first value up, the separator down to the back of n
+      void borrow_from_right(node_type * n, node_type * right)
+      {
+	inner_type * p = n->parent;
+	const size_type k = n->position;
+	transfer(n, n->count, p, k);
+	transfer(p, k, right, 0);
+	if (!n->leaf)
+	  set_child(btree_details::inner(n), n->count + 1u, btree_details::inner(right)->children[0]);
+	for (size_type j = 1; j < right->count; ++j)
+	  transfer(right, j - 1, right, j);
+	if (!right->leaf)
+	  for (size_type j = 1; j <= right->count; ++j)
+	    set_child(btree_details::inner(right), j - 1, btree_details::inner(right)->children[j]);
+	--right->count;
+	++n->count;
+      }
+
+      //! Moves the separator and all of right into left, then frees right
+      void merge(node_type * left, node_type * right, cursor& c)
+      {
+	inner_type * p = left->parent;
+	const size_type k = left->position;
+	const size_type offset = left->count + 1u;
+	transfer(left, left->count, p, k);
+	for (size_type j = 0; j < right->count; ++j)
+	  transfer(left, offset + j, right, j);
+	if (!left->leaf)
+	  for (size_type j = 0; j <= right->count; ++j)
+	    set_child(btree_details::inner(left), offset + j, btree_details::inner(right)->children[j]);
+	left->count = static_cast<std::uint16_t>(offset + right->count);
+	if (c.node == right)
+	  c = cursor{left, offset + c.position};
+
+	close_slot(p, k);
+	right->count = 0;
+	delete_node(right);
+      }
+
+      //! Drops the roots left without values, the map's last one included
+      void shrink_root(cursor& c)
+      {
+	while (_root && !_root->count)
+	{
+	  node_type * old = _root;
+	  _root = old->leaf ? nullptr : btree_details::inner(old)->children[0];
+	  if (_root)
+	    _root->parent = nullptr;
+	  delete_node(old);
+	  if (c.node == old)
+	    c = cursor{_root, 0};
+	}
+      }
+
+    private:
+      key_compare _compare{};
+      allocator_type _allocator{};
+      leaf_allocator_type _leaf_allocator{_allocator};
+      inner_allocator_type _inner_allocator{_allocator};
+      node_type * _root = nullptr;
+      size_type _size = 0;
+  };
+}
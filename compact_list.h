@@ -0,0 +1,288 @@
+#pragma once
+
+#include "unlikely.h"
+#include "list_base.h"
+#include "legacy_memory_block.h"
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <initializer_list>
+#include <algorithm>
+
+namespace nonstd
+{
+  /**
+   * @class compact_list
+   * @brief Singly-linked list of at most N elements living in its own memory block.
+   *
+   * The nodes link each other by 32-bit offsets from the block's beginning,
+   * so a node of a small T takes half the space of list_details::node<T>.
+   */
+  template <typename T, size_t N>
+  class compact_list
+  {
+    private:
+      using node_type = list_details::compact_node<T>;
+      using header_type = list_details::compact_header;
+      using block = nonstd::legacy::memory_block;
+
+      //! Room for N nodes, along with their redzones in ASan builds
+      constexpr static size_t block_size = details::asan_padded(N * sizeof(node_type), sizeof(node_type));
+
+      static_assert(block_size <= list_details::npos, "the block must fit 32-bit offsets");
+
+    public:
+      using value_type = T;
+      using reference = T&;
+      using const_reference = const T&;
+      using difference_type = std::ptrdiff_t;
+      using size_type = size_t;
+      using iterator = list_details::compact_iterator<T>;
+      using const_iterator = list_details::compact_const_iterator<T>;
+
+    public:
+
+      compact_list()
+	: _storage(new block(block_size))
+	, _header(reinterpret_cast<unsigned char *>(_storage->_storage))
+      {}
+
+      compact_list(std::initializer_list<value_type> l)
+	: compact_list()
+      {
+	for (const value_type& value : l)
+	  push_back(value);
+      }
+
+      template<typename InputIt>
+	compact_list(InputIt first, InputIt last)
+	  : compact_list()
+	{
+	  for (; first != last; ++first)
+	    push_back(*first);
+	}
+
+      compact_list(const compact_list& other)
+	: compact_list(other.begin(), other.end())
+      {}
+
+      //! Leaves other empty on a fresh block of its own, still usable
+      compact_list(compact_list&& other)
+	: compact_list()
+      {
+	swap(other);
+      }
+
+      compact_list& operator=(const compact_list& other)
+      {
+	if (&other != this)
+	{
+	  clear();
+	  for (const value_type& value : other)
+	    push_back(value);
+	}
+	return *this;
+      }
+
+      compact_list& operator=(compact_list&& other)
+      {
+	if (&other != this)
+	{
+	  clear();
+	  swap(other);
+	}
+	return *this;
+      }
+
+      ~compact_list()
+      {
+	clear();
+      }
+
+      void swap(compact_list& other)
+      {
+	using std::swap;
+	swap(other._storage, _storage);
+	swap(other._header, _header);
+      }
+
+      friend void swap(compact_list& lhs, compact_list& rhs)
+      {
+	lhs.swap(rhs);
+      }
+
+      friend bool operator==(const compact_list& lhs, const compact_list& rhs)
+      {
+	return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+      }
+
+      friend bool operator!=(const compact_list& lhs, const compact_list& rhs)
+      {
+	return !(lhs == rhs);
+      }
+
+      iterator begin()
+      {
+	return iterator{_header._base, _header._first};
+      }
+
+      const_iterator begin() const
+      {
+	return const_iterator{_header._base, _header._first};
+      }
+
+      iterator end()
+      {
+	return iterator{_header._base, list_details::npos};
+      }
+
+      const_iterator end() const
+      {
+	return const_iterator{_header._base, list_details::npos};
+      }
+
+      const_iterator cbegin() const
+      {
+	return begin();
+      }
+
+      const_iterator cend() const
+      {
+	return end();
+      }
+
+      constexpr size_type max_size() const
+      {
+	return N;
+      }
+
+      size_type size() const
+      {
+	return _header._size;
+      }
+
+      bool empty() const
+      {
+	return _header.empty();
+      }
+
+      void push_back(const value_type& value)
+      {
+	emplace_back(value);
+      }
+
+      void push_back(value_type&& value)
+      {
+	emplace_back(std::forward<value_type>(value));
+      }
+
+      template<typename... Args>
+      void emplace_back(Args&&... args)
+      {
+	const list_details::offset_type offset = create_node(std::forward<Args>(args)...);
+	if (_header.empty())
+	  _header._first = offset;
+	else
+	  node(_header._last)->_next = offset;
+	_header._last = offset;
+      }
+
+      void push_front(const value_type& value)
+      {
+	emplace_front(value);
+      }
+
+      void push_front(value_type&& value)
+      {
+	emplace_front(std::forward<value_type>(value));
+      }
+
+      template<typename... Args>
+      void emplace_front(Args&&... args)
+      {
+	const list_details::offset_type offset = create_node(std::forward<Args>(args)...);
+	node(offset)->_next = _header._first;
+	if (_header.empty())
+	  _header._last = offset;
+	_header._first = offset;
+      }
+
+      void pop_front()
+      {
+	if (!_header.empty())
+	{
+	  const list_details::offset_type offset = _header._first;
+	  _header._first = node(offset)->_next;
+	  if (_header.empty())
+	    _header._last = list_details::npos;
+	  destroy_node(offset);
+	}
+      }
+
+      reference front()
+      {
+	return node(_header._first)->_value;
+      }
+
+      const_reference front() const
+      {
+	return node(_header._first)->_value;
+      }
+
+      reference back()
+      {
+	return node(_header._last)->_value;
+      }
+
+      const_reference back() const
+      {
+	return node(_header._last)->_value;
+      }
+
+      void clear()
+      {
+	while (!_header.empty())
+	  pop_front();
+      }
+
+    private:
+
+      node_type * node(list_details::offset_type offset) const
+      {
+	return list_details::resolve<node_type>(_header._base, offset);
+      }
+
+      template<typename... Args>
+	list_details::offset_type create_node(Args&&... args)
+	{
+	  void * p = _storage->allocate(sizeof(node_type));
+	  if (unlikely(!p))
+	    throw std::bad_alloc();
+
+	  try
+	  {
+	    new(p) node_type(std::forward<Args>(args)...);
+	  }
+	  catch(...)
+	  {
+	    _storage->deallocate(p, sizeof(node_type));
+	    throw;
+	  }
+	  ++_header._size;
+	  return list_details::offset_of(_header._base, p);
+	}
+
+      void destroy_node(list_details::offset_type offset)
+      {
+	node_type * n = node(offset);
+	n->~node_type();
+	_storage->deallocate(n, sizeof(node_type));
+	--_header._size;
+      }
+
+    private:
+      std::unique_ptr<block> _storage;
+      header_type _header{};
+  };
+}
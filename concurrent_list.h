@@ -0,0 +1,287 @@
+#pragma once
+
+#include "list_base.h"
+#include "epoch.h"
+#include "allocator_extensions.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace nonstd
+{
+  namespace list_details
+  {
+    // Atomic access to the plain node_base::_next links shared with the other lists,
+    // the lowest bit of a link marks its owner node as logically deleted.
+
+    inline node_base * load_next(const node_base * node)
+    {
+      return __atomic_load_n(&node->_next, __ATOMIC_ACQUIRE);
+    }
+
+    inline bool exchange_next(node_base * node, node_base * expected, node_base * desired)
+    {
+      return __atomic_compare_exchange_n(&node->_next, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+
+    inline bool is_marked(const node_base * link)
+    {
+      return (reinterpret_cast<std::uintptr_t>(link) & 1);
+    }
+
+    inline node_base * marked(const node_base * link)
+    {
+      return reinterpret_cast<node_base *>(reinterpret_cast<std::uintptr_t>(link) | 1);
+    }
+
+    inline node_base * unmarked(const node_base * link)
+    {
+      return reinterpret_cast<node_base *>(reinterpret_cast<std::uintptr_t>(link) & ~std::uintptr_t{1});
+    }
+  } // list_details
+
+  /**
+   * @class concurrent_list
+   * @brief Lock-free singly-linked list of list_details::node<T>.
+   *
+   * push_front is a single CAS on the head, erase and try_pop_front mark the
+   * node's link first (Harris) and unlink it then, traversals help unlinking
+   * the marked nodes they pass. Readers never retry: for_each and contains
+   * skip the marked nodes. Unlinked nodes are reclaimed through an epoch_domain
+   * back to the allocator, which is shared by all the threads and has to be
+   * thread-safe once prepared (see allocator_extensions::prepare).
+   */
+  template <
+    typename T
+    , typename Allocator = std::allocator<T>
+    >
+  class concurrent_list
+  {
+    private:
+      using node_type = list_details::node<T>;
+      using node_base = list_details::node_base;
+
+    public:
+      using value_type = T;
+      using size_type = std::size_t;
+      using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<node_type>;
+
+      explicit concurrent_list(const allocator_type& alloc = allocator_type())
+	: _allocator(alloc)
+	, _domain(&reclaim, this)
+      {
+	// lazily set up allocators (like humble_allocator's block) mustn't race
+	if (!allocator_extensions::prepare(_allocator))
+	  throw std::bad_alloc();
+      }
+
+      concurrent_list(const concurrent_list&) = delete;
+      concurrent_list& operator=(const concurrent_list&) = delete;
+
+      //! No other thread may access the list by now
+      ~concurrent_list()
+      {
+	node_base * node = list_details::unmarked(_head._next);
+	while (node)
+	{
+	  node_base * next = list_details::unmarked(node->_next);
+	  destroy_node(static_cast<node_type *>(node));
+	  node = next;
+	}
+      }
+
+      void push_front(const value_type& value)
+      {
+	emplace_front(value);
+      }
+
+      void push_front(value_type&& value)
+      {
+	emplace_front(std::forward<value_type>(value));
+      }
+
+      template<typename... Args>
+      void emplace_front(Args&&... args)
+      {
+	node_type * node = create_node(std::forward<Args>(args)...);
+	node_base * next = list_details::load_next(&_head);
+	do
+	{
+	  node->_next = next;
+	}
+	while (!__atomic_compare_exchange_n(&_head._next, &next, node, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	_size.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      //! Copies the first value out and removes it, returns false for the empty list
+      bool try_pop_front(value_type& value)
+      {
+	epoch_domain::guard guard(_domain);
+	for (;;)
+	{
+	  auto found = find([](const node_type&) { return true; });
+	  if (!found.second)
+	    return false;
+	  if (remove(found.first, found.second))
+	  {
+	    value = static_cast<node_type *>(found.second)->_value;
+	    return true;
+	  }
+	}
+      }
+
+      //! Removes the first node holding the value, returns false if there is none
+      bool erase(const value_type& value)
+      {
+	epoch_domain::guard guard(_domain);
+	for (;;)
+	{
+	  auto found = find([&value](const node_type& node) { return node._value == value; });
+	  if (!found.second)
+	    return false;
+	  if (remove(found.first, found.second))
+	    return true;
+	}
+      }
+
+      bool contains(const value_type& value) const
+      {
+	bool found = false;
+	for_each([&](const value_type& v) { found = found || v == value; });
+	return found;
+      }
+
+      //! Visits the values present when reached, never retries
+      template<typename F>
+	void for_each(F f) const
+	{
+	  epoch_domain::guard guard(_domain);
+	  for (node_base * node = list_details::unmarked(list_details::load_next(&_head))
+	      ; node
+	      ; )
+	  {
+	    node_base * next = list_details::load_next(node);
+	    if (!list_details::is_marked(next))
+	      f(static_cast<const node_type *>(node)->_value);
+	    node = list_details::unmarked(next);
+	  }
+	}
+
+      //! Approximate while there are concurrent writers
+      size_type size() const
+      {
+	return _size.load(std::memory_order_relaxed);
+      }
+
+      bool empty() const
+      {
+	return (size() == 0);
+      }
+
+      allocator_type get_allocator() const
+      {
+	return _allocator;
+      }
+
+    private:
+      using allocator_traits = std::allocator_traits<allocator_type>;
+      using allocator_extensions = nonstd::allocator_extensions<allocator_type>;
+
+      template<typename... Args>
+	node_type * create_node(Args&&... args)
+	{
+	  node_type * node = allocator_traits::allocate(_allocator, 1);
+	  try
+	  {
+	    allocator_traits::construct(_allocator, node, std::forward<Args>(args)...);
+	  }
+	  catch(...)
+	  {
+	    allocator_traits::deallocate(_allocator, node, 1);
+	    throw;
+	  }
+	  return node;
+	}
+
+      void destroy_node(node_type * node)
+      {
+	allocator_traits::destroy(_allocator, node);
+	allocator_traits::deallocate(_allocator, node, 1);
+      }
+
+      /**
+       * Finds the first unmarked node matching the predicate and the link to it.
+       * Unlinks and retires the marked nodes on the way, restarts when beaten to it.
+       */
+      template<typename Predicate>
+	std::pair<node_base *, node_base *> find(Predicate matches)
+	{
+	retry:
+	  node_base * prev = &_head;
+	  node_base * node = list_details::unmarked(list_details::load_next(prev));
+	  while (node)
+	  {
+	    node_base * next = list_details::load_next(node);
+	    if (list_details::is_marked(next))
+	    {
+	      if (!list_details::exchange_next(prev, node, list_details::unmarked(next)))
+		goto retry;
+	      _domain.retire(node);
+	      node = list_details::unmarked(next);
+	      continue;
+	    }
+	    if (matches(*static_cast<node_type *>(node)))
+	      return {prev, node};
+	    prev = node;
+	    node = next;
+	  }
+	  return {prev, nullptr};
+	}
+
+      //! Marks the node deleted and tries to unlink it, false if someone else marked it first
+      bool remove(node_base * prev, node_base * node)
+      {
+	node_base * next = list_details::load_next(node);
+	while (!list_details::is_marked(next))
+	{
+	  if (list_details::exchange_next(node, next, list_details::marked(next)))
+	  {
+	    _size.fetch_sub(1, std::memory_order_relaxed);
+	    if (list_details::exchange_next(prev, node, next))
+	      _domain.retire(node);
+	    return true;
+	  }
+	  next = list_details::load_next(node);
+	}
+	return false;
+      }
+
+      static void reclaim(void * context, node_base ** nodes, size_type count)
+      {
+	auto self = static_cast<concurrent_list *>(context);
+	constexpr size_type batch_size = epoch_domain::batch_size;
+	node_type * batch[batch_size];
+	while (count)
+	{
+	  const size_type n = count < batch_size ? count : batch_size;
+	  for (size_type i = 0; i < n; ++i)
+	  {
+	    batch[i] = static_cast<node_type *>(nodes[i]);
+	    allocator_traits::destroy(self->_allocator, batch[i]);
+	  }
+	  allocator_extensions::deallocate_bulk(self->_allocator, batch, n);
+	  nodes += n;
+	  count -= n;
+	}
+      }
+
+    private:
+      allocator_type _allocator;
+      node_base _head{};
+      std::atomic<size_type> _size{0};
+      mutable epoch_domain _domain;
+  };
+} // nonstd
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "list_base.h"
+#include "per_thread.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nonstd
+{
+  /**
+   * @class epoch_domain
+   * @brief Epoch-based reclamation of list nodes.
+   *
+   * Readers pin the domain for as long as they hold node pointers, writers retire
+   * unlinked nodes instead of freeing them. The global epoch advances once every
+   * pinned thread has observed it, a node retired in epoch E is handed to the
+   * reclaim function in a batch with its neighbours once the epoch reaches E + 2.
+   */
+  class epoch_domain
+  {
+    public:
+      using size_type = std::size_t;
+      using node_base = list_details::node_base;
+      using reclaim_function = void (*)(void * context, node_base ** nodes, size_type count);
+
+      //! Nodes a thread retires between the attempts to advance the epoch
+      static constexpr size_type batch_size = 64;
+
+      //! Pins the domain for the calling thread for the guard's lifetime, nests
+      class guard
+      {
+	public:
+	  explicit guard(epoch_domain& domain)
+	    : _domain(domain)
+	  {
+	    _domain.pin();
+	  }
+
+	  guard(const guard&) = delete;
+	  guard& operator=(const guard&) = delete;
+
+	  ~guard()
+	  {
+	    _domain.unpin();
+	  }
+
+	private:
+	  epoch_domain& _domain;
+      };
+
+      epoch_domain(reclaim_function reclaim, void * context)
+	: _reclaim(reclaim)
+	, _context(context)
+      {}
+
+      epoch_domain(const epoch_domain&) = delete;
+      epoch_domain& operator=(const epoch_domain&) = delete;
+
+      //! No thread may hold the domain pinned by now
+      ~epoch_domain()
+      {
+	reclaim_all();
+      }
+
+      void pin()
+      {
+	record& r = _records.local();
+	if (r.depth++)
+	  return;
+
+	const std::uint64_t epoch = _epoch.load();
+	r.state.store((epoch << 1) | 1);
+	collect(r, epoch);
+      }
+
+      void unpin()
+      {
+	record& r = _records.local();
+	if (!--r.depth)
+	  r.state.store(r.state.load(std::memory_order_relaxed) & ~std::uint64_t{1}, std::memory_order_release);
+      }
+
+      //! Defers reclamation of an unlinked node until no reader may hold it
+      void retire(node_base * node)
+      {
+	record& r = _records.local();
+	const std::uint64_t epoch = _epoch.load();
+	const size_type i = epoch % 3;
+	if (r.limbo_epoch[i] != epoch)
+	{
+	  reclaim(r.limbo[i]);
+	  r.limbo_epoch[i] = epoch;
+	}
+	r.limbo[i].push_back(node);
+
+	if (++r.retired >= batch_size)
+	{
+	  r.retired = 0;
+	  try_advance();
+	  collect(r, _epoch.load());
+	}
+      }
+
+      //! Advances the epoch as far as the pinned threads allow and reclaims this thread's nodes
+      void synchronize()
+      {
+	for (int i = 0; i < 3; ++i)
+	  try_advance();
+	collect(_records.local(), _epoch.load());
+      }
+
+      std::uint64_t epoch() const
+      {
+	return _epoch.load();
+      }
+
+    protected:
+      //! Hands every retired node to the reclaim function regardless of the readers
+      void reclaim_all()
+      {
+	_records.for_each([this](record& r)
+	    {
+	      for (auto& limbo : r.limbo)
+		reclaim(limbo);
+	    });
+      }
+
+    private:
+      struct record
+      {
+	std::atomic<std::uint64_t> state{0}; //! pinned epoch << 1 | pinned flag
+	size_type depth = 0;
+	size_type retired = 0;
+	std::vector<node_base *> limbo[3];
+	std::uint64_t limbo_epoch[3] = {};
+      };
+
+      bool try_advance()
+      {
+	std::uint64_t epoch = _epoch.load();
+	bool quiescent = true;
+	_records.for_each([epoch, &quiescent](record& r)
+	    {
+	      const std::uint64_t state = r.state.load();
+	      if ((state & 1) && (state >> 1) != epoch)
+		quiescent = false;
+	    });
+	return (quiescent && _epoch.compare_exchange_strong(epoch, epoch + 1));
+      }
+
+      //! Reclaims the calling thread's nodes retired two epochs ago or earlier
+      void collect(record& r, std::uint64_t epoch)
+      {
+	for (size_type i = 0; i < 3; ++i)
+	  if (r.limbo_epoch[i] + 2 <= epoch)
+	    reclaim(r.limbo[i]);
+      }
+
+      void reclaim(std::vector<node_base *>& nodes)
+      {
+	if (!nodes.empty())
+	{
+	  _reclaim(_context, nodes.data(), nodes.size());
+	  nodes.clear();
+	}
+      }
+
+      reclaim_function _reclaim = nullptr;
+      void * _context = nullptr;
+      std::atomic<std::uint64_t> _epoch{0};
+      details::per_thread<record> _records;
+  };
+} // nonstd
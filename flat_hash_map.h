@@ -0,0 +1,821 @@
+#pragma once
+
+#include "allocator_extensions.h"
+
+#include <memory>
+#include <utility>
+#include <tuple>
+#include <initializer_list>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace nonstd
+{
+  namespace hash_details
+  {
+    //! Control byte of a slot: the 7 low bits of the hash once full, one of the markers otherwise
+    using ctrl_t = std::int8_t;
+
+    constexpr ctrl_t empty = -128;
+    constexpr ctrl_t deleted = -2;
+    constexpr ctrl_t sentinel = -1;
+
+    inline bool is_full(ctrl_t c)
+    {
+      return c >= 0;
+    }
+
+#if defined(__SSE2__)
+    //! Sixteen control bytes compared at once, one bit per byte in the masks
+    struct group
+    {
+      static constexpr std::size_t width = 16;
+      static constexpr unsigned shift = 0;
+      using mask_type = std::uint32_t;
+
+      explicit group(const ctrl_t * p)
+	: ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)))
+      {}
+
+      mask_type match(ctrl_t h2) const
+      {
+	return static_cast<mask_type>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl)));
+      }
+
+      mask_type match_empty() const
+      {
+	return match(empty);
+      }
+
+      mask_type match_empty_or_deleted() const
+      {
+	return static_cast<mask_type>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(sentinel), ctrl)));
+      }
+
+      static unsigned leading_zeros(mask_type m)
+      {
+	return static_cast<unsigned>(__builtin_clz(m)) - 16;
+      }
+
+      __m128i ctrl;
+    };
+#else
+    //! Eight control bytes compared at once within a word, the high bit of a byte per match
+    struct group
+    {
+      static constexpr std::size_t width = 8;
+      static constexpr unsigned shift = 3;
+      using mask_type = std::uint64_t;
+
+      static constexpr std::uint64_t lsbs = 0x0101010101010101ull;
+      static constexpr std::uint64_t msbs = 0x8080808080808080ull;
+
+      explicit group(const ctrl_t * p)
+      {
+	std::memcpy(&ctrl, p, sizeof(ctrl));
+      }
+
+      //! May report a false positive next to a true one, the keys are compared anyway
+      mask_type match(ctrl_t h2) const
+      {
+	const std::uint64_t x = ctrl ^ (lsbs * static_cast<std::uint8_t>(h2));
+	return (x - lsbs) & ~x & msbs;
+      }
+
+      mask_type match_empty() const
+      {
+	return (ctrl & (~ctrl << 6)) & msbs;
+      }
+
+      mask_type match_empty_or_deleted() const
+      {
+	return (ctrl & (~ctrl << 7)) & msbs;
+      }
+
+      static unsigned leading_zeros(mask_type m)
+      {
+	return static_cast<unsigned>(__builtin_clzll(m)) >> shift;
+      }
+
+      std::uint64_t ctrl;
+    };
+#endif
+
+    //! Index within the group of the lowest match in a non-zero mask
+    inline std::size_t lowest(group::mask_type m)
+    {
+      return static_cast<std::size_t>(__builtin_ctzll(m)) >> group::shift;
+    }
+
+    //! Triangular walk over the groups, visits every group of a power of two table once
+    struct probe_sequence
+    {
+      probe_sequence(std::size_t hash, std::size_t capacity)
+	: mask(capacity)
+	, offset(hash & capacity)
+      {}
+
+      std::size_t position(std::size_t i) const
+      {
+	return (offset + i) & mask;
+      }
+
+      void next()
+      {
+	index += group::width;
+	offset = (offset + index) & mask;
+      }
+
+      std::size_t mask;
+      std::size_t offset;
+      std::size_t index = 0;
+    };
+
+    template<typename V, bool Const>
+      struct iterator
+      {
+	using value_type = V;
+	using reference = typename std::conditional<Const, const V&, V&>::type;
+	using pointer = typename std::conditional<Const, const V*, V*>::type;
+	using iterator_category = std::forward_iterator_tag;
+	using difference_type = std::ptrdiff_t;
+
+	iterator() = default;
+
+	iterator(const ctrl_t * ctrl, V * slot)
+	  : _ctrl(ctrl)
+	  , _slot(slot)
+	{}
+
+	//! Mutable to constant conversion
+	template<bool C = Const, typename = typename std::enable_if<C>::type>
+	  iterator(const iterator<V, false>& other)
+	    : _ctrl(other._ctrl)
+	    , _slot(other._slot)
+	  {}
+
+	reference operator*() const
+	{
+	  return *_slot;
+	}
+
+	pointer operator->() const
+	{
+	  return _slot;
+	}
+
+	iterator& operator++()
+	{
+	  ++_ctrl;
+	  ++_slot;
+	  skip_free();
+	  return *this;
+	}
+
+	iterator operator++(int)
+	{
+	  iterator it = *this;
+	  ++(*this);
+	  return it;
+	}
+
+	//! Moves on to the next full slot, the sentinel stops at the end
+	void skip_free()
+	{
+	  while (_ctrl && *_ctrl < sentinel)
+	  {
+	    ++_ctrl;
+	    ++_slot;
+	  }
+	}
+
+	friend bool operator==(const iterator& lhs, const iterator& rhs)
+	{
+	  return (lhs._ctrl == rhs._ctrl);
+	}
+
+	friend bool operator!=(const iterator& lhs, const iterator& rhs)
+	{
+	  return !(lhs == rhs);
+	}
+
+	const ctrl_t * _ctrl = nullptr;
+	V * _slot = nullptr;
+      };
+  } // hash_details
+
+  /**
+   * @class flat_hash_map
+   * @brief Open-addressing hash map with a byte of control per slot, Swiss table style.
+   *
+   * The slots and their control bytes share a single buffer from the allocator,
+   * the slots first. A lookup compares the 7 hash bits kept in the control
+   * bytes of a whole group of slots at once (SSE2 where available) before
+   * touching any key. The table grows by asking the allocator to try_expand the
+   * buffer first, which a memory block does while the buffer is its latest
+   * allocation, and rehashes within it, so an arena holds a single table.
+   * Tombstones are cleared by a rehash in place as well.
+   *
+   * Insertion invalidates the iterators, erasure only the erased one's.
+   */
+  template <
+    typename Key
+    , typename T
+    , typename Hash = std::hash<Key>
+    , typename KeyEqual = std::equal_to<Key>
+    , typename Allocator = std::allocator<std::pair<const Key, T>>
+    >
+  class flat_hash_map
+  {
+    public:
+      using key_type = Key;
+      using mapped_type = T;
+      using value_type = std::pair<const Key, T>;
+      using reference = value_type&;
+      using const_reference = const value_type&;
+      using difference_type = std::ptrdiff_t;
+      using size_type = size_t;
+      using hasher = Hash;
+      using key_equal = KeyEqual;
+      using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<value_type>;
+      using iterator = hash_details::iterator<value_type, false>;
+      using const_iterator = hash_details::iterator<value_type, true>;
+
+    private:
+      using ctrl_t = hash_details::ctrl_t;
+      using group = hash_details::group;
+      using slot_type = typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type;
+      using buffer_allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<slot_type>;
+      using buffer_traits = std::allocator_traits<buffer_allocator_type>;
+      using allocator_extensions = nonstd::allocator_extensions<buffer_allocator_type>;
+
+      //! Smallest table, a group wraps around it at most once
+      static constexpr size_type min_capacity = group::width - 1;
+
+    public:
+
+      flat_hash_map() = default;
+
+      explicit flat_hash_map(size_type count, const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual(), const allocator_type& alloc = allocator_type())
+	: _hash(hash)
+	, _equal(equal)
+	, _allocator(alloc)
+      {
+	reserve(count);
+      }
+
+      explicit flat_hash_map(const allocator_type& alloc)
+	: _allocator(alloc)
+      {}
+
+      flat_hash_map(std::initializer_list<value_type> l, const allocator_type& alloc = allocator_type())
+	: _allocator(alloc)
+      {
+	insert(l);
+      }
+
+      template<typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+	flat_hash_map(InputIt first, InputIt last, const allocator_type& alloc = allocator_type())
+	  : _allocator(alloc)
+	{
+	  insert(first, last);
+	}
+
+      flat_hash_map(const flat_hash_map& other)
+	: _hash(other._hash)
+	, _equal(other._equal)
+	, _allocator(buffer_traits::select_on_container_copy_construction(other._allocator))
+      {
+	reserve(other.size());
+	insert(other.begin(), other.end());
+      }
+
+      flat_hash_map(flat_hash_map&& other)
+	: _hash(std::move(other._hash))
+	, _equal(std::move(other._equal))
+	, _allocator(std::move(other._allocator))
+      {
+	swap(other);
+      }
+
+      flat_hash_map& operator=(const flat_hash_map& other)
+      {
+	if (&other != this)
+	{
+	  clear();
+	  reserve(other.size());
+	  insert(other.begin(), other.end());
+	}
+	return *this;
+      }
+
+      flat_hash_map& operator=(flat_hash_map&& other)
+      {
+	if (&other != this)
+	{
+	  clear();
+	  if (_allocator == other._allocator)
+	    swap(other);
+	  else
+	  {
+	    reserve(other.size());
+	    insert(std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+	  }
+	}
+	return *this;
+      }
+
+      ~flat_hash_map()
+      {
+	destroy_values();
+	if (_slots)
+	  buffer_traits::deallocate(_allocator, _slots, buffer_size(_capacity));
+      }
+
+      allocator_type get_allocator() const
+      {
+	return allocator_type(_allocator);
+      }
+
+      hasher hash_function() const
+      {
+	return _hash;
+      }
+
+      key_equal key_eq() const
+      {
+	return _equal;
+      }
+
+      //! Swaps the tables only, the allocators are expected to be equal
+      void swap(flat_hash_map& other)
+      {
+	using std::swap;
+	swap(other._hash, _hash);
+	swap(other._equal, _equal);
+	swap(other._slots, _slots);
+	swap(other._ctrl, _ctrl);
+	swap(other._capacity, _capacity);
+	swap(other._size, _size);
+	swap(other._growth_left, _growth_left);
+      }
+
+      friend void swap(flat_hash_map& lhs, flat_hash_map& rhs)
+      {
+	lhs.swap(rhs);
+      }
+
+      friend bool operator==(const flat_hash_map& lhs, const flat_hash_map& rhs)
+      {
+	if (lhs.size() != rhs.size())
+	  return false;
+	for (const auto& v : lhs)
+	{
+	  auto it = rhs.find(v.first);
+	  if (it == rhs.end() || !(it->second == v.second))
+	    return false;
+	}
+	return true;
+      }
+
+      friend bool operator!=(const flat_hash_map& lhs, const flat_hash_map& rhs)
+      {
+	return !(lhs == rhs);
+      }
+
+      iterator begin()
+      {
+	iterator it(_ctrl, slot(0));
+	it.skip_free();
+	return it;
+      }
+
+      const_iterator begin() const
+      {
+	return const_cast<flat_hash_map *>(this)->begin();
+      }
+
+      iterator end()
+      {
+	return iterator(_ctrl ? _ctrl + _capacity : nullptr, slot(_capacity));
+      }
+
+      const_iterator end() const
+      {
+	return const_cast<flat_hash_map *>(this)->end();
+      }
+
+      const_iterator cbegin() const
+      {
+	return begin();
+      }
+
+      const_iterator cend() const
+      {
+	return end();
+      }
+
+      bool empty() const
+      {
+	return (_size == 0);
+      }
+
+      size_type size() const
+      {
+	return _size;
+      }
+
+      //! Slots of the table, 2^k - 1
+      size_type capacity() const
+      {
+	return _capacity;
+      }
+
+      size_type max_size() const
+      {
+	return buffer_traits::max_size(_allocator);
+      }
+
+      float load_factor() const
+      {
+	return _capacity ? static_cast<float>(_size) / static_cast<float>(_capacity) : 0.0f;
+      }
+
+      //! Fixed, the table grows once 7/8 of its slots have been used
+      float max_load_factor() const
+      {
+	return 0.875f;
+      }
+
+      //! Makes room for count values without growing again
+      void reserve(size_type count)
+      {
+	if (count <= growth(_capacity))
+	  return;
+	size_type capacity = _capacity ? _capacity : min_capacity;
+	while (growth(capacity) < count)
+	  capacity = 2 * capacity + 1;
+	resize(capacity);
+      }
+
+      void clear()
+      {
+	destroy_values();
+	if (_ctrl)
+	  reset_ctrl();
+	_size = 0;
+	_growth_left = growth(_capacity);
+      }
+
+      iterator find(const key_type& key)
+      {
+	if (!_capacity)
+	  return end();
+	const size_type hash = hash_of(key);
+	hash_details::probe_sequence seq(h1(hash), _capacity);
+	for (;;)
+	{
+	  const group g(_ctrl + seq.offset);
+	  for (auto m = g.match(h2(hash)); m; m &= m - 1)
+	  {
+	    const size_type i = seq.position(hash_details::lowest(m));
+	    if (_equal(slot(i)->first, key))
+	      return iterator(_ctrl + i, slot(i));
+	  }
+	  if (g.match_empty())
+	    return end();
+	  seq.next();
+	}
+      }
+
+      const_iterator find(const key_type& key) const
+      {
+	return const_cast<flat_hash_map *>(this)->find(key);
+      }
+
+      size_type count(const key_type& key) const
+      {
+	return (find(key) != end());
+      }
+
+      bool contains(const key_type& key) const
+      {
+	return (find(key) != end());
+      }
+
+      mapped_type& at(const key_type& key)
+      {
+	iterator it = find(key);
+	if (it == end())
+	  throw std::out_of_range("flat_hash_map key not found");
+	return it->second;
+      }
+
+      const mapped_type& at(const key_type& key) const
+      {
+	return const_cast<flat_hash_map *>(this)->at(key);
+      }
+
+      mapped_type& operator[](const key_type& key)
+      {
+	return try_emplace(key).first->second;
+      }
+
+      mapped_type& operator[](key_type&& key)
+      {
+	return try_emplace(std::move(key)).first->second;
+      }
+
+      std::pair<iterator, bool> insert(const value_type& value)
+      {
+	return emplace_key(value.first, value);
+      }
+
+      std::pair<iterator, bool> insert(value_type&& value)
+      {
+	return emplace_key(value.first, std::move(value));
+      }
+
+      template<typename InputIt>
+	void insert(InputIt first, InputIt last)
+	{
+	  for (; first != last; ++first)
+	    insert(*first);
+	}
+
+      void insert(std::initializer_list<value_type> l)
+      {
+	insert(l.begin(), l.end());
+      }
+
+      template<typename... Args>
+	std::pair<iterator, bool> emplace(Args&&... args)
+	{
+	  value_type value(std::forward<Args>(args)...);
+	  return emplace_key(value.first, std::move(value));
+	}
+
+      template<typename... Args>
+	std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args)
+	{
+	  return emplace_key(key, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+	}
+
+      template<typename... Args>
+	std::pair<iterator, bool> try_emplace(key_type&& key, Args&&... args)
+	{
+	  return emplace_key(key, std::piecewise_construct, std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+	}
+
+      //! Returns the iterator following the erased value
+      iterator erase(const_iterator pos)
+      {
+	const size_type i = static_cast<size_type>(pos._ctrl - _ctrl);
+	buffer_traits::destroy(_allocator, slot(i));
+	--_size;
+
+	// a probe never went past the slot if no group around it was ever full
+	const size_type before = (i - group::width) & _capacity;
+	const auto empty_after = group(_ctrl + i).match_empty();
+	const auto empty_before = group(_ctrl + before).match_empty();
+	const bool never_full = empty_before && empty_after
+	  && hash_details::lowest(empty_after) + group::leading_zeros(empty_before) < group::width;
+	set_ctrl(i, never_full ? hash_details::empty : hash_details::deleted);
+	_growth_left += never_full;
+
+	iterator it(_ctrl + i, slot(i));
+	it.skip_free();
+	return it;
+      }
+
+      iterator erase(iterator pos)
+      {
+	return erase(const_iterator(pos));
+      }
+
+      size_type erase(const key_type& key)
+      {
+	iterator it = find(key);
+	if (it == end())
+	  return 0;
+	erase(it);
+	return 1;
+      }
+
+    private:
+      //! Spreads the hash over all the bits, std::hash of an integer is the identity
+      size_type hash_of(const key_type& key) const
+      {
+	const std::uint64_t h = static_cast<std::uint64_t>(_hash(key)) * 0x9E3779B97F4A7C15ull;
+	return static_cast<size_type>(h ^ (h >> 32));
+      }
+
+      static size_type h1(size_type hash)
+      {
+	return hash >> 7;
+      }
+
+      static ctrl_t h2(size_type hash)
+      {
+	return static_cast<ctrl_t>(hash & 0x7F);
+      }
+
+      //! Values a table of capacity slots takes before growing
+      static size_type growth(size_type capacity)
+      {
+	return capacity - (capacity + 1) / 8;
+      }
+
+      //! Slots' worth of buffer holding capacity slots, then their control bytes and the cloned group
+      static size_type buffer_size(size_type capacity)
+      {
+	return capacity + (capacity + group::width + sizeof(slot_type) - 1) / sizeof(slot_type);
+      }
+
+      value_type * slot(size_type i) const
+      {
+	return reinterpret_cast<value_type *>(_slots + i);
+      }
+
+      //! Sets a control byte along with its clone past the sentinel
+      void set_ctrl(size_type i, ctrl_t c)
+      {
+	_ctrl[i] = c;
+	_ctrl[((i - (group::width - 1)) & _capacity) + (group::width - 1)] = c;
+      }
+
+      void reset_ctrl()
+      {
+	std::memset(_ctrl, static_cast<std::uint8_t>(hash_details::empty), _capacity + group::width);
+	_ctrl[_capacity] = hash_details::sentinel;
+      }
+
+      void destroy_values()
+      {
+	if (!_size)
+	  return;
+	for (size_type i = 0; i < _capacity; ++i)
+	  if (hash_details::is_full(_ctrl[i]))
+	    buffer_traits::destroy(_allocator, slot(i));
+      }
+
+      //! First empty or deleted slot on the hash's probe sequence
+      size_type find_free(size_type hash) const
+      {
+	hash_details::probe_sequence seq(h1(hash), _capacity);
+	for (;;)
+	{
+	  const auto m = group(_ctrl + seq.offset).match_empty_or_deleted();
+	  if (m)
+	    return seq.position(hash_details::lowest(m));
+	  seq.next();
+	}
+      }
+
+      template<typename... Args>
+	std::pair<iterator, bool> emplace_key(const key_type& key, Args&&... args)
+	{
+	  iterator found = find(key);
+	  if (found != end())
+	    return {found, false};
+
+	  const size_type hash = hash_of(key);
+	  if (!_capacity)
+	    resize(min_capacity);
+	  size_type i = find_free(hash);
+	  if (!_growth_left && _ctrl[i] != hash_details::deleted)
+	  {
+	    grow();
+	    i = find_free(hash);
+	  }
+
+	  buffer_traits::construct(_allocator, slot(i), std::forward<Args>(args)...);
+	  _growth_left -= (_ctrl[i] == hash_details::empty);
+	  set_ctrl(i, h2(hash));
+	  ++_size;
+	  return {iterator(_ctrl + i, slot(i)), true};
+	}
+
+      //! Doubles the table, or just clears the tombstones where they take most of the room
+      void grow()
+      {
+	if (_size * 32 <= _capacity * 25)
+	{
+	  for (size_type i = 0; i < _capacity; ++i)
+	    _ctrl[i] = hash_details::is_full(_ctrl[i]) ? hash_details::deleted : hash_details::empty;
+	  std::memcpy(_ctrl + _capacity + 1, _ctrl, group::width - 1);
+	  _ctrl[_capacity] = hash_details::sentinel;
+	  rehash_in_place();
+	}
+	else
+	  resize(2 * _capacity + 1);
+      }
+
+      //! Moves to a table of capacity slots, growing the buffer in place where the allocator can
+      void resize(size_type capacity)
+      {
+	if (_slots && allocator_extensions::try_expand(_allocator, _slots, buffer_size(_capacity), buffer_size(capacity)))
+	{
+	  // the old control bytes end before the new ones begin, the slots stay where they are
+	  const ctrl_t * old = _ctrl;
+	  const size_type old_capacity = _capacity;
+	  _capacity = capacity;
+	  _ctrl = reinterpret_cast<ctrl_t *>(_slots + capacity);
+	  reset_ctrl();
+	  for (size_type i = 0; i < old_capacity; ++i)
+	    if (hash_details::is_full(old[i]))
+	      set_ctrl(i, hash_details::deleted);
+	  rehash_in_place();
+	  return;
+	}
+
+	slot_type * slots = buffer_traits::allocate(_allocator, buffer_size(capacity));
+	slot_type * old_slots = _slots;
+	const ctrl_t * old_ctrl = _ctrl;
+	const size_type old_capacity = _capacity;
+	_slots = slots;
+	_capacity = capacity;
+	_ctrl = reinterpret_cast<ctrl_t *>(_slots + capacity);
+	reset_ctrl();
+	for (size_type i = 0; i < old_capacity; ++i)
+	  if (hash_details::is_full(old_ctrl[i]))
+	  {
+	    value_type * v = reinterpret_cast<value_type *>(old_slots + i);
+	    const size_type hash = hash_of(v->first);
+	    const size_type j = find_free(hash);
+	    transfer(j, v);
+	    set_ctrl(j, h2(hash));
+	  }
+	_growth_left = growth(_capacity) - _size;
+	if (old_slots)
+	  buffer_traits::deallocate(_allocator, old_slots, buffer_size(old_capacity));
+      }
+
+      void transfer(size_type i, value_type * from)
+      {
+	buffer_traits::construct(_allocator, slot(i), std::move(*from));
+	buffer_traits::destroy(_allocator, from);
+      }
+
+      /**
+       * Puts every value marked deleted where its probe sequence now finds a
+       * free slot first, those on the way in the same group stay. A value in
+       * the way, marked deleted too, swaps places and gets processed next.
+       */
+      void rehash_in_place()
+      {
+	slot_type spare;
+	value_type * tmp = reinterpret_cast<value_type *>(&spare);
+	for (size_type i = 0; i < _capacity; ++i)
+	{
+	  if (_ctrl[i] != hash_details::deleted)
+	    continue;
+	  const size_type hash = hash_of(slot(i)->first);
+	  const size_type j = find_free(hash);
+	  const size_type start = h1(hash) & _capacity;
+	  const auto group_of = [this, start](size_type pos) { return ((pos - start) & _capacity) / group::width; };
+	  if (group_of(i) == group_of(j))
+	  {
+	    set_ctrl(i, h2(hash));
+	    continue;
+	  }
+	  if (_ctrl[j] == hash_details::empty)
+	  {
+	    transfer(j, slot(i));
+	    set_ctrl(j, h2(hash));
+	    set_ctrl(i, hash_details::empty);
+	  }
+	  else
+	  {
+	    buffer_traits::construct(_allocator, tmp, std::move(*slot(j)));
+	    buffer_traits::destroy(_allocator, slot(j));
+	    transfer(j, slot(i));
+	    transfer(i, tmp);
+	    set_ctrl(j, h2(hash));
+	    --i;
+	  }
+	}
+	_growth_left = growth(_capacity) - _size;
+      }
+
+    private:
+      hasher _hash{};
+      key_equal _equal{};
+      buffer_allocator_type _allocator{};
+      slot_type * _slots = nullptr;
+      ctrl_t * _ctrl = nullptr;
+      size_type _capacity = 0;
+      size_type _size = 0;
+      size_type _growth_left = 0;
+  };
+}
@@ -3,11 +3,14 @@
 #if __cplusplus >= 201103L && __cplusplus <= 201402L
 #include "unlikely.h"
 
+#include <new>
+#include <algorithm>
 #include <utility>
 #include <memory>
 #include <cassert>
 
 #include "legacy_memory_block.h"
+#include "block_cache.h"
 
 namespace nonstd
 {
@@ -24,8 +27,17 @@ namespace legacy
       using size_type = std::size_t;
       using difference_type = std::ptrdiff_t;
 
-      constexpr static size_t block_size = sizeof(T) * N;
+      //! Room for N objects, along with their redzones in ASan builds
+      constexpr static size_t block_size = details::asan_padded(sizeof(T) * N, sizeof(T));
       using block = nonstd::legacy::memory_block;
+      using cache = nonstd::block_cache<block_size>;
+
+      //! Drops every object at once, the allocator is the sole user of its block
+      void release() noexcept
+      {
+	if (storage_)
+	  storage_->release();
+      }
 
       template<typename U>
 	struct rebind
@@ -36,13 +48,26 @@ namespace legacy
       ~humble_allocator()
       {
 	if (storage_ && !(--(storage_->_refcnt)))
-	  delete storage_;
+	  retire(storage_);
       }
 
       humble_allocator() = default;
 
-      humble_allocator(const humble_allocator& /*other*/)
+      //! Charges tag instead of the current one
+      explicit humble_allocator(allocation_tag& tag)
+	: tag_(&tag)
+      {}
+
+      //! Sizes the blocks at the high-water mark the tag learned, block_size until it has one
+      explicit humble_allocator(adaptive_t, allocation_tag& tag = allocation_tag::current())
+	: tag_(&tag)
+	, adaptive_(true)
+      {}
+
+      humble_allocator(const humble_allocator& other)
 	// : storage_(other.storage_)
+	: tag_(other.tag_)
+	, adaptive_(other.adaptive_)
       {
 	// if (storage_)
 	//   ++storage_->_refcnt;
@@ -51,13 +76,17 @@ namespace legacy
       //! Move-constructor claims the allocated memory block (if any).
       humble_allocator(humble_allocator&& other)
 	: storage_(other.storage_)
+	, tag_(other.tag_)
+	, adaptive_(other.adaptive_)
       {
 	other.storage_ = nullptr;
       }
 
       template<typename U>
-	humble_allocator(const humble_allocator<U,N>& /*other*/)
+	humble_allocator(const humble_allocator<U,N>& other)
 	  // : storage_(other.storage_)
+	  : tag_(other.tag_)
+	  , adaptive_(other.adaptive_)
       {
 	// if (storage_)
 	//   ++storage_->_refcnt;
@@ -83,14 +112,29 @@ namespace legacy
 
       pointer allocate(std::size_t n)
       {
-	if (!storage_)
-	  storage_ = new block(block_size);
-
-	void * p = storage_->allocate(n * sizeof(T));
+	pointer p = try_allocate(n);
 	if (unlikely(!p))
 	  throw std::bad_alloc();
+	return p;
+      }
+
+      //! Acquires the block upfront rather than on the first allocation, false if out of memory
+      bool prepare() noexcept
+      {
+	if (!storage_)
+	  storage_ = acquire(sizeof(T));
+	return (storage_ != nullptr);
+      }
+
+      //! Returns nullptr instead of throwing once the block is exhausted
+      pointer try_allocate(std::size_t n) noexcept
+      {
+	if (!storage_)
+	  storage_ = acquire(n * sizeof(T));
 
-	return reinterpret_cast<T *>(p);
+	if (unlikely(!storage_))
+	  return nullptr;
+	return reinterpret_cast<T *>(storage_->allocate(n * sizeof(T)));
       }
 
       void deallocate(T *p, std::size_t n)
@@ -99,6 +143,44 @@ namespace legacy
 	  throw std::out_of_range("deallocation outside the storage");
       }
 
+      //! Hands out the room for n objects or more the block can spare
+      allocation_result<pointer, size_type> allocate_at_least(std::size_t n)
+      {
+	if (!storage_)
+	  storage_ = acquire(n * sizeof(T));
+	if (unlikely(!storage_))
+	  throw std::bad_alloc();
+
+	auto result = storage_->allocate_at_least(n, sizeof(T));
+	if (unlikely(!result.ptr))
+	  throw std::bad_alloc();
+	return {static_cast<pointer>(result.ptr), result.count};
+      }
+
+      //! Grows or shrinks the latest allocation of old_n objects to new_n in place
+      bool try_expand(pointer p, std::size_t old_n, std::size_t new_n) noexcept
+      {
+	return (storage_ && storage_->try_expand(p, old_n * sizeof(T), new_n * sizeof(T)));
+      }
+
+      //! Allocates count single objects under a single lock of the block
+      void allocate_bulk(std::size_t count, pointer * out)
+      {
+	if (!storage_)
+	  storage_ = acquire(count * sizeof(T));
+	if (unlikely(!storage_))
+	  throw std::bad_alloc();
+
+	if (unlikely(!storage_->allocate_bulk(sizeof(T), count, out)))
+	  throw std::bad_alloc();
+      }
+
+      void deallocate_bulk(pointer * ptrs, std::size_t count)
+      {
+	if (!storage_ || !storage_->deallocate_bulk(ptrs, count, sizeof(T)))
+	  throw std::out_of_range("deallocation outside the storage");
+      }
+
       template<typename U, typename... Args>
       void construct(U *p, Args&&... args)
       {
@@ -123,6 +205,39 @@ namespace legacy
       }
 
       block * storage_ = nullptr;
+      allocation_tag * tag_ = &allocation_tag::current(); //! charged by the blocks acquired
+      bool adaptive_ = false; //! blocks sized at the tag's learned high-water mark
+
+    private:
+      //! Fresh block of block_size bytes, or as learned by the tag's profile, charging the tag
+      block * acquire(std::size_t bytes) const noexcept
+      {
+	const std::size_t size = adaptive_ ? std::max(bytes, details::asan_padded(tag_->profile().suggest(sizeof(T) * N), sizeof(T))) : block_size;
+	block * b = nullptr;
+	if (size == block_size)
+	  b = cache::acquire();
+	else
+	{
+	  b = new(std::nothrow) block(size);
+	  if (b && !b->initialized())
+	  {
+	    delete b;
+	    b = nullptr;
+	  }
+	}
+	if (b)
+	  b->set_tag(*tag_);
+	return b;
+      }
+
+      //! Only blocks of block_size go back to the cache
+      static void retire(block * b) noexcept
+      {
+	if (b->capacity() == block_size)
+	  cache::release(b);
+	else
+	  delete b;
+      }
     };
 } // legacy
 } //nonstd
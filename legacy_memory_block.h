@@ -1,10 +1,16 @@
 #pragma once
 
 #include "unlikely.h"
+#include "purge_pages.h"
+#include "asan.h"
+#include "allocator_extensions.h"
+#include "resource_registry.h"
+#include "allocation_tag.h"
 #include <cstddef>
 #include <utility>
 #include <mutex>
 #include <atomic>
+#include <chrono>
 #include <iostream>
 
 namespace nonstd
@@ -17,6 +23,8 @@ namespace nonstd
      * @brief Non-copyable and non-movable contigious thread-safe memory block holder.
      *
      * Allocates N bytes upon construction, fills space on demand.
+     * Rewinds once all the space is deallocated, pages left idle for longer than
+     * the decay time may be returned to the OS by purge().
      * Deallocates upon destruction.
      */
     struct memory_block
@@ -29,13 +37,20 @@ namespace nonstd
 
       using size_type = std::size_t;
       using difference_type = std::ptrdiff_t;
+      using clock_type = std::chrono::steady_clock;
 
       byte_type * const _storage = nullptr;     //! block's beginning
       byte_type * const _storage_end = nullptr; //! block's end
       byte_type * _end = nullptr;               //! end of space used at least once
+      byte_type * _dirty_end = nullptr;         //! end of space touched since the last purge
       std::atomic<size_type> _stored{};
       std::atomic<size_type> _refcnt{1};
       mutable std::mutex _mutex{};
+      clock_type::time_point _idle_since{};     //! last time the block became empty
+      std::chrono::milliseconds _decay{std::chrono::seconds(10)}; //! idle time before purging
+      allocation_tag * _tag = &allocation_tag::current(); //! charged for every allocation
+      size_type _high_water = 0;                //! most bytes held or asked for since the last reset
+      resource_registry::entry _registration{"legacy::memory_block", this, &memory_block::usage}; //! kept last
 
 #ifdef MEMORY_BLOCK_TRACING
       static std::atomic_int count;
@@ -45,10 +60,13 @@ namespace nonstd
 	: _storage(static_cast<byte_type *>(malloc(N)))
 	, _storage_end(_storage + N)
 	, _end(_storage)
+	, _dirty_end(_storage)
       {
 #ifdef MEMORY_BLOCK_TRACING
 	std::cout << __PRETTY_FUNCTION__ << ": " << ++count << std::endl;
 #endif
+	if (_storage)
+	  NONSTD_ASAN_POISON(_storage, N);
       }
 
       memory_block(const memory_block& other) = delete;
@@ -62,8 +80,12 @@ namespace nonstd
 	std::cout << __PRETTY_FUNCTION__ << ": " << --count << std::endl;
 #endif
 	std::lock_guard<std::mutex> lock(_mutex);
+	retire();
 	if (_storage)
+	{
+	  NONSTD_ASAN_UNPOISON(_storage, capacity());
 	  free(const_cast<byte_type *>(_storage));
+	}
       }
 
       bool is_pointed_by(const void * p, size_type size = 0) const
@@ -91,6 +113,18 @@ namespace nonstd
 	return _stored.load();
       }
 
+      size_type capacity() const
+      {
+	return static_cast<size_type>(_storage_end - _storage);
+      }
+
+      //! Most bytes held, or asked for and refused, at once since the block was constructed or reset
+      size_type high_water() const
+      {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _high_water;
+      }
+
       void * allocate(size_type n)
       {
 	std::lock_guard<std::mutex> lock(_mutex);
@@ -98,18 +132,20 @@ namespace nonstd
 	if (_end + n <= _storage_end)
 	{
 	  p = _end;
-	  _end += n;
+	  bump(n);
 	  _stored += n;
+	  charge(n);
 #ifdef MEMORY_BLOCK_TRACING
 	  std::cout << __PRETTY_FUNCTION__ << ": allocated: " << n << std::endl;
 #endif
 	}
-#ifdef MEMORY_BLOCK_TRACING
 	else
 	{
+	  demand(n);
+#ifdef MEMORY_BLOCK_TRACING
 	  std::cerr << __PRETTY_FUNCTION__ << ": no room for: " << n << std::endl;
-	}
 #endif
+	}
 	return p;
       }
 
@@ -121,7 +157,11 @@ namespace nonstd
 #ifdef MEMORY_BLOCK_TRACING
 	  std::cout << __PRETTY_FUNCTION__ << ": " << size << std::endl;
 #endif
+	  NONSTD_ASAN_POISON(p, size);
 	  _stored -= size;
+	  _tag->credit(size);
+	  if (!_stored.load())
+	    rewind();
 	  return true;
 	}
 #ifdef MEMORY_BLOCK_TRACING
@@ -129,6 +169,232 @@ namespace nonstd
 #endif
 	return false;
       }
+
+      //! Allocates count chunks of size bytes, or the whole tail when it couldn't fit count more
+      allocation_result<void *, size_type> allocate_at_least(size_type count, size_type size)
+      {
+	std::lock_guard<std::mutex> lock(_mutex);
+	const size_type left = initialized() && size ? static_cast<size_type>(_storage_end - _end) / size : 0;
+	if (unlikely(count > left || !count))
+	{
+	  if (count && size)
+	    demand(count * size);
+	  return {nullptr, 0};
+	}
+
+	const size_type n = details::bump_grant(count, left);
+	void * p = _end;
+	bump(n * size);
+	_stored += n * size;
+	charge(n * size);
+	return {p, n};
+      }
+
+      //! Resizes the most recent allocation in place, false if p isn't on top or there is no room
+      bool try_expand(void * p, size_type old_size, size_type new_size)
+      {
+	std::lock_guard<std::mutex> lock(_mutex);
+	byte_type * top = static_cast<byte_type *>(p);
+	if (!initialized() || !on_top(top, old_size) || _stored.load() < old_size
+	    || new_size > static_cast<size_type>(_storage_end - top))
+	  return false;
+
+	if (new_size < old_size)
+	  NONSTD_ASAN_POISON(top + new_size, old_size - new_size);
+	_end = top;
+	bump(new_size);
+	_stored += new_size;
+	_stored -= old_size;
+	if (new_size > old_size)
+	  charge(new_size - old_size, 0);
+	else
+	  _tag->credit(old_size - new_size);
+	return true;
+      }
+
+      //! Allocates count chunks of size bytes under a single lock, either all of them or none
+      template<typename Pointer>
+	bool allocate_bulk(size_type size, size_type count, Pointer * out)
+	{
+	  std::lock_guard<std::mutex> lock(_mutex);
+	  if (!count)
+	    return true;
+	  // chunks are redzone apart in ASan builds
+	  const size_type stride = size + details::asan_redzone;
+	  const size_type span = stride * (count - 1) + size;
+	  if (unlikely(_end + span > _storage_end))
+	  {
+	    demand(size * count);
+	    return false;
+	  }
+
+	  byte_type * p = _end;
+	  bump(span);
+	  for (size_type i = 0; i < count; ++i)
+	  {
+	    out[i] = static_cast<Pointer>(static_cast<void *>(p + i * stride));
+	    if (details::asan_redzone)
+	      NONSTD_ASAN_POISON(p + i * stride + size, details::asan_redzone);
+	  }
+	  _stored += size * count;
+	  charge(size * count, count);
+	  return true;
+	}
+
+      //! Deallocates count chunks of size bytes under a single lock, either all of them or none
+      template<typename Pointer>
+	bool deallocate_bulk(const Pointer * ptrs, size_type count, size_type size)
+	{
+	  std::lock_guard<std::mutex> lock(_mutex);
+	  if (!initialized() || _stored.load() < size * count)
+	    return false;
+
+	  for (size_type i = 0; i < count; ++i)
+	  {
+	    const void * p = ptrs[i];
+	    if (!(_storage <= p && p < _end))
+	      return false;
+	  }
+
+	  for (size_type i = 0; i < count; ++i)
+	    NONSTD_ASAN_POISON(static_cast<const void *>(ptrs[i]), size);
+	  _stored -= size * count;
+	  _tag->credit(size * count);
+	  if (!_stored.load())
+	    rewind();
+	  return true;
+	}
+
+      //! Drops all the allocations at once, only for the sole user of the block
+      void release()
+      {
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (initialized() && _stored.load())
+	{
+	  _tag->credit(_stored.load());
+	  _stored = 0;
+	  rewind();
+	}
+      }
+
+      //! Makes a block no one refers to anymore as good as new, keeping its pages
+      void reset()
+      {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_tag->credit(_stored.load());
+	retire();
+	_stored = 0;
+	_refcnt = 1;
+	_decay = std::chrono::seconds(10);
+	if (initialized())
+	  rewind();
+      }
+
+      //! Makes an empty block charge tag from now on
+      void set_tag(allocation_tag& tag)
+      {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_tag = &tag;
+      }
+
+      allocation_tag& tag() const
+      {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return *_tag;
+      }
+
+      //! Sets the time an empty block stays resident, zero purges right upon emptying
+      void set_decay(std::chrono::milliseconds decay)
+      {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_decay = decay;
+      }
+
+      std::chrono::milliseconds decay() const
+      {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _decay;
+      }
+
+      //! Returns pages of an empty block idle for longer than decay to the OS
+      size_type purge()
+      {
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (!initialized() || _stored.load() || clock_type::now() - _idle_since < _decay)
+	  return 0;
+	return purge_pages();
+      }
+
+    private:
+
+      //! Hands out n bytes at _end, followed by a poisoned redzone in ASan builds
+      void bump(size_type n)
+      {
+	NONSTD_ASAN_UNPOISON(_end, n);
+	_end += n;
+	const size_type tail = static_cast<size_type>(_storage_end - _end);
+	_end += tail < details::asan_redzone ? tail : details::asan_redzone;
+      }
+
+      //! Whether the size bytes at top are the latest allocation
+      bool on_top(const byte_type * top, size_type size) const
+      {
+	if (top < _storage || size > static_cast<size_type>(_storage_end - top))
+	  return false;
+	const size_type tail = static_cast<size_type>(_storage_end - top) - size;
+	return (_end == top + size + (tail < details::asan_redzone ? tail : details::asan_redzone));
+      }
+
+      void charge(size_type bytes, size_type count = 1)
+      {
+	_tag->charge(bytes, count);
+	if (_stored.load() > _high_water)
+	  _high_water = _stored.load();
+      }
+
+      //! A refused allocation raises the high-water mark too, the next block makes room for it
+      void demand(size_type bytes)
+      {
+	if (initialized() && _stored.load() + bytes > _high_water)
+	  _high_water = _stored.load() + bytes;
+      }
+
+      //! Records the high-water mark to the tag's profile
+      void retire()
+      {
+	if (_high_water)
+	  _tag->profile().record(_high_water);
+	_high_water = 0;
+      }
+
+      static resource_usage usage(const void * self)
+      {
+	const memory_block& b = *static_cast<const memory_block *>(self);
+	std::lock_guard<std::mutex> lock(b._mutex);
+	const size_type capacity = static_cast<size_type>(b._storage_end - b._storage);
+	const size_type touched = static_cast<size_type>(b._end - b._storage);
+	const size_type used = b._stored.load();
+	return {capacity, used, touched > used ? touched - used : 0};
+      }
+
+      //! Makes the whole space of an empty block available again
+      void rewind()
+      {
+	if (_dirty_end < _end)
+	  _dirty_end = _end;
+	NONSTD_ASAN_POISON(_storage, capacity());
+	_end = _storage;
+	_idle_since = clock_type::now();
+	if (_decay.count() == 0)
+	  purge_pages();
+      }
+
+      size_type purge_pages()
+      {
+	const size_type purged = details::purge_pages(_storage, _dirty_end);
+	_dirty_end = _storage;
+	return purged;
+      }
     };
 
   } // memory
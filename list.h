@@ -1,26 +1,41 @@
 #pragma once
 
 #include "list_base.h"
+#include "allocator_extensions.h"
 
 #include <memory>
 #include <utility>
 #include <initializer_list>
+#include <iterator>
+#include <type_traits>
+#include <functional>
 
 #include <cassert>
 
 namespace nonstd
 {
+  /**
+   * SpareNodes bounds the chain of popped nodes the list keeps (destroyed,
+   * not deallocated) for its next insertions, so push/pop churn stops
+   * touching the allocator once warm. None are kept by default, and the
+   * empty chain, a private base, then takes no room.
+   */
   template <
     typename T
     , typename Allocator = std::allocator<T>
+    , size_t SpareNodes = 0
     >
-  class list
+  class list : private list_details::spare_nodes<SpareNodes>
   {
     private:
+      using spare_type = list_details::spare_nodes<SpareNodes>;
       using node_type = list_details::node<T>;
       using node_base_type = typename node_type::base_type;
       using header_type = list_details::header;
 
+      //! Number of nodes allocated or deallocated at once by the range operations
+      static constexpr size_t bulk_size = 64;
+
     public:
       using value_type = T;
       using reference = T&;
@@ -48,10 +63,8 @@ namespace nonstd
 
       list(const list& other)
 	: _allocator()
-	, _header(clone(other._header))
       {
-	if (_header.empty() && !other._header.empty())
-	  throw std::bad_alloc();
+	append(other.begin(), other.end());
       }
 
       // list(const list& other, const allocator_type& alloc)
@@ -67,9 +80,7 @@ namespace nonstd
 	if (&other != this)
 	{
 	  destroy(_header);
-	  _header._node._next = clone(other._header);
-	  if (_header.empty() && !other._header.empty())
-	    throw std::bad_alloc();
+	  append(other.begin(), other.end());
 	}
 	return *this;
       }
@@ -107,12 +118,7 @@ namespace nonstd
 
       list(std::initializer_list<value_type> l)
       {
-	list_details::node_base **end = &_header._node._next;
-	for (const value_type& value : l)
-	{
-	  *end = create_node(value);
-	  end = &((*end)->_next);
-	}
+	append(l.begin(), l.end());
       }
 
       // list(std::initializer_list<T>&& l, const allocator_type& alloc = allocator_type())
@@ -130,17 +136,12 @@ namespace nonstd
       template<typename InputIt>
 	list(InputIt first, InputIt last)
 	{
-	  list_details::node_base **end = &_header._node._next;
-	  while (first != last)
-	  {
-	    *end = create_node(std::forward<value_type>(*first));
-	    end = &((*end)->_next);
-	    ++first;
-	  }
+	  append(first, last);
 	}
 
       ~list()
       {
+	shrink_spare();
 	destroy(_header);
       }
 
@@ -188,7 +189,7 @@ namespace nonstd
 
       const_iterator end() const
       {
-	return iterator{&_header._node};
+	return const_iterator{&_header._node};
       }
 
       const_iterator cbegin() const
@@ -216,6 +217,24 @@ namespace nonstd
 	return (_header._size == 0);
       }
 
+      //! Number of spare nodes kept for the next insertions
+      size_type spare_size() const
+      {
+	return spare().size();
+      }
+
+      static constexpr size_type spare_limit()
+      {
+	return SpareNodes;
+      }
+
+      //! Hands the spare nodes back to the allocator
+      void shrink_spare()
+      {
+	while (void * spare = this->spare().pop())
+	  _allocator.deallocate(static_cast<node_pointer>(spare), 1);
+      }
+
       void push_back(value_type&& value)
       {
 	list_details::node_base **end = _header.get_end_slot();
@@ -240,6 +259,34 @@ namespace nonstd
 	}
       }
 
+      void push_front(const value_type& value)
+      {
+	emplace_front(value);
+      }
+
+      void push_front(value_type&& value)
+      {
+	emplace_front(std::forward<value_type>(value));
+      }
+
+      template<typename... Args>
+      void emplace_front(Args&&... args)
+      {
+	auto node = create_node(std::forward<Args>(args)...);
+	node->_next = _header._node._next;
+	_header._node._next = node;
+      }
+
+      void pop_front()
+      {
+	if (!_header.is_end(_header._node._next))
+	{
+	  auto node = _header._node._next;
+	  _header._node._next = node->_next;
+	  destroy_node(static_cast<typename allocator_type::pointer>(node));
+	}
+      }
+
       const_reference back() const
       {
 	list_details::node_base * const *end = _header.get_last_node_slot();
@@ -262,49 +309,242 @@ namespace nonstd
 	return static_cast<typename allocator_type::pointer>(_header._node._next)->_value;
       }
 
+      //! Stable merge sort relinking the nodes, allocates nothing
+      void sort()
+      {
+	sort(std::less<value_type>());
+      }
+
+      template<typename Compare>
+	void sort(Compare comp)
+	{
+	  list_details::sort<T>(_header, comp);
+	}
+
+      void merge(list& other)
+      {
+	merge(other, std::less<value_type>());
+      }
+
+      void merge(list&& other)
+      {
+	merge(other, std::less<value_type>());
+      }
+
+      template<typename Compare>
+	void merge(list&& other, Compare comp)
+	{
+	  merge(other, comp);
+	}
+
+      /**
+       * Moves the nodes of the sorted other into the sorted list, stable.
+       * Relinks them when the allocators compare equal, otherwise the nodes
+       * must stay with their allocator: the values are moved over instead.
+       */
+      template<typename Compare>
+	void merge(list& other, Compare comp)
+	{
+	  if (&other == this)
+	    return;
+	  if (_allocator == other._allocator)
+	  {
+	    list_details::merge<T>(_header, other._header, comp);
+	    return;
+	  }
+	  list_details::node_base **end = _header.get_end_slot();
+	  append(std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+	  other.destroy(other._header);
+	  header_type moved;
+	  list_details::split(_header, end, moved);
+	  try
+	  {
+	    list_details::merge<T>(_header, moved, comp);
+	  }
+	  catch(...)
+	  {
+	    list_details::splice_back(_header, moved);
+	    throw;
+	  }
+	}
+
+      //! Erases the nodes equal to their predecessor, returns their count
+      size_type unique()
+      {
+	return unique(std::equal_to<value_type>());
+      }
+
+      template<typename BinaryPredicate>
+	size_type unique(BinaryPredicate pred)
+	{
+	  header_type removed;
+	  size_type count = 0;
+	  try
+	  {
+	    count = list_details::unique<T>(_header, removed, pred);
+	  }
+	  catch(...)
+	  {
+	    destroy(removed, std::false_type{});
+	    throw;
+	  }
+	  destroy(removed, std::false_type{});
+	  return count;
+	}
+
+      void reverse()
+      {
+	list_details::reverse(_header);
+      }
+
     private:
+      using node_pointer = typename allocator_type::pointer;
+      using allocator_extensions = nonstd::allocator_extensions<allocator_type>;
 
       template<typename... Args>
 	auto create_node(Args&&... args)
       {
-	typename allocator_type::pointer node = _allocator.allocate(1);
-	_allocator.construct(node, std::forward<Args>(args)...);
-	node->_next = &_header._node;
+	node_pointer node = allocate_node();
+	try
+	{
+	  construct_node(node, std::forward<Args>(args)...);
+	}
+	catch(...)
+	{
+	  deallocate_node(node);
+	  throw;
+	}
 	return node;
       }
 
-      void destroy_node(typename allocator_type::pointer node)
+      spare_type& spare() noexcept
+      {
+	return *this;
+      }
+
+      const spare_type& spare() const noexcept
+      {
+	return *this;
+      }
+
+      //! A spare node if any, a fresh one from the allocator otherwise
+      node_pointer allocate_node()
+      {
+	if (void * spare = this->spare().pop())
+	  return static_cast<node_pointer>(spare);
+	return _allocator.allocate(1);
+      }
+
+      //! Keeps the destroyed node as a spare up to the limit, deallocates it otherwise
+      void deallocate_node(node_pointer node)
+      {
+	if (spare().size() < spare().limit())
+	  spare().push(node);
+	else
+	  _allocator.deallocate(node, 1);
+      }
+
+      template<typename... Args>
+	void construct_node(node_pointer node, Args&&... args)
+	{
+	  _allocator.construct(node, std::forward<Args>(args)...);
+	  node->_next = &_header._node;
+	  ++_header._size;
+	}
+
+      void destroy_node(node_pointer node)
       {
 	_allocator.destroy(node);
-	_allocator.deallocate(node, 1);
+	deallocate_node(node);
+	--_header._size;
       }
 
+      //! Trivially destructible nodes of an exclusively owned storage need no walk to be freed
+      using winks_out = std::integral_constant<bool,
+	    std::is_trivially_destructible<T>::value && details::has_release<allocator_type>::value
+	    >;
+
       void destroy(list_details::header& header)
       {
+	destroy(header, winks_out{});
+      }
+
+      //! Releases the whole storage at once
+      void destroy(list_details::header& header, std::true_type)
+      {
+	allocator_extensions::release(_allocator);
+	spare().reset();
+	header.reset();
+      }
+
+      //! Destroys the nodes and hands them back to the allocator in batches
+      void destroy(list_details::header& header, std::false_type)
+      {
+	node_pointer nodes[bulk_size];
+	size_type count = 0;
 	list_details::node_base * next = header._node._next;
 	while (next != &header._node)
 	{
-	  auto it = next;
+	  auto node = static_cast<node_pointer>(next);
 	  next = next->_next;
-	  destroy_node(static_cast<typename allocator_type::pointer>(it));
+	  _allocator.destroy(node);
+	  nodes[count++] = node;
+	  if (count == bulk_size)
+	  {
+	    allocator_extensions::deallocate_bulk(_allocator, nodes, count);
+	    count = 0;
+	  }
 	}
+	if (count)
+	  allocator_extensions::deallocate_bulk(_allocator, nodes, count);
+	header.reset();
       }
 
-      auto clone (const header_type& other_head)
-      {
-	list_details::header header;
-	list_details::node_base ** slot_it = &header._node._next;
-	typename allocator_type::const_pointer other_it =
-		static_cast<typename allocator_type::const_pointer>(other_head._node._next);
+      template<typename InputIt>
+	void append(InputIt first, InputIt last)
+	{
+	  append(first, last, typename std::iterator_traits<InputIt>::iterator_category{});
+	}
+
+      template<typename InputIt>
+	void append(InputIt first, InputIt last, std::input_iterator_tag)
+	{
+	  list_details::node_base **end = _header.get_end_slot();
+	  for (; first != last; ++first)
+	  {
+	    *end = create_node(*first);
+	    end = &((*end)->_next);
+	  }
+	}
 
-	while (other_it != &other_head._node)
+      //! Allocates the nodes in batches when the range length is known upfront
+      template<typename ForwardIt>
+	void append(ForwardIt first, ForwardIt last, std::forward_iterator_tag)
 	{
-	  *slot_it = create_node(other_it->_value);
-	  slot_it = &((*slot_it)->_next);
-	  other_it = static_cast<typename allocator_type::const_pointer>(other_it->_next);
+	  list_details::node_base **end = _header.get_end_slot();
+	  node_pointer nodes[bulk_size];
+	  for (size_type count = std::distance(first, last); count; )
+	  {
+	    const size_type batch = count < bulk_size ? count : bulk_size;
+	    allocator_extensions::allocate_bulk(_allocator, batch, nodes);
+	    size_type i = 0;
+	    try
+	    {
+	      for (; i < batch; ++i, ++first)
+	      {
+		construct_node(nodes[i], *first);
+		*end = nodes[i];
+		end = &((*end)->_next);
+	      }
+	    }
+	    catch(...)
+	    {
+	      allocator_extensions::deallocate_bulk(_allocator, nodes + i, batch - i);
+	      throw;
+	    }
+	    count -= batch;
+	  }
 	}
-	return header._node._next;
-      }
 
     private:
       allocator_type _allocator{};
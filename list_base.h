@@ -2,6 +2,9 @@
 
 #include <utility>
 #include <iterator>
+#include <cstdint>
+#include <limits>
+#include <new>
 
 namespace nonstd
 {
@@ -32,18 +35,16 @@ namespace nonstd
 
       header(const header&) = delete;
       header(header&& other)
-	: _node(std::move(other._node))
-	, _size(other._size)
+	: _node{&_node}
       {
-	other.reset();
+	swap(other);
       }
 
       header& operator=(const header&) = delete;
       header& operator=(header&& other)
       {
-	_node = other._node;
-	_size = other._size;
-	other.reset();
+	reset();
+	swap(other);
 	return *this;
       }
 
@@ -53,23 +54,24 @@ namespace nonstd
 	_size = 0;
       }
 
+      //! Swaps the chains relinking their last nodes to the new sentinels
       void swap(header& other)
       {
 	using std::swap;
-	swap(other._node, _node);
+	*get_end_slot() = &other._node;
+	*other.get_end_slot() = &_node;
+	swap(other._node._next, _node._next);
 	swap(other._size, _size);
       }
 
       friend void swap(header& lhs, header& rhs)
       {
-	using std::swap;
-	swap(lhs._node, rhs._node);
-	swap(lhs._size, rhs._size);
+	lhs.swap(rhs);
       }
 
       bool empty() const
       {
-	return (!_node._next);
+	return (_node._next == &_node);
       }
 
       bool is_end(const node_base * node) const
@@ -209,17 +211,15 @@ namespace nonstd
 	  return result;
 	}
 
-	template<typename U>
-	  friend bool operator==(const iterator<U>& lhs, const iterator<U>& rhs)
-	  {
-	    return (lhs._node == rhs._node);
-	  }
+	friend bool operator==(const iterator& lhs, const iterator& rhs)
+	{
+	  return (lhs._node == rhs._node);
+	}
 
-	template<typename U>
-	  friend bool operator!=(const iterator<U>& lhs, const iterator<U>& rhs)
-	  {
-	    return (lhs._node != rhs._node);
-	  }
+	friend bool operator!=(const iterator& lhs, const iterator& rhs)
+	{
+	  return (lhs._node != rhs._node);
+	}
 
 	void swap (iterator& rhs)
 	{
@@ -227,12 +227,11 @@ namespace nonstd
 	  swap(rhs._node, _node);
 	}
 
-	template<typename U>
-	  friend void swap (iterator<U>& lhs, iterator<U>& rhs)
-	  {
-	    using std::swap;
-	    swap(lhs._node, rhs._node);
-	  }
+	friend void swap (iterator& lhs, iterator& rhs)
+	{
+	  using std::swap;
+	  swap(lhs._node, rhs._node);
+	}
 
 	node_base * _node;
       };
@@ -258,7 +257,7 @@ namespace nonstd
 
 	reference operator*() const
 	{
-	  return (static_cast<node_type*>(_node))->_value;
+	  return (static_cast<const node_type*>(_node))->_value;
 	}
 
 	pointer operator->() const
@@ -280,34 +279,530 @@ namespace nonstd
 	  return result;
 	}
 
-	template<typename U>
-	  friend bool operator==(const const_iterator<U>& lhs, const const_iterator<U>& rhs)
+	friend bool operator==(const const_iterator& lhs, const const_iterator& rhs)
+	{
+	  return (lhs._node == rhs._node);
+	}
+
+	friend bool operator!=(const const_iterator& lhs, const const_iterator& rhs)
+	{
+	  return (lhs._node != rhs._node);
+	}
+
+	void swap (const_iterator& rhs)
+	{
+	  using std::swap;
+	  swap(rhs._node, _node);
+	}
+
+	friend void swap (const_iterator& lhs, const_iterator& rhs)
+	{
+	  using std::swap;
+	  swap(lhs._node, rhs._node);
+	}
+
+	const node_base * _node;
+      };
+
+    /**
+     * Chain of spare nodes: allocated, their values destroyed, kept by a list
+     * for its next insertions instead of going back to the allocator. The
+     * link lives in the node memory, which holds a bare node_base meanwhile.
+     */
+    struct spare_chain
+    {
+      using size_type = std::size_t;
+
+      size_type size() const noexcept
+      {
+	return _size;
+      }
+
+      //! Keeps the raw memory of a node
+      void push(void * p) noexcept
+      {
+	_head = ::new (p) node_base{_head};
+	++_size;
+      }
+
+      //! Raw memory of a spare node, nullptr when there is none
+      void * pop() noexcept
+      {
+	node_base * node = _head;
+	if (node)
+	{
+	  _head = node->_next;
+	  --_size;
+	}
+	return node;
+      }
+
+      //! Forgets the nodes, their memory went back some other way
+      void reset() noexcept
+      {
+	_head = nullptr;
+	_size = 0;
+      }
+
+      node_base * _head = nullptr;
+      size_type _size = 0;
+    }; // spare_chain
+
+    //! Spare nodes of a list bounded at compile time
+    template<std::size_t Limit>
+      struct spare_nodes : spare_chain
+      {
+	static constexpr size_type limit() noexcept
+	{
+	  return Limit;
+	}
+      };
+
+    //! No spare nodes at all, the checks compile away
+    template<>
+      struct spare_nodes<0>
+      {
+	using size_type = std::size_t;
+
+	static constexpr size_type limit() noexcept
+	{
+	  return 0;
+	}
+
+	static constexpr size_type size() noexcept
+	{
+	  return 0;
+	}
+
+	void push(void *) noexcept {}
+
+	static constexpr void * pop() noexcept
+	{
+	  return nullptr;
+	}
+
+	void reset() noexcept {}
+      };
+
+    // Relinking algorithms shared by the lists: they only rewrite the _next
+    // links of the nodes already there, hence never allocate.
+
+    template<typename T>
+      T& value_of(node_base * n)
+      {
+	return static_cast<node<T> *>(n)->_value;
+      }
+
+    /**
+     * Merges the nullptr terminated sorted chains a and b, a's nodes first
+     * among the equivalent ones. Should comp throw, a holds every node.
+     */
+    template<typename T, typename Compare>
+      node_base * merge_chains(node_base *& a, node_base *& b, Compare& comp)
+      {
+	node_base head;
+	node_base * tail = &head;
+	try
+	{
+	  while (a && b)
 	  {
-	    return (lhs._node == rhs._node);
+	    node_base *& taken = comp(value_of<T>(b), value_of<T>(a)) ? b : a;
+	    tail->_next = taken;
+	    tail = taken;
+	    taken = taken->_next;
 	  }
+	}
+	catch(...)
+	{
+	  tail->_next = a ? a : b;
+	  if (a)
+	  {
+	    while (tail->_next)
+	      tail = tail->_next;
+	    tail->_next = b;
+	  }
+	  a = head._next;
+	  b = nullptr;
+	  throw;
+	}
+	tail->_next = a ? a : b;
+	a = b = nullptr;
+	return head._next;
+      }
 
-	template<typename U>
-	  friend bool operator!=(const const_iterator<U>& lhs, const const_iterator<U>& rhs)
+    //! Relinks the nullptr terminated chain as the whole content of the header
+    inline void adopt(header& h, node_base * chain)
+    {
+      node_base ** end = &h._node._next;
+      *end = chain;
+      while (*end)
+	end = &(*end)->_next;
+      *end = &h._node;
+    }
+
+    /**
+     * Stable bottom-up merge sort, O(n log n) comparisons. bins[i] holds a
+     * sorted run of 2^i nodes or nothing, each node carries into the bins
+     * like a binary counter increment. Should comp throw, every node stays
+     * in the list though in no particular order.
+     */
+    template<typename T, typename Compare>
+      void sort(header& h, Compare comp)
+      {
+	if (h._size < 2)
+	  return;
+
+	constexpr std::size_t max_bins = std::numeric_limits<std::size_t>::digits;
+	node_base * bins[max_bins] = {};
+	std::size_t fill = 0;
+	node_base * next = h._node._next;
+	try
+	{
+	  while (!h.is_end(next))
+	  {
+	    node_base * carry = next;
+	    next = next->_next;
+	    carry->_next = nullptr;
+	    std::size_t i = 0;
+	    for (; i < fill && bins[i]; ++i)
+	      carry = merge_chains<T>(bins[i], carry, comp);
+	    bins[i] = carry;
+	    if (i == fill)
+	      ++fill;
+	  }
+	  // the higher bins hold the earlier nodes
+	  for (std::size_t i = 1; i < fill; ++i)
 	  {
-	    return (lhs._node != rhs._node);
+	    if (!bins[i - 1])
+	      continue;
+	    bins[i] = bins[i] ? merge_chains<T>(bins[i], bins[i - 1], comp) : bins[i - 1];
+	    bins[i - 1] = nullptr;
 	  }
+	}
+	catch(...)
+	{
+	  h._node._next = next;
+	  for (node_base * chain : bins)
+	    if (chain)
+	    {
+	      node_base * last = chain;
+	      while (last->_next)
+		last = last->_next;
+	      last->_next = h._node._next;
+	      h._node._next = chain;
+	    }
+	  throw;
+	}
+	adopt(h, bins[fill - 1]);
+      }
 
-	void swap (const_iterator& rhs)
+    /**
+     * Moves the nodes of the sorted from into the sorted into, from's nodes
+     * after the equivalent ones of into. Both headers stay consistent at
+     * every step should comp throw.
+     */
+    template<typename T, typename Compare>
+      void merge(header& into, header& from, Compare comp)
+      {
+	node_base ** slot = &into._node._next;
+	while (!from.empty())
 	{
-	  using std::swap;
-	  swap(rhs._node, _node);
+	  node_base * node = from._node._next;
+	  while (!into.is_end(*slot) && !comp(value_of<T>(node), value_of<T>(*slot)))
+	    slot = &(*slot)->_next;
+
+	  if (into.is_end(*slot))
+	  {
+	    // the rest of from goes at the end
+	    *slot = node;
+	    (*from.get_last_node_slot())->_next = &into._node;
+	    into._size += from._size;
+	    from.reset();
+	    return;
+	  }
+
+	  from._node._next = node->_next;
+	  node->_next = *slot;
+	  *slot = node;
+	  slot = &node->_next;
+	  ++into._size;
+	  --from._size;
 	}
+      }
 
-	template<typename U>
-	  friend void swap (const_iterator<U>& lhs, const_iterator<U>& rhs)
+    /**
+     * Moves every node equivalent to its predecessor (under pred) to the
+     * empty removed, keeps the first of each group. Returns the count moved.
+     */
+    template<typename T, typename BinaryPredicate>
+      std::size_t unique(header& h, header& removed, BinaryPredicate pred)
+      {
+	std::size_t count = 0;
+	node_base ** tail = &removed._node._next;
+	node_base * kept = h._node._next;
+	while (!h.is_end(kept) && !h.is_end(kept->_next))
+	{
+	  node_base * node = kept->_next;
+	  if (pred(value_of<T>(kept), value_of<T>(node)))
 	  {
-	    using std::swap;
-	    swap(lhs._node, rhs._node);
+	    kept->_next = node->_next;
+	    node->_next = &removed._node;
+	    *tail = node;
+	    tail = &node->_next;
+	    --h._size;
+	    ++removed._size;
+	    ++count;
 	  }
+	  else
+	    kept = node;
+	}
+	return count;
+      }
 
-	const node_base * _node;
+    inline void reverse(header& h)
+    {
+      node_base * previous = &h._node;
+      node_base * node = h._node._next;
+      while (!h.is_end(node))
+      {
+	node_base * next = node->_next;
+	node->_next = previous;
+	previous = node;
+	node = next;
+      }
+      h._node._next = previous;
+    }
+
+    //! Moves the nodes from the one *slot points to on into the empty to
+    inline void split(header& from, node_base ** slot, header& to)
+    {
+      if (from.is_end(*slot))
+	return;
+      to._node._next = *slot;
+      node_base * last = *slot;
+      ++to._size;
+      while (!from.is_end(last->_next))
+      {
+	last = last->_next;
+	++to._size;
+      }
+      last->_next = &to._node;
+      *slot = &from._node;
+      from._size -= to._size;
+    }
+
+    //! Moves every node of from to the end of into
+    inline void splice_back(header& into, header& from)
+    {
+      if (from.empty())
+	return;
+      *into.get_end_slot() = from._node._next;
+      (*from.get_last_node_slot())->_next = &into._node;
+      into._size += from._size;
+      from.reset();
+    }
+
+    // Compact variant: 32-bit links holding the offsets of the nodes from the beginning
+    // of the block (at most 4 GiB) they all live in, resolved against that block's base.
+
+    using offset_type = std::uint32_t;
+
+    //! "No node" offset, terminates the compact lists
+    constexpr offset_type npos = std::numeric_limits<offset_type>::max();
+
+    struct compact_node_base
+    {
+      offset_type _next = npos;
+    }; // compact_node_base
+
+    template<typename T>
+      struct compact_node : public compact_node_base
+    {
+      using value_type = T;
+      using base_type = compact_node_base;
+
+      T _value{};
+
+      template<typename... Args>
+	compact_node(Args&&... args)
+	  : _value(std::forward<Args>(args)...)
+	{}
+    };
+
+    //! Resolves the offsets against the base of the block
+    template<typename Node>
+      Node * resolve(unsigned char * base, offset_type offset)
+      {
+	return reinterpret_cast<Node *>(base + offset);
+      }
+
+    template<typename Node>
+      const Node * resolve(const unsigned char * base, offset_type offset)
+      {
+	return reinterpret_cast<const Node *>(base + offset);
+      }
+
+    inline offset_type offset_of(const unsigned char * base, const void * node)
+    {
+      return static_cast<offset_type>(static_cast<const unsigned char *>(node) - base);
+    }
+
+    struct compact_header
+    {
+      using size_type = std::size_t;
+
+      compact_header() = default;
+
+      explicit compact_header(unsigned char * base)
+	: _base(base)
+      {}
+
+      bool empty() const
+      {
+	return (_first == npos);
+      }
+
+      void reset()
+      {
+	_first = npos;
+	_last = npos;
+	_size = 0;
+      }
+
+      void swap(compact_header& other)
+      {
+	using std::swap;
+	swap(other._base, _base);
+	swap(other._first, _first);
+	swap(other._last, _last);
+	swap(other._size, _size);
+      }
+
+      friend void swap(compact_header& lhs, compact_header& rhs)
+      {
+	lhs.swap(rhs);
+      }
+
+      unsigned char * _base = nullptr; //! owning block's beginning
+      offset_type _first = npos;
+      offset_type _last = npos;
+      size_type _size = 0;
+    }; // compact_header
+
+    template<typename T>
+      struct compact_iterator
+      {
+	using value_type = T;
+	using reference = T&;
+	using pointer = T*;
+	using iterator_category = std::forward_iterator_tag;
+	using difference_type = std::ptrdiff_t;
+	using node_type = compact_node<T>;
+
+	compact_iterator() = default;
+
+	compact_iterator(unsigned char * base, offset_type offset)
+	  : _base(base)
+	  , _offset(offset)
+	{}
+
+	reference operator*() const
+	{
+	  return resolve<node_type>(_base, _offset)->_value;
+	}
+
+	pointer operator->() const
+	{
+	  return &resolve<node_type>(_base, _offset)->_value;
+	}
+
+	compact_iterator& operator++()
+	{
+	  if (_offset != npos)
+	    _offset = resolve<node_type>(_base, _offset)->_next;
+	  return *this;
+	}
+
+	compact_iterator operator++(int)
+	{
+	  compact_iterator result(*this);
+	  ++(*this);
+	  return result;
+	}
+
+	friend bool operator==(const compact_iterator& lhs, const compact_iterator& rhs)
+	{
+	  return (lhs._offset == rhs._offset);
+	}
+
+	friend bool operator!=(const compact_iterator& lhs, const compact_iterator& rhs)
+	{
+	  return (lhs._offset != rhs._offset);
+	}
+
+	unsigned char * _base = nullptr;
+	offset_type _offset = npos;
       };
 
+    template<typename T>
+      struct compact_const_iterator
+      {
+	using value_type = T;
+	using reference = const T&;
+	using pointer = const T*;
+	using iterator_category = std::forward_iterator_tag;
+	using difference_type = std::ptrdiff_t;
+	using node_type = compact_node<T>;
+
+	compact_const_iterator() = default;
+
+	compact_const_iterator(const unsigned char * base, offset_type offset)
+	  : _base(base)
+	  , _offset(offset)
+	{}
+
+	compact_const_iterator(const compact_iterator<T>& other)
+	  : _base(other._base)
+	  , _offset(other._offset)
+	{}
+
+	reference operator*() const
+	{
+	  return resolve<node_type>(_base, _offset)->_value;
+	}
+
+	pointer operator->() const
+	{
+	  return &resolve<node_type>(_base, _offset)->_value;
+	}
+
+	compact_const_iterator& operator++()
+	{
+	  if (_offset != npos)
+	    _offset = resolve<node_type>(_base, _offset)->_next;
+	  return *this;
+	}
+
+	compact_const_iterator operator++(int)
+	{
+	  compact_const_iterator result(*this);
+	  ++(*this);
+	  return result;
+	}
+
+	friend bool operator==(const compact_const_iterator& lhs, const compact_const_iterator& rhs)
+	{
+	  return (lhs._offset == rhs._offset);
+	}
+
+	friend bool operator!=(const compact_const_iterator& lhs, const compact_const_iterator& rhs)
+	{
+	  return (lhs._offset != rhs._offset);
+	}
+
+	const unsigned char * _base = nullptr;
+	offset_type _offset = npos;
+      };
 
   } // list_details
 } // nonstd
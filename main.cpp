@@ -6,6 +6,7 @@
 #include <type_traits>
 
 #include "list.h"
+#include "btree_map.h"
 
 #ifdef MEMORY_BLOCK_TRACING
 std::atomic_int nonstd::legacy::memory_block::count{};
@@ -105,6 +106,18 @@ int main(int, char **)
       >{}(factorial_pair_generator);
   }
 
+  {
+    // custom map with humble allocator
+    printer<
+      nonstd::btree_map<
+	int
+	, int
+	, std::less<int>
+	, nonstd::legacy::humble_allocator<std::pair<const int, int>, 10>
+	>
+      >{}(factorial_pair_generator);
+  }
+
   {
     //custom container with std::allocator
     printer<
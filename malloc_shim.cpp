@@ -0,0 +1,855 @@
+#include "pmr_reserved_memory_block.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <type_traits>
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Drop-in replacement of malloc, free and operator new/delete, meant for
+// LD_PRELOAD=libnonstd_malloc.so so whole programs run on the project's blocks.
+//
+// NONSTD_MALLOC_STRATEGY picks how the chunks are handed out:
+//   cached (default)  size classes carved from a reserved_memory_block, with a
+//                     thread-local cache of free chunks per class
+//   locked            same size classes, every call goes to the shared lists
+//   bump              memory_block semantics, the reserved block bumps and
+//                     rewinds once every chunk is back, realloc expands in place
+// Chunks above the largest class get their own mapping. NONSTD_MALLOC_STATS=1
+// dumps the counters to stderr at exit. The own mappings are kept in a registry,
+// so pointers the shim didn't hand out are recognized without touching them and
+// left alone. Every lock is held across fork() so the child finds the lists
+// consistent.
+//
+// Nothing here may call malloc: no std containers, no iostream, no thread_local
+// needing a constructor or a destructor.
+
+namespace
+{
+  using nonstd::pmr::reserved_memory_block;
+  using byte_type = unsigned char;
+
+  constexpr size_t min_alignment = 16;
+  constexpr size_t page_size = 64 * 1024;           //! span of a single size class
+  constexpr size_t arena_size = size_t{64} << 30;   //! address space reserved for the chunks
+  constexpr size_t page_count = arena_size / page_size;
+  constexpr size_t class_count = 40;
+  constexpr size_t max_small = 32 * 1024;           //! largest size class
+  constexpr size_t max_small_alignment = 4096;      //! guaranteed by the power-of-two classes
+  constexpr size_t header_size = 16;
+
+  enum class strategy_type { cached, locked, bump };
+
+  //! Size classes step by 16 bytes up to 128, then by a quarter of each power of two
+  constexpr size_t class_of(size_t size)
+  {
+    if (size <= 128)
+      return (size ? size + 15 : 16) / 16 - 1;
+    size_t e = 7;
+    while ((size_t{1} << (e + 1)) < size)
+      ++e;
+    return 8 + (e - 7) * 4 + ((size - 1 - (size_t{1} << e)) >> (e - 2));
+  }
+
+  constexpr size_t class_size(size_t c)
+  {
+    return c < 8
+      ? 16 * (c + 1)
+      : (size_t{1} << (7 + (c - 8) / 4)) + ((c - 8) % 4 + 1) * (size_t{1} << (5 + (c - 8) / 4));
+  }
+
+  static_assert(class_of(max_small) == class_count - 1 && class_size(class_count - 1) == max_small, "size classes");
+  static_assert(class_of(129) == 8 && class_size(8) == 160 && class_of(257) == 12 && class_size(11) == 256, "size classes");
+
+  //! Free chunks a thread keeps per class, half of them move at once
+  constexpr size_t cache_limit(size_t c)
+  {
+    return class_size(c) >= 32 * 1024 / 8 ? 8 : (class_size(c) <= 32 * 1024 / 256 ? 256 : 32 * 1024 / class_size(c));
+  }
+
+  //! Precedes bump and large chunks
+  struct header
+  {
+    size_t length; //! bytes taken from the block or mapped
+    size_t offset; //! from the beginning of those bytes to the chunk
+  };
+
+  static_assert(sizeof(header) == header_size, "header must keep the chunks aligned");
+
+  struct counters
+  {
+    std::atomic<std::uint64_t> mallocs{0};
+    std::atomic<std::uint64_t> frees{0};
+    std::atomic<std::uint64_t> reallocs{0};
+    std::atomic<std::uint64_t> in_place{0};    //! reallocs that kept the chunk
+    std::atomic<std::uint64_t> large{0};       //! chunks mapped on their own
+    std::atomic<std::uint64_t> foreign{0};     //! frees and reallocs of pointers not from the shim
+    std::atomic<std::uint64_t> cache_hits{0};
+    std::atomic<std::uint64_t> refills{0};
+    std::atomic<std::uint64_t> flushes{0};
+    std::atomic<std::uint64_t> pages{0};
+    std::atomic<std::uint64_t> live{0};        //! usable bytes held by the program
+    std::atomic<std::uint64_t> peak{0};
+  };
+
+  //! Shared free list and current page of a size class
+  struct size_class
+  {
+    std::mutex mutex;
+    void * free = nullptr;
+    byte_type * next = nullptr;
+    byte_type * end = nullptr;
+  };
+
+  //! Open-addressed set of the chunks map_allocate handed out, in a mapping of its own
+  struct mapping_registry
+  {
+    static constexpr std::uintptr_t empty = 0;
+    static constexpr std::uintptr_t erased = 1;
+
+    std::mutex mutex;
+    std::uintptr_t * slots = nullptr;
+    size_t capacity = 0; //! power of two
+    size_t used = 0;     //! live and erased slots
+    size_t live = 0;
+  };
+
+  //! Free chunks of a thread, plain data so the TLS needs no allocation
+  struct thread_cache
+  {
+    void * heads[class_count];
+    std::uint32_t counts[class_count];
+    bool registered;
+    bool busy;  //! set while refilling, a reentrant call goes to the shared lists
+    bool dead;  //! flushed at the thread's exit, later calls go to the shared lists
+  };
+
+  static_assert(std::is_trivial<thread_cache>::value, "thread_cache must need no construction");
+
+  alignas(reserved_memory_block) byte_type arena_storage[sizeof(reserved_memory_block)];
+  reserved_memory_block * arena = nullptr;
+  byte_type * arena_base = nullptr;
+  std::uint8_t page_class[page_count];  //! class + 1 of every page handed out
+  size_class classes[class_count];
+  mapping_registry mappings;
+  counters stats;
+  strategy_type strategy = strategy_type::cached;
+  pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_key_t cache_key;
+  std::atomic<bool> ready{false};
+
+  thread_local thread_cache cache __attribute__((tls_model("initial-exec")));
+
+  void flush_thread_cache(void *);
+  void lock_all();
+  void unlock_all();
+  void reinitialize_locks();
+
+  bool env_is(const char * name, const char * value)
+  {
+    const char * v = getenv(name);
+    return v && !strcmp(v, value);
+  }
+
+  void initialize_once()
+  {
+    if (env_is("NONSTD_MALLOC_STRATEGY", "locked"))
+      strategy = strategy_type::locked;
+    else if (env_is("NONSTD_MALLOC_STRATEGY", "bump"))
+      strategy = strategy_type::bump;
+
+    arena = new(arena_storage) reserved_memory_block(arena_size, page_size);
+    // the block bumps from its beginning, the first page tells where the pages start
+    arena_base = static_cast<byte_type *>(arena->try_allocate(page_size, min_alignment));
+    if (!arena_base)
+      abort();
+    arena->deallocate(arena_base, page_size, min_alignment);
+
+    pthread_key_create(&cache_key, flush_thread_cache);
+    ready.store(true, std::memory_order_release);
+    // registering may allocate, the shim has to be ready by then
+    pthread_atfork(lock_all, unlock_all, reinitialize_locks);
+  }
+
+  inline void initialize()
+  {
+    if (__builtin_expect(!ready.load(std::memory_order_acquire), 0))
+      pthread_once(&once, initialize_once);
+  }
+
+  void account(std::int64_t bytes)
+  {
+    const std::uint64_t live = stats.live.fetch_add(static_cast<std::uint64_t>(bytes), std::memory_order_relaxed) + static_cast<std::uint64_t>(bytes);
+    std::uint64_t peak = stats.peak.load(std::memory_order_relaxed);
+    while (bytes > 0 && live > peak && !stats.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+      ;
+  }
+
+  size_t align_up(size_t n, size_t alignment)
+  {
+    return (n + alignment - 1) / alignment * alignment;
+  }
+
+  size_t slot_of(std::uintptr_t key, size_t capacity)
+  {
+    return static_cast<size_t>(((key >> 4) * 0x9e3779b97f4a7c15ull) >> 20) & (capacity - 1);
+  }
+
+  //! Moves the live chunks to a table a quarter full, false if it can't be mapped
+  bool rehash()
+  {
+    size_t capacity = 512;
+    while (capacity < 4 * (mappings.live + 1))
+      capacity *= 2;
+    void * m = mmap(nullptr, capacity * sizeof(std::uintptr_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED)
+      return false;
+
+    std::uintptr_t * slots = static_cast<std::uintptr_t *>(m);
+    for (size_t i = 0; i < mappings.capacity; ++i)
+    {
+      const std::uintptr_t key = mappings.slots[i];
+      if (key == mapping_registry::empty || key == mapping_registry::erased)
+	continue;
+      size_t s = slot_of(key, capacity);
+      while (slots[s] != mapping_registry::empty)
+	s = (s + 1) & (capacity - 1);
+      slots[s] = key;
+    }
+    if (mappings.slots)
+      munmap(mappings.slots, mappings.capacity * sizeof(std::uintptr_t));
+    mappings.slots = slots;
+    mappings.capacity = capacity;
+    mappings.used = mappings.live;
+    return true;
+  }
+
+  bool remember_mapping(const void * p)
+  {
+    const std::uintptr_t key = reinterpret_cast<std::uintptr_t>(p);
+    std::lock_guard<std::mutex> lock(mappings.mutex);
+    if (4 * (mappings.used + 1) > 3 * mappings.capacity && !rehash())
+      return false;
+    size_t s = slot_of(key, mappings.capacity);
+    while (mappings.slots[s] != mapping_registry::empty && mappings.slots[s] != mapping_registry::erased)
+      s = (s + 1) & (mappings.capacity - 1);
+    mappings.used += (mappings.slots[s] == mapping_registry::empty);
+    ++mappings.live;
+    mappings.slots[s] = key;
+    return true;
+  }
+
+  //! Slot of a chunk map_allocate handed out, the capacity if p isn't one, under the lock
+  size_t find_mapping(const void * p)
+  {
+    const std::uintptr_t key = reinterpret_cast<std::uintptr_t>(p);
+    if (!mappings.capacity)
+      return mappings.capacity;
+    for (size_t s = slot_of(key, mappings.capacity); mappings.slots[s] != mapping_registry::empty; s = (s + 1) & (mappings.capacity - 1))
+      if (mappings.slots[s] == key)
+	return s;
+    return mappings.capacity;
+  }
+
+  bool is_mapped(const void * p)
+  {
+    std::lock_guard<std::mutex> lock(mappings.mutex);
+    return (find_mapping(p) != mappings.capacity);
+  }
+
+  //! Drops p from the registry, false if the shim didn't map it
+  bool forget_mapping(const void * p)
+  {
+    std::lock_guard<std::mutex> lock(mappings.mutex);
+    const size_t s = find_mapping(p);
+    if (s == mappings.capacity)
+      return false;
+    mappings.slots[s] = mapping_registry::erased;
+    --mappings.live;
+    return true;
+  }
+
+  //! Large chunks: own mapping, header right before the chunk
+  void * map_allocate(size_t size, size_t alignment)
+  {
+    const size_t offset = alignment > header_size ? alignment : header_size;
+    const size_t length = align_up(size + offset + (alignment > 4096 ? alignment : 0), 4096);
+    if (length < size)
+      return nullptr;
+    void * m = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED)
+      return nullptr;
+
+    byte_type * base = static_cast<byte_type *>(m);
+    byte_type * p = reinterpret_cast<byte_type *>(align_up(reinterpret_cast<std::uintptr_t>(base) + offset, alignment));
+    *reinterpret_cast<header *>(p - header_size) = header{length, static_cast<size_t>(p - base)};
+    if (!remember_mapping(p))
+    {
+      munmap(m, length);
+      return nullptr;
+    }
+    stats.large.fetch_add(1, std::memory_order_relaxed);
+    account(static_cast<std::int64_t>(length - static_cast<size_t>(p - base)));
+    return p;
+  }
+
+  header& header_of(void * p)
+  {
+    return *reinterpret_cast<header *>(static_cast<byte_type *>(p) - header_size);
+  }
+
+  void map_free(void * p)
+  {
+    const header h = header_of(p);
+    account(-static_cast<std::int64_t>(h.length - h.offset));
+    munmap(static_cast<byte_type *>(p) - h.offset, h.length);
+  }
+
+  //! Bump chunks: taken from the arena as a memory_block would, header right before the chunk
+  void * bump_allocate(size_t size, size_t alignment)
+  {
+    const size_t offset = alignment > header_size ? alignment : header_size;
+    const size_t length = align_up(offset + size, min_alignment);
+    if (length < size)
+      return nullptr;
+    byte_type * base = static_cast<byte_type *>(arena->try_allocate(length, alignment));
+    if (!base)
+      return map_allocate(size, alignment);
+
+    byte_type * p = base + offset;
+    header_of(p) = header{length, offset};
+    account(static_cast<std::int64_t>(length - offset));
+    return p;
+  }
+
+  void bump_free(void * p)
+  {
+    const header h = header_of(p);
+    account(-static_cast<std::int64_t>(h.length - h.offset));
+    arena->deallocate(static_cast<byte_type *>(p) - h.offset, h.length, min_alignment);
+  }
+
+  bool bump_expand(void * p, size_t size)
+  {
+    header& h = header_of(p);
+    const size_t length = align_up(h.offset + size, min_alignment);
+    if (length < size || !arena->try_expand(static_cast<byte_type *>(p) - h.offset, h.length, length))
+      return false;
+    account(static_cast<std::int64_t>(length) - static_cast<std::int64_t>(h.length));
+    h.length = length;
+    return true;
+  }
+
+  //! Class of a chunk lying in the arena
+  size_t class_of_chunk(const void * p)
+  {
+    return page_class[static_cast<size_t>(static_cast<const byte_type *>(p) - arena_base) / page_size] - 1u;
+  }
+
+  //! Moves up to n chunks of class c to out, carving a new page if the free list runs dry
+  size_t central_take(size_t c, void ** out, size_t n)
+  {
+    size_class& sc = classes[c];
+    const size_t size = class_size(c);
+    std::lock_guard<std::mutex> lock(sc.mutex);
+    size_t taken = 0;
+    for (; taken < n && sc.free; ++taken)
+    {
+      out[taken] = sc.free;
+      sc.free = *static_cast<void **>(sc.free);
+    }
+    while (taken < n)
+    {
+      if (sc.next == sc.end)
+      {
+	byte_type * page = static_cast<byte_type *>(arena->try_allocate(page_size, min_alignment));
+	if (!page)
+	  break;
+	page_class[static_cast<size_t>(page - arena_base) / page_size] = static_cast<std::uint8_t>(c + 1);
+	sc.next = page;
+	sc.end = page + page_size / size * size;
+	stats.pages.fetch_add(1, std::memory_order_relaxed);
+      }
+      for (; taken < n && sc.next != sc.end; sc.next += size)
+	out[taken++] = sc.next;
+    }
+    return taken;
+  }
+
+  //! Links a run of chunks back to the free list of class c
+  void central_give(size_t c, void * first, void * last)
+  {
+    size_class& sc = classes[c];
+    std::lock_guard<std::mutex> lock(sc.mutex);
+    *static_cast<void **>(last) = sc.free;
+    sc.free = first;
+  }
+
+  bool cache_usable()
+  {
+    return strategy == strategy_type::cached && !cache.busy && !cache.dead;
+  }
+
+  void * small_allocate(size_t c)
+  {
+    void * p = nullptr;
+    if (cache_usable())
+    {
+      if (cache.heads[c])
+      {
+	p = cache.heads[c];
+	cache.heads[c] = *static_cast<void **>(p);
+	--cache.counts[c];
+	stats.cache_hits.fetch_add(1, std::memory_order_relaxed);
+      }
+      else
+      {
+	cache.busy = true;
+	if (!cache.registered)
+	{
+	  cache.registered = true;
+	  pthread_setspecific(cache_key, &cache);
+	}
+	void * batch[256];
+	const size_t n = central_take(c, batch, cache_limit(c) / 2);
+	if (n)
+	{
+	  p = batch[0];
+	  for (size_t i = 1; i < n; ++i)
+	  {
+	    *static_cast<void **>(batch[i]) = cache.heads[c];
+	    cache.heads[c] = batch[i];
+	  }
+	  cache.counts[c] += static_cast<std::uint32_t>(n - 1);
+	}
+	stats.refills.fetch_add(1, std::memory_order_relaxed);
+	cache.busy = false;
+      }
+    }
+    else
+      central_take(c, &p, 1);
+
+    if (p)
+      account(static_cast<std::int64_t>(class_size(c)));
+    return p;
+  }
+
+  //! Returns n cached chunks of class c to the shared list
+  void flush(size_t c, size_t n)
+  {
+    void * first = cache.heads[c];
+    void * last = first;
+    for (size_t i = 1; i < n; ++i)
+      last = *static_cast<void **>(last);
+    cache.heads[c] = *static_cast<void **>(last);
+    cache.counts[c] -= static_cast<std::uint32_t>(n);
+    central_give(c, first, last);
+    stats.flushes.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void small_free(void * p)
+  {
+    const size_t c = class_of_chunk(p);
+    account(-static_cast<std::int64_t>(class_size(c)));
+    if (!cache_usable())
+    {
+      central_give(c, p, p);
+      return;
+    }
+
+    *static_cast<void **>(p) = cache.heads[c];
+    cache.heads[c] = p;
+    if (++cache.counts[c] > cache_limit(c))
+      flush(c, cache.counts[c] / 2);
+  }
+
+  //! pthread key destructor, the TLS is still there
+  void flush_thread_cache(void *)
+  {
+    cache.dead = true;
+    for (size_t c = 0; c < class_count; ++c)
+      if (cache.counts[c])
+	flush(c, cache.counts[c]);
+  }
+
+  //! Every lock in the order the shim takes them, a class's before the arena's
+  void lock_all()
+  {
+    if (!ready.load(std::memory_order_acquire))
+      return;
+    for (size_class& sc : classes)
+      sc.mutex.lock();
+    arena->lock();
+    mappings.mutex.lock();
+  }
+
+  void unlock_all()
+  {
+    if (!ready.load(std::memory_order_acquire))
+      return;
+    mappings.mutex.unlock();
+    arena->unlock();
+    for (size_class& sc : classes)
+      sc.mutex.unlock();
+  }
+
+  //! The child's only thread is the one that forked and holds the arena's lock
+  void reinitialize_locks()
+  {
+    if (!ready.load(std::memory_order_acquire))
+      return;
+    arena->unlock();
+    new(&mappings.mutex) std::mutex;
+    for (size_class& sc : classes)
+      new(&sc.mutex) std::mutex;
+  }
+
+  void * allocate(size_t size, size_t alignment)
+  {
+    initialize();
+    stats.mallocs.fetch_add(1, std::memory_order_relaxed);
+    if (strategy == strategy_type::bump)
+      return bump_allocate(size, alignment);
+
+    if (alignment > min_alignment && alignment <= max_small_alignment && size <= max_small)
+    {
+      // power-of-two classes are aligned on their size within the pages
+      size_t pow2 = min_alignment;
+      while (pow2 < size || pow2 < alignment)
+	pow2 *= 2;
+      size = pow2;
+    }
+    if (size > max_small || alignment > max_small_alignment)
+      return map_allocate(size, alignment);
+    return small_allocate(class_of(size));
+  }
+
+  void deallocate(void * p)
+  {
+    if (!p)
+      return;
+    stats.frees.fetch_add(1, std::memory_order_relaxed);
+    if (!arena || !arena->is_pointed_by(p))
+    {
+      if (forget_mapping(p))
+	map_free(p);
+      else
+	stats.foreign.fetch_add(1, std::memory_order_relaxed);
+    }
+    else if (strategy == strategy_type::bump)
+      bump_free(p);
+    else
+      small_free(p);
+  }
+
+  size_t usable_size(void * p)
+  {
+    if (!p)
+      return 0;
+    if (arena && arena->is_pointed_by(p) && strategy != strategy_type::bump)
+      return class_size(class_of_chunk(p));
+    if (!(arena && arena->is_pointed_by(p)) && !is_mapped(p))
+      return 0;
+    const header& h = header_of(p);
+    return h.length - h.offset;
+  }
+
+  void * reallocate(void * p, size_t size)
+  {
+    if (!p)
+      return allocate(size, min_alignment);
+    if (!size)
+    {
+      deallocate(p);
+      return nullptr;
+    }
+
+    // p can't be told from a chunk that lost its header, so it stays as it is
+    if (!(arena && arena->is_pointed_by(p)) && !is_mapped(p))
+    {
+      stats.foreign.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    stats.reallocs.fetch_add(1, std::memory_order_relaxed);
+    const size_t usable = usable_size(p);
+    if ((size <= usable && size >= usable / 2)
+	|| (strategy == strategy_type::bump && arena->is_pointed_by(p) && bump_expand(p, size)))
+    {
+      stats.in_place.fetch_add(1, std::memory_order_relaxed);
+      return p;
+    }
+
+    void * q = allocate(size, min_alignment);
+    if (q)
+    {
+      memcpy(q, p, size < usable ? size : usable);
+      deallocate(p);
+    }
+    return q;
+  }
+
+  void * aligned(size_t alignment, size_t size)
+  {
+    return allocate(size, alignment < min_alignment ? min_alignment : alignment);
+  }
+
+  bool power_of_two(size_t n)
+  {
+    return n && !(n & (n - 1));
+  }
+
+  //! Formats without allocating, stdio may not be usable at exit
+  void print(const char * name, std::uint64_t value)
+  {
+    char buffer[64];
+    size_t n = strlen(name);
+    memcpy(buffer, name, n);
+    char digits[24];
+    size_t d = 0;
+    do
+    {
+      digits[d++] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while (value);
+    while (d)
+      buffer[n++] = digits[--d];
+    buffer[n++] = '\n';
+    if (write(STDERR_FILENO, buffer, n) < 0)
+      return;
+  }
+
+  __attribute__((destructor)) void dump_stats()
+  {
+    const char * v = getenv("NONSTD_MALLOC_STATS");
+    if (!ready.load() || !v || !*v || !strcmp(v, "0"))
+      return;
+
+    static const char * const names[] = {"cached", "locked", "bump"};
+    const char * name = names[static_cast<int>(strategy)];
+    if (write(STDERR_FILENO, "nonstd_malloc strategy ", 23) < 0 || write(STDERR_FILENO, name, strlen(name)) < 0
+	|| write(STDERR_FILENO, "\n", 1) < 0)
+      return;
+    print("  mallocs      ", stats.mallocs.load());
+    print("  frees        ", stats.frees.load());
+    print("  reallocs     ", stats.reallocs.load());
+    print("  in place     ", stats.in_place.load());
+    print("  large        ", stats.large.load());
+    print("  foreign      ", stats.foreign.load());
+    print("  cache hits   ", stats.cache_hits.load());
+    print("  refills      ", stats.refills.load());
+    print("  flushes      ", stats.flushes.load());
+    print("  class pages  ", stats.pages.load());
+    print("  committed    ", arena->committed());
+    print("  live bytes   ", stats.live.load());
+    print("  peak bytes   ", stats.peak.load());
+  }
+}
+
+extern "C"
+{
+  void * malloc(size_t size)
+  {
+    void * p = allocate(size, min_alignment);
+    if (!p)
+      errno = ENOMEM;
+    return p;
+  }
+
+  void free(void * p)
+  {
+    deallocate(p);
+  }
+
+  void * calloc(size_t count, size_t size)
+  {
+    size_t bytes;
+    if (__builtin_mul_overflow(count, size, &bytes))
+    {
+      errno = ENOMEM;
+      return nullptr;
+    }
+    void * p = malloc(bytes);
+    if (p)
+      memset(p, 0, bytes);
+    return p;
+  }
+
+  void * realloc(void * p, size_t size)
+  {
+    void * q = reallocate(p, size);
+    if (!q && size)
+      errno = ENOMEM;
+    return q;
+  }
+
+  void * reallocarray(void * p, size_t count, size_t size)
+  {
+    size_t bytes;
+    if (__builtin_mul_overflow(count, size, &bytes))
+    {
+      errno = ENOMEM;
+      return nullptr;
+    }
+    return realloc(p, bytes);
+  }
+
+  int posix_memalign(void ** out, size_t alignment, size_t size)
+  {
+    if (!power_of_two(alignment) || alignment % sizeof(void *))
+      return EINVAL;
+    void * p = aligned(alignment, size);
+    if (!p)
+      return ENOMEM;
+    *out = p;
+    return 0;
+  }
+
+  void * aligned_alloc(size_t alignment, size_t size)
+  {
+    if (!power_of_two(alignment))
+    {
+      errno = EINVAL;
+      return nullptr;
+    }
+    void * p = aligned(alignment, size);
+    if (!p)
+      errno = ENOMEM;
+    return p;
+  }
+
+  void * memalign(size_t alignment, size_t size)
+  {
+    return aligned_alloc(alignment, size);
+  }
+
+  void * valloc(size_t size)
+  {
+    return aligned_alloc(static_cast<size_t>(sysconf(_SC_PAGESIZE)), size);
+  }
+
+  void * pvalloc(size_t size)
+  {
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return aligned_alloc(page, align_up(size, page));
+  }
+
+  size_t malloc_usable_size(void * p)
+  {
+    return usable_size(p);
+  }
+}
+
+void * operator new(size_t size)
+{
+  void * p = allocate(size, min_alignment);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void * operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void * operator new(size_t size, const std::nothrow_t&) noexcept
+{
+  return allocate(size, min_alignment);
+}
+
+void * operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+  return allocate(size, min_alignment);
+}
+
+void * operator new(size_t size, std::align_val_t alignment)
+{
+  void * p = aligned(static_cast<size_t>(alignment), size);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void * operator new[](size_t size, std::align_val_t alignment)
+{
+  return operator new(size, alignment);
+}
+
+void * operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+  return aligned(static_cast<size_t>(alignment), size);
+}
+
+void * operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+  return aligned(static_cast<size_t>(alignment), size);
+}
+
+void operator delete(void * p) noexcept
+{
+  deallocate(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+  deallocate(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+  deallocate(p);
+}
+
+void operator delete[](void * p, size_t) noexcept
+{
+  deallocate(p);
+}
+
+void operator delete(void * p, const std::nothrow_t&) noexcept
+{
+  deallocate(p);
+}
+
+void operator delete[](void * p, const std::nothrow_t&) noexcept
+{
+  deallocate(p);
+}
+
+void operator delete(void * p, std::align_val_t) noexcept
+{
+  deallocate(p);
+}
+
+void operator delete[](void * p, std::align_val_t) noexcept
+{
+  deallocate(p);
+}
+
+void operator delete(void * p, size_t, std::align_val_t) noexcept
+{
+  deallocate(p);
+}
+
+void operator delete[](void * p, size_t, std::align_val_t) noexcept
+{
+  deallocate(p);
+}
+
+void operator delete(void * p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+  deallocate(p);
+}
+
+void operator delete[](void * p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+  deallocate(p);
+}
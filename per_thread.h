@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+namespace nonstd
+{
+  namespace details
+  {
+    /**
+     * @class per_thread
+     * @brief Instance-local storage of a Record per thread.
+     *
+     * A thread claims a record on its first local() call and releases it on exit.
+     * Released records are kept as they are and handed to the next claiming thread,
+     * all of them are visited by for_each() and freed along with the instance.
+     */
+    template<typename Record>
+      class per_thread
+      {
+	private:
+	  struct slot
+	  {
+	    Record record{};
+	    std::atomic<bool> owned{false};
+	    slot * next = nullptr;
+	  };
+
+	  struct state
+	  {
+	    ~state()
+	    {
+	      slot * s = head.load();
+	      while (s)
+	      {
+		slot * next = s->next;
+		delete s;
+		s = next;
+	      }
+	    }
+
+	    std::atomic<slot *> head{nullptr};
+	  };
+
+	  struct cache_entry
+	  {
+	    std::uint64_t id;
+	    slot * s;
+	    std::weak_ptr<state> owner;
+	  };
+
+	  //! Thread's claimed slots, released on the thread exit if their instance is alive
+	  struct cache
+	  {
+	    ~cache()
+	    {
+	      for (auto& e : entries)
+		if (auto owner = e.owner.lock())
+		  e.s->owned.store(false, std::memory_order_release);
+	    }
+
+	    std::vector<cache_entry> entries;
+	  };
+
+	public:
+	  per_thread()
+	    : _state(std::make_shared<state>())
+	    , _id(next_id())
+	  {}
+
+	  per_thread(const per_thread&) = delete;
+	  per_thread& operator=(const per_thread&) = delete;
+
+	  //! Calling thread's record
+	  Record& local()
+	  {
+	    cache& c = local_cache();
+	    for (auto& e : c.entries)
+	      if (e.id == _id)
+		return e.s->record;
+
+	    c.entries.erase(
+		std::remove_if(c.entries.begin(), c.entries.end(), [](const cache_entry& e) { return e.owner.expired(); })
+		, c.entries.end()
+		);
+	    slot * s = claim();
+	    c.entries.push_back(cache_entry{_id, s, _state});
+	    return s->record;
+	  }
+
+	  //! Visits every record, claimed or released
+	  template<typename F>
+	    void for_each(F f)
+	    {
+	      for (slot * s = _state->head.load(std::memory_order_acquire); s; s = s->next)
+		f(s->record);
+	    }
+
+	private:
+	  slot * claim()
+	  {
+	    for (slot * s = _state->head.load(std::memory_order_acquire); s; s = s->next)
+	    {
+	      bool owned = false;
+	      if (!s->owned.load(std::memory_order_relaxed)
+		  && s->owned.compare_exchange_strong(owned, true, std::memory_order_acquire))
+		return s;
+	    }
+
+	    slot * s = new slot;
+	    s->owned.store(true, std::memory_order_relaxed);
+	    s->next = _state->head.load(std::memory_order_relaxed);
+	    while (!_state->head.compare_exchange_weak(s->next, s, std::memory_order_release, std::memory_order_relaxed))
+	      ;
+	    return s;
+	  }
+
+	  static cache& local_cache()
+	  {
+	    static thread_local cache c;
+	    return c;
+	  }
+
+	  static std::uint64_t next_id()
+	  {
+	    static std::atomic<std::uint64_t> id{0};
+	    return ++id;
+	  }
+
+	  std::shared_ptr<state> _state;
+	  const std::uint64_t _id;
+      };
+  } // details
+} // nonstd
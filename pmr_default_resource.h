@@ -0,0 +1,59 @@
+#pragma once
+
+#if __cplusplus > 201402L
+#include <memory_resource>
+
+namespace nonstd
+{
+  namespace details
+  {
+    //! Innermost scoped resource of the calling thread, nullptr outside of any scope
+    inline std::pmr::memory_resource *& thread_default_resource() noexcept
+    {
+      static thread_local std::pmr::memory_resource * resource = nullptr;
+      return resource;
+    }
+  } // details
+
+  namespace pmr
+  {
+    //! Calling thread's scoped default resource, the process-wide std::pmr one outside of any scope
+    inline std::pmr::memory_resource * get_default_resource() noexcept
+    {
+      std::pmr::memory_resource * resource = nonstd::details::thread_default_resource();
+      return resource ? resource : std::pmr::get_default_resource();
+    }
+
+    /**
+     * @class scoped_default_resource
+     * @brief Installs a default resource for the calling thread until the scope ends.
+     *
+     * The project's pmr containers and blocks constructed without an explicit
+     * resource take nonstd::pmr::get_default_resource(), so a worker may route
+     * a whole request to its own arena. Scopes nest, std::pmr containers keep
+     * using the process-wide default.
+     */
+    class scoped_default_resource
+    {
+      public:
+	explicit scoped_default_resource(std::pmr::memory_resource * resource) noexcept
+	  : _previous(nonstd::details::thread_default_resource())
+	{
+	  nonstd::details::thread_default_resource() = resource;
+	}
+
+	scoped_default_resource(const scoped_default_resource&) = delete;
+	scoped_default_resource& operator=(const scoped_default_resource&) = delete;
+
+	~scoped_default_resource()
+	{
+	  nonstd::details::thread_default_resource() = _previous;
+	}
+
+      private:
+	std::pmr::memory_resource * const _previous;
+    };
+  } // pmr
+} // nonstd
+
+#endif // __cplusplus > 201402L
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "epoch.h"
+#include "pmr_memory_block.h"
+
+#if __cplusplus > 201402L
+#include <memory_resource>
+
+namespace nonstd
+{
+  namespace pmr
+  {
+    /**
+     * @class epoch_domain
+     * @brief Epoch-based reclamation of list_details::node<T> allocated from a memory resource.
+     *
+     * Destroys the retired nodes and returns them to the resource in batches,
+     * one lock of the block per batch for the memory_block resources.
+     */
+    template<typename T>
+      class epoch_domain : public nonstd::epoch_domain
+      {
+	public:
+	  using node_type = list_details::node<T>;
+
+	  explicit epoch_domain(std::pmr::memory_resource * resource = nonstd::pmr::get_default_resource())
+	    : nonstd::epoch_domain(&reclaim, this)
+	    , _resource(resource)
+	  {}
+
+	  ~epoch_domain()
+	  {
+	    reclaim_all();
+	  }
+
+	  std::pmr::memory_resource * resource() const
+	  {
+	    return _resource;
+	  }
+
+	private:
+	  static void reclaim(void * context, node_base ** nodes, size_type count)
+	  {
+	    auto self = static_cast<epoch_domain *>(context);
+	    void * batch[batch_size];
+	    while (count)
+	    {
+	      const size_type n = count < batch_size ? count : batch_size;
+	      for (size_type i = 0; i < n; ++i)
+	      {
+		node_type * node = static_cast<node_type *>(nodes[i]);
+		node->~node_type();
+		batch[i] = node;
+	      }
+	      nonstd::pmr::deallocate_bulk(self->_resource, batch, n, sizeof(node_type), alignof(node_type));
+	      nodes += n;
+	      count -= n;
+	    }
+	  }
+
+	  std::pmr::memory_resource * _resource = nullptr;
+      };
+  } // pmr
+} // nonstd
+
+#endif // __cplusplus > 201402L
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "unlikely.h"
+#include "pmr_memory_block.h"
+#include <atomic>
+
+#if __cplusplus > 201402L
+#include <memory_resource>
+
+namespace nonstd
+{
+  namespace pmr
+  {
+    /**
+     * @class fallback_resource
+     * @brief Allocates from a primary memory block, spills to the upstream once it's full.
+     *
+     * The primary is asked through try_allocate so overflowing it costs a branch,
+     * not an exception. Being a memory_block_base itself the resource chains:
+     * a fallback_resource may well be the primary of another one.
+     */
+    class fallback_resource : public memory_block_base
+    {
+      public:
+	fallback_resource(memory_block_base * primary, std::pmr::memory_resource * upstream = nonstd::pmr::get_default_resource())
+	  : _primary(primary)
+	  , _upstream(upstream)
+	{}
+
+	fallback_resource(const fallback_resource&) = delete;
+	fallback_resource& operator=(const fallback_resource&) = delete;
+
+	//! Number of allocations the primary couldn't serve
+	size_type spills() const
+	{
+	  return _spills.load(std::memory_order_relaxed);
+	}
+
+	memory_block_base * primary() const
+	{
+	  return _primary;
+	}
+
+	std::pmr::memory_resource * upstream() const
+	{
+	  return _upstream;
+	}
+
+	bool is_pointed_by(const void * p, size_type size = 0) const noexcept override
+	{
+	  if (_primary->is_pointed_by(p, size))
+	    return true;
+	  auto upstream = dynamic_cast<const memory_block_base *>(_upstream);
+	  return (upstream && upstream->is_pointed_by(p, size));
+	}
+
+      protected:
+	void * do_try_allocate(size_type bytes, size_type alignment) noexcept override
+	{
+	  if (void * p = _primary->try_allocate(bytes, alignment))
+	    return p;
+
+	  _spills.fetch_add(1, std::memory_order_relaxed);
+	  if (auto upstream = dynamic_cast<memory_block_base *>(_upstream))
+	    return upstream->try_allocate(bytes, alignment);
+	  try
+	  {
+	    return _upstream->allocate(bytes, alignment);
+	  }
+	  catch(...)
+	  {
+	    return nullptr;
+	  }
+	}
+
+	void * do_allocate(size_type bytes, size_type alignment) override
+	{
+	  if (void * p = _primary->try_allocate(bytes, alignment))
+	    return p;
+
+	  _spills.fetch_add(1, std::memory_order_relaxed);
+	  return _upstream->allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void * p, size_type bytes, size_type alignment) override
+	{
+	  if (_primary->is_pointed_by(p))
+	    _primary->deallocate(p, bytes, alignment);
+	  else
+	    _upstream->deallocate(p, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+	  return (this == &other);
+	}
+
+      private:
+	memory_block_base * _primary = nullptr;
+	std::pmr::memory_resource * _upstream = nullptr;
+	std::atomic<size_type> _spills{0};
+    };
+  } // pmr
+} // nonstd
+
+#endif // __cplusplus > 201402L
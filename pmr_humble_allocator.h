@@ -4,10 +4,12 @@
 #include "unlikely.h"
 
 #include <new>
+#include <algorithm>
 #include <utility>
 #include <memory>
 
-#include "memory.h"
+#include "legacy_memory_block.h"
+#include "block_cache.h"
 
 namespace nonstd
 {
@@ -24,8 +26,17 @@ namespace pmr
       using size_type = std::size_t;
       using difference_type = std::ptrdiff_t;
 
-      constexpr static size_t block_size = sizeof(T) * N;
-      using block = nonstd::memory::memory_block;
+      //! Room for N objects, along with their redzones in ASan builds
+      constexpr static size_t block_size = details::asan_padded(sizeof(T) * N, sizeof(T));
+      using block = nonstd::legacy::memory_block;
+      using cache = nonstd::block_cache<block_size>;
+
+      //! Drops every object at once, the allocator is the sole user of its block
+      void release() noexcept
+      {
+	if (storage_)
+	  storage_->release();
+      }
 
       template<typename U>
 	struct rebind
@@ -33,22 +44,45 @@ namespace pmr
 	  using other = humble<U, N>;
 	};
 
-      ~humble() {}
+      ~humble()
+      {
+	if (storage_ && !(--(storage_->_refcnt)))
+	  retire(storage_);
+      }
 
       humble() = default;
 
-      //! Copy-constructor does nothing - new region will be allocated on demand
-      humble(const humble&) {}
+      //! Charges tag instead of the current one
+      explicit humble(allocation_tag& tag)
+	: tag_(&tag)
+      {}
+
+      //! Sizes the blocks at the high-water mark the tag learned, block_size until it has one
+      explicit humble(adaptive_t, allocation_tag& tag = allocation_tag::current())
+	: tag_(&tag)
+	, adaptive_(true)
+      {}
+
+      //! Copy-constructor only takes the tag - new region will be allocated on demand
+      humble(const humble& other)
+	: tag_(other.tag_)
+	, adaptive_(other.adaptive_)
+      {}
 
       //! Move-constructor claims the allocated memory block (if any).
       humble(humble&& other)
 	: storage_(other.storage_)
+	, tag_(other.tag_)
+	, adaptive_(other.adaptive_)
       {
 	other.storage_ = nullptr;
       }
 
-      //! Copy-constructor does nothing - new region will be allocated on demand
-      template<typename U> humble(const humble<U,N>&) {}
+      //! Copy-constructor only takes the tag - new region will be allocated on demand
+      template<typename U> humble(const humble<U,N>& other)
+	: tag_(other.tag_)
+	, adaptive_(other.adaptive_)
+      {}
 
       //! Copy assignment does nothing - new region will be allocated on demand
       humble& operator=(const humble&) {return *this;}
@@ -57,37 +91,84 @@ namespace pmr
       humble& operator=(humble&& other)
       {
 	if (storage_ && !(--(storage_->_refcnt)))
-	  delete storage_;
+	  retire(storage_);
 	storage_ = other.storage_;
+	tag_ = other.tag_;
+	adaptive_ = other.adaptive_;
 	other.storage_ = nullptr;
 	return *this;
       }
 
       pointer allocate(std::size_t n)
       {
-	if (!storage_)
-	  storage_ = new block(block_size);
-
-	void * p = storage_->allocate(n * sizeof(T));
+	pointer p = try_allocate(n);
 	if (unlikely(!p))
 	  throw std::bad_alloc();
-	return reinterpret_cast<T *>(p);
+	return p;
+      }
+
+      //! Acquires the block upfront rather than on the first allocation, false if out of memory
+      bool prepare() noexcept
+      {
+	if (!storage_)
+	  storage_ = acquire(sizeof(T));
+	return (storage_ != nullptr);
       }
 
+      //! Returns nullptr instead of throwing once the block is exhausted
+      pointer try_allocate(std::size_t n) noexcept
+      {
+	if (!storage_)
+	  storage_ = acquire(n * sizeof(T));
+
+	if (unlikely(!storage_))
+	  return nullptr;
+	return reinterpret_cast<T *>(storage_->allocate(n * sizeof(T)));
+      }
+
+      //! An emptied block rewinds by itself and is kept for the next allocations
       void deallocate(T *p, std::size_t n)
       {
-	if (storage_ && storage_->deallocate(p, n * sizeof(T)))
-	{
-	  if (storage_->empty())
-	  {
-	    delete storage_;
-	    storage_ = nullptr;
-	  }
-	}
-	else
-	{
+	if (!storage_ || !storage_->deallocate(p, n * sizeof(T)))
+	  throw std::out_of_range("deallocation outside the storage");
+      }
+
+      //! Hands out the room for n objects or more the block can spare
+      allocation_result<pointer, size_type> allocate_at_least(std::size_t n)
+      {
+	if (!storage_)
+	  storage_ = acquire(n * sizeof(T));
+	if (unlikely(!storage_))
+	  throw std::bad_alloc();
+
+	auto result = storage_->allocate_at_least(n, sizeof(T));
+	if (unlikely(!result.ptr))
+	  throw std::bad_alloc();
+	return {static_cast<pointer>(result.ptr), result.count};
+      }
+
+      //! Grows or shrinks the latest allocation of old_n objects to new_n in place
+      bool try_expand(pointer p, std::size_t old_n, std::size_t new_n) noexcept
+      {
+	return (storage_ && storage_->try_expand(p, old_n * sizeof(T), new_n * sizeof(T)));
+      }
+
+      //! Allocates count single objects under a single lock of the block
+      void allocate_bulk(std::size_t count, pointer * out)
+      {
+	if (!storage_)
+	  storage_ = acquire(count * sizeof(T));
+	if (unlikely(!storage_))
+	  throw std::bad_alloc();
+
+	if (unlikely(!storage_->allocate_bulk(sizeof(T), count, out)))
+	  throw std::bad_alloc();
+      }
+
+      void deallocate_bulk(pointer * ptrs, std::size_t count)
+      {
+	if (!storage_ || !storage_->deallocate_bulk(ptrs, count, sizeof(T)))
 	  throw std::out_of_range("deallocation outside the storage");
-	}
       }
 
       template<typename U, typename ...Args>
@@ -114,34 +195,67 @@ namespace pmr
       }
 
       block * storage_ = nullptr;
+      allocation_tag * tag_ = &allocation_tag::current(); //! charged by the blocks acquired
+      bool adaptive_ = false; //! blocks sized at the tag's learned high-water mark
+
+    private:
+      //! Fresh block of block_size bytes, or as learned by the tag's profile, charging the tag
+      block * acquire(std::size_t bytes) const noexcept
+      {
+	const std::size_t size = adaptive_ ? std::max(bytes, details::asan_padded(tag_->profile().suggest(sizeof(T) * N), sizeof(T))) : block_size;
+	block * b = nullptr;
+	if (size == block_size)
+	  b = cache::acquire();
+	else
+	{
+	  b = new(std::nothrow) block(size);
+	  if (b && !b->initialized())
+	  {
+	    delete b;
+	    b = nullptr;
+	  }
+	}
+	if (b)
+	  b->set_tag(*tag_);
+	return b;
+      }
+
+      //! Only blocks of block_size go back to the cache
+      static void retire(block * b) noexcept
+      {
+	if (b->capacity() == block_size)
+	  cache::release(b);
+	else
+	  delete b;
+      }
     };
-} // legacy_allocator
+} // pmr
 } //nonstd
 
 //! Allocators for the same memory block and value type are replaceapble
 template <typename T, size_t N>
-  bool operator==(const nonstd::legacy_allocator::humble<T,N>& lhs, const nonstd::legacy_allocator::humble<T,N>& rhs)
+  bool operator==(const nonstd::pmr::humble<T,N>& lhs, const nonstd::pmr::humble<T,N>& rhs)
 {
   return (lhs.storage_ && rhs.storage_ && (lhs.storage_ == rhs.storage_));
 }
 
 //! Allocators for the same memory block and value type are replaceapble
 template <typename T, size_t N>
-  bool operator!=(const nonstd::legacy_allocator::humble<T,N>& lhs, const nonstd::legacy_allocator::humble<T,N>& rhs)
+  bool operator!=(const nonstd::pmr::humble<T,N>& lhs, const nonstd::pmr::humble<T,N>& rhs)
 {
   return !(lhs == rhs);
 }
 
 //! Fallback template: in common case allocators aren't replaceapble
 template <typename T1, size_t N1, typename T2, size_t N2>
-  bool operator==(const nonstd::legacy_allocator::humble<T1,N1>&, const nonstd::legacy_allocator::humble<T2,N2>&)
+  bool operator==(const nonstd::pmr::humble<T1,N1>&, const nonstd::pmr::humble<T2,N2>&)
 {
   return false;
 }
 
 //! Fallback template: in common case allocators aren't replaceapble
 template <typename T1, size_t N1, typename T2, size_t N2>
-  bool operator!=(const nonstd::legacy_allocator::humble<T1,N1>&, const nonstd::legacy_allocator::humble<T2,N2>&)
+  bool operator!=(const nonstd::pmr::humble<T1,N1>&, const nonstd::pmr::humble<T2,N2>&)
 {
   return true;
 }
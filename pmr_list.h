@@ -3,16 +3,29 @@
 #if __cplusplus > 201402L
 
 #include "list_base.h"
+#include "pmr_memory_block.h"
+#include "pmr_default_resource.h"
 #include <memory_resource>
 
 #include <memory>
 #include <utility>
 #include <initializer_list>
+#include <iterator>
+#include <type_traits>
+#include <functional>
 
 namespace nonstd
 {
   namespace pmr
   {
+    /**
+     * @class list
+     * @brief Singly linked list allocating its nodes from a memory resource.
+     *
+     * Given a spare_limit() it keeps up to that many popped nodes (destroyed,
+     * not deallocated) for its next insertions, so push/pop churn on a bump
+     * memory_block stops draining the block once warm.
+     */
     template <typename T>
       class list
       {
@@ -21,6 +34,9 @@ namespace nonstd
 	  using node_base_type = typename node_type::base_type;
 	  using header_type = list_details::header;
 
+	  //! Number of nodes allocated or deallocated at once by the range operations
+	  static constexpr size_t bulk_size = 64;
+
 	public:
 	  using value_type = T;
 	  using reference = T&;
@@ -35,18 +51,17 @@ namespace nonstd
 
 	  list() = default;
 
-	  explicit list(allocator_type& alloc)
+	  explicit list(const allocator_type& alloc)
 	    : _allocator(alloc)
 	  {}
 
-	  list(size_type count, const T& value, allocator_type alloc = {})
+	  list(size_type count, const T& value, allocator_type alloc = nonstd::pmr::get_default_resource())
 	    : _allocator(alloc)
 	  {
-	    while(count--)
-	      push_back(value);
+	    append(count, [&value]() -> const T& { return value; });
 	  }
 
-	  list(const list& other, allocator_type alloc = {})
+	  list(const list& other, allocator_type alloc = nonstd::pmr::get_default_resource())
 	    : _allocator(alloc)
 	  {
 	    operator=(other);
@@ -54,6 +69,7 @@ namespace nonstd
 
 	  list(list&& other)
 	    : _allocator(other.get_allocator())
+	    , _spare_limit(other._spare_limit)
 	  {
 	    operator=(std::move(other));
 	  }
@@ -69,8 +85,7 @@ namespace nonstd
 	    if (&other != this)
 	    {
 	      destroy(_header);
-	      for (const T& v : other)
-		push_back(v);
+	      append(other.begin(), other.end());
 	    }
 	    return *this;
 	  }
@@ -92,27 +107,28 @@ namespace nonstd
 	    return *this;
 	  }
 
-	  list(std::initializer_list<T>&& l, const allocator_type& alloc = {})
+	  list(std::initializer_list<T>&& l, const allocator_type& alloc = nonstd::pmr::get_default_resource())
 	    : _allocator(alloc)
 	  {
-	    for (auto&& value : l)
-	      push_back(std::forward<value_type>(value));
+	    append(l.begin(), l.end());
 	  }
 
 	  template<typename InputIt>
-	    list(InputIt first, InputIt last, const allocator_type& alloc = {})
+	    list(InputIt first, InputIt last, const allocator_type& alloc = nonstd::pmr::get_default_resource())
 	      : _allocator(alloc)
 	    {
-	      while (first != last)
-	      {
-		push_back(*first);
-		++first;
-	      }
+	      append(first, last);
 	    }
 
 	  ~list()
 	  {
-	    erase(begin(), end());
+	    shrink_spare();
+	    destroy(_header);
+	  }
+
+	  allocator_type get_allocator() const
+	  {
+	    return _allocator;
 	  }
 
 	  void swap(list& other) noexcept
@@ -153,7 +169,7 @@ namespace nonstd
 
 	  const_iterator end() const
 	  {
-	    return iterator{&_header._node};
+	    return const_iterator{&_header._node};
 	  }
 
 	  const_iterator cbegin() const
@@ -181,11 +197,49 @@ namespace nonstd
 	    return (_header._size == 0);
 	  }
 
+	  //! Number of spare nodes kept for the next insertions
+	  size_type spare_size() const
+	  {
+	    return _spare.size();
+	  }
+
+	  size_type spare_limit() const
+	  {
+	    return _spare_limit;
+	  }
+
+	  //! Keeps up to limit popped nodes from now on, hands back the spare ones beyond
+	  void spare_limit(size_type limit)
+	  {
+	    _spare_limit = limit;
+	    while (_spare.size() > _spare_limit)
+	      _allocator.resource()->deallocate(_spare.pop(), sizeof(node_type), alignof(node_type));
+	  }
+
+	  //! Hands the spare nodes back to the resource
+	  void shrink_spare()
+	  {
+	    while (void * spare = _spare.pop())
+	      _allocator.resource()->deallocate(spare, sizeof(node_type), alignof(node_type));
+	  }
+
+	  void push_back(const value_type& value)
+	  {
+	    list_details::node_base **end = _header.get_end_slot();
+	    *end = create_node(value);
+	  }
+
 	  void push_back(value_type&& value)
 	  {
 	    list_details::node_base **end = _header.get_end_slot();
 	    *end = create_node(std::forward<value_type>(value));
-	    (*end)->_next = &_header._node;
+	  }
+
+	  template<typename... Args>
+	  void emplace_back(Args&&... args)
+	  {
+	    list_details::node_base **end = _header.get_end_slot();
+	    *end = create_node(std::forward<Args>(args)...);
 	  }
 
 	  void pop_back()
@@ -199,6 +253,34 @@ namespace nonstd
 	    }
 	  }
 
+	  void push_front(const value_type& value)
+	  {
+	    emplace_front(value);
+	  }
+
+	  void push_front(value_type&& value)
+	  {
+	    emplace_front(std::forward<value_type>(value));
+	  }
+
+	  template<typename... Args>
+	  void emplace_front(Args&&... args)
+	  {
+	    auto node = create_node(std::forward<Args>(args)...);
+	    node->_next = _header._node._next;
+	    _header._node._next = node;
+	  }
+
+	  void pop_front()
+	  {
+	    if (!_header.is_end(_header._node._next))
+	    {
+	      auto node = _header._node._next;
+	      _header._node._next = node->_next;
+	      destroy_node(static_cast<node_type *>(node));
+	    }
+	  }
+
 	  const_reference back() const
 	  {
 	    list_details::node_base * const *end = _header.get_last_node_slot();
@@ -221,63 +303,238 @@ namespace nonstd
 	    return static_cast<node_type *>(_header._node._next)->_value;
 	  }
 
+	  //! Stable merge sort relinking the nodes, allocates nothing
+	  void sort()
+	  {
+	    sort(std::less<value_type>());
+	  }
+
+	  template<typename Compare>
+	    void sort(Compare comp)
+	    {
+	      list_details::sort<T>(_header, comp);
+	    }
+
+	  void merge(list& other)
+	  {
+	    merge(other, std::less<value_type>());
+	  }
+
+	  void merge(list&& other)
+	  {
+	    merge(other, std::less<value_type>());
+	  }
+
+	  template<typename Compare>
+	    void merge(list&& other, Compare comp)
+	    {
+	      merge(other, comp);
+	    }
+
+	  /**
+	   * Moves the nodes of the sorted other into the sorted list, stable.
+	   * Relinks them when the allocators compare equal, otherwise the nodes
+	   * must stay with their allocator: the values are moved over instead.
+	   */
+	  template<typename Compare>
+	    void merge(list& other, Compare comp)
+	    {
+	      if (&other == this)
+		return;
+	      if (_allocator == other._allocator)
+	      {
+		list_details::merge<T>(_header, other._header, comp);
+		return;
+	      }
+	      list_details::node_base **end = _header.get_end_slot();
+	      append(std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+	      other.destroy(other._header);
+	      header_type moved;
+	      list_details::split(_header, end, moved);
+	      try
+	      {
+		list_details::merge<T>(_header, moved, comp);
+	      }
+	      catch(...)
+	      {
+		list_details::splice_back(_header, moved);
+		throw;
+	      }
+	    }
+
+	  //! Erases the nodes equal to their predecessor, returns their count
+	  size_type unique()
+	  {
+	    return unique(std::equal_to<value_type>());
+	  }
+
+	  template<typename BinaryPredicate>
+	    size_type unique(BinaryPredicate pred)
+	    {
+	      header_type removed;
+	      size_type count = 0;
+	      try
+	      {
+		count = list_details::unique<T>(_header, removed, pred);
+	      }
+	      catch(...)
+	      {
+		destroy_nodes(removed);
+		throw;
+	      }
+	      destroy_nodes(removed);
+	      return count;
+	    }
+
+	  void reverse()
+	  {
+	    list_details::reverse(_header);
+	  }
+
 	private:
 
 	  template<typename... Args>
 	    auto create_node(Args&&... args)
 	    {
-	      node_type * node =
-		static_cast<node_type *>(
-		    _allocator.resource()->allocate(sizeof(node_type), alignof(node_type))
-		    );
+	      node_type * node = allocate_node();
 	      try
 	      {
-		_allocator.construct(std::addressof(node->_value), std::forward<Args>(args)...);
+		construct_node(node, std::forward<Args>(args)...);
 	      }
 	      catch(...)
 	      {
-		_allocator.resource()->deallocate(node, sizeof(node_type), alignof(node_type));
+		deallocate_node(node);
 		throw;
 	      }
 	      return node;
 	    }
 
+	  //! A spare node if any, a fresh one from the resource otherwise
+	  node_type * allocate_node()
+	  {
+	    void * node = _spare.pop();
+	    if (!node)
+	      node = _allocator.resource()->allocate(sizeof(node_type), alignof(node_type));
+	    return static_cast<node_type *>(node);
+	  }
+
+	  //! Keeps the destroyed node as a spare up to the limit, deallocates it otherwise
+	  void deallocate_node(node_type * node)
+	  {
+	    if (_spare.size() < _spare_limit)
+	      _spare.push(node);
+	    else
+	      _allocator.resource()->deallocate(node, sizeof(node_type), alignof(node_type));
+	  }
+
+	  template<typename... Args>
+	    void construct_node(node_type * node, Args&&... args)
+	    {
+	      _allocator.construct(std::addressof(node->_value), std::forward<Args>(args)...);
+	      node->_next = &_header._node;
+	      ++_header._size;
+	    }
+
 	  void destroy_node(node_type * node)
 	  {
 	    _allocator.destroy(std::addressof(node->_value));
-	    _allocator.resource()->deallocate(node, sizeof(node_type), alignof(node_type));
+	    deallocate_node(node);
+	    --_header._size;
 	  }
 
+	  //! Destroys the nodes, at once when they fill the whole memory block
 	  void destroy(list_details::header& header)
 	  {
+	    // trivially destructible nodes filling a whole memory block need no walk
+	    if constexpr (std::is_trivially_destructible_v<T>)
+	    {
+	      auto block = header._size ? dynamic_cast<memory_block_base *>(_allocator.resource()) : nullptr;
+	      if (block && block->release(header._size * sizeof(node_type)))
+	      {
+		header.reset();
+		return;
+	      }
+	    }
+
+	    destroy_nodes(header);
+	  }
+
+	  //! Destroys the nodes one by one, handing them back to the resource in batches
+	  void destroy_nodes(list_details::header& header)
+	  {
+	    void * nodes[bulk_size];
+	    size_type count = 0;
 	    list_details::node_base * next = header._node._next;
 	    while (next != &header._node)
 	    {
-	      auto it = next;
+	      auto node = static_cast<node_type *>(next);
 	      next = next->_next;
-	      destroy_node(static_cast<node_type *>(it));
+	      _allocator.destroy(std::addressof(node->_value));
+	      nodes[count++] = node;
+	      if (count == bulk_size)
+	      {
+		nonstd::pmr::deallocate_bulk(_allocator.resource(), nodes, count, sizeof(node_type), alignof(node_type));
+		count = 0;
+	      }
 	    }
+	    if (count)
+	      nonstd::pmr::deallocate_bulk(_allocator.resource(), nodes, count, sizeof(node_type), alignof(node_type));
+	    header.reset();
 	  }
 
-	  auto clone (const node_type * other_head)
-	  {
-	    list_details::header header;
-	    list_details::node_base ** it = &header._node._next;
+	  template<typename InputIt>
+	    void append(InputIt first, InputIt last)
+	    {
+	      if constexpr (std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<InputIt>::iterator_category>)
+	      {
+		append(std::distance(first, last), [&first]() -> decltype(auto) { return *first++; });
+	      }
+	      else
+	      {
+		list_details::node_base **end = _header.get_end_slot();
+		for (; first != last; ++first)
+		{
+		  *end = create_node(*first);
+		  end = &((*end)->_next);
+		}
+	      }
+	    }
 
-	    for (auto other_it = other_head
-		; other_it != nullptr
-		; it = &((*it)->_next)
-		, other_it = other_it->_next
-		)
+	  //! Appends count nodes constructed from next() allocating them in batches
+	  template<typename Generator>
+	    void append(size_type count, Generator next)
 	    {
-	      *it = create_node(other_it->_value);
+	      list_details::node_base **end = _header.get_end_slot();
+	      void * nodes[bulk_size];
+	      while (count)
+	      {
+		const size_type batch = count < bulk_size ? count : bulk_size;
+		nonstd::pmr::allocate_bulk(_allocator.resource(), sizeof(node_type), batch, nodes, alignof(node_type));
+		size_type i = 0;
+		try
+		{
+		  for (; i < batch; ++i)
+		  {
+		    node_type * node = static_cast<node_type *>(nodes[i]);
+		    construct_node(node, next());
+		    *end = node;
+		    end = &((*end)->_next);
+		  }
+		}
+		catch(...)
+		{
+		  nonstd::pmr::deallocate_bulk(_allocator.resource(), nodes + i, batch - i, sizeof(node_type), alignof(node_type));
+		  throw;
+		}
+		count -= batch;
+	      }
 	    }
-	    return header._node._next;
-	  }
 
 	private:
 	  header_type _header{};
-	  allocator_type _allocator{};
+	  allocator_type _allocator{nonstd::pmr::get_default_resource()};
+	  list_details::spare_chain _spare{};
+	  size_type _spare_limit = 0;
       }; // list
   } // pmr
 } //nonstd
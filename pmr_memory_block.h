@@ -1,10 +1,18 @@
 #pragma once
 
 #include "unlikely.h"
+#include "purge_pages.h"
+#include "asan.h"
+#include "allocator_extensions.h"
+#include "pmr_default_resource.h"
+#include "resource_registry.h"
+#include "allocation_tag.h"
+#include <algorithm>
 #include <cstddef>
 #include <utility>
 #include <mutex>
 #include <atomic>
+#include <chrono>
 
 #ifdef MEMORY_BLOCK_TRACING
 #include <iostream>
@@ -17,12 +25,158 @@ namespace nonstd
 {
   namespace pmr
   {
+    /**
+     * @class memory_block_base
+     * @brief Size-independent interface of the memory blocks.
+     *
+     * Extends std::pmr::memory_resource with batched allocation and, as an
+     * expandable_resource, in-place resizing. The defaults fall back to a call
+     * per chunk and refuse to resize.
+     */
+    class memory_block_base : public std::pmr::memory_resource, public expandable_resource
+    {
+      public:
+	using size_type = size_t;
+
+	//! Allocates count chunks of bytes each, either all of them or none
+	void allocate_bulk(size_type bytes, size_type count, void ** out, size_type alignment = alignof(std::max_align_t))
+	{
+	  do_allocate_bulk(bytes, count, out, alignment);
+	}
+
+	//! Deallocates count chunks of bytes each
+	void deallocate_bulk(void * const * ptrs, size_type count, size_type bytes, size_type alignment = alignof(std::max_align_t))
+	{
+	  do_deallocate_bulk(ptrs, count, bytes, alignment);
+	}
+
+	//! Returns nullptr instead of throwing once the resource is exhausted
+	void * try_allocate(size_type bytes, size_type alignment = alignof(std::max_align_t)) noexcept
+	{
+	  return do_try_allocate(bytes, alignment);
+	}
+
+	//! Whether [p, p + size) lies within the resource's storage
+	virtual bool is_pointed_by(const void * p, size_type size = 0) const noexcept = 0;
+
+	//! Allocates bytes or more, to be deallocated with the size returned
+	allocation_result<void *, size_type> allocate_at_least(size_type bytes, size_type alignment = alignof(std::max_align_t))
+	{
+	  return do_allocate_at_least(bytes, alignment);
+	}
+
+	//! Resizes the allocation at p in place, false where unsupported or there is no room
+	bool try_expand(void * p, size_type old_size, size_type new_size) noexcept override
+	{
+	  return do_try_expand(p, old_size, new_size);
+	}
+
+	//! Drops all the allocations at once provided they sum up to bytes, i.e. the caller owns them all
+	bool release(size_type bytes) noexcept
+	{
+	  return do_release(bytes);
+	}
+
+      protected:
+	virtual bool do_release(size_type /*bytes*/) noexcept
+	{
+	  return false;
+	}
+
+	virtual allocation_result<void *, size_type> do_allocate_at_least(size_type bytes, size_type alignment)
+	{
+	  return {allocate(bytes, alignment), bytes};
+	}
+
+	virtual bool do_try_expand(void * /*p*/, size_type /*old_size*/, size_type /*new_size*/) noexcept
+	{
+	  return false;
+	}
+
+	virtual void * do_try_allocate(size_type bytes, size_type alignment) noexcept
+	{
+	  try
+	  {
+	    return allocate(bytes, alignment);
+	  }
+	  catch(...)
+	  {
+	    return nullptr;
+	  }
+	}
+
+	virtual void do_allocate_bulk(size_type bytes, size_type count, void ** out, size_type alignment)
+	{
+	  size_type i = 0;
+	  try
+	  {
+	    for (; i < count; ++i)
+	      out[i] = allocate(bytes, alignment);
+	  }
+	  catch(...)
+	  {
+	    do_deallocate_bulk(out, i, bytes, alignment);
+	    throw;
+	  }
+	}
+
+	virtual void do_deallocate_bulk(void * const * ptrs, size_type count, size_type bytes, size_type alignment)
+	{
+	  for (size_type i = 0; i < count; ++i)
+	    deallocate(ptrs[i], bytes, alignment);
+	}
+    };
+
+    //! Allocates count chunks from any resource, batched where the resource supports it
+    inline void allocate_bulk(std::pmr::memory_resource * resource, size_t bytes, size_t count, void ** out, size_t alignment)
+    {
+      if (auto block = dynamic_cast<memory_block_base *>(resource))
+      {
+	block->allocate_bulk(bytes, count, out, alignment);
+	return;
+      }
+
+      size_t i = 0;
+      try
+      {
+	for (; i < count; ++i)
+	  out[i] = resource->allocate(bytes, alignment);
+      }
+      catch(...)
+      {
+	while (i--)
+	  resource->deallocate(out[i], bytes, alignment);
+	throw;
+      }
+    }
+
+    //! Deallocates count chunks to any resource, batched where the resource supports it
+    inline void deallocate_bulk(std::pmr::memory_resource * resource, void * const * ptrs, size_t count, size_t bytes, size_t alignment)
+    {
+      if (auto block = dynamic_cast<memory_block_base *>(resource))
+      {
+	block->deallocate_bulk(ptrs, count, bytes, alignment);
+	return;
+      }
+
+      for (size_t i = 0; i < count; ++i)
+	resource->deallocate(ptrs[i], bytes, alignment);
+    }
+
+    /**
+     * @class memory_block
+     * @brief Contigious thread-safe memory resource of N times the first request size.
+     *
+     * Rewinds once all the space is deallocated, pages left idle for longer than
+     * the decay time may be returned to the OS by purge().
+     */
     template<size_t N>
-      class memory_block : public std::pmr::memory_resource
+      class memory_block : public memory_block_base
       {
 	public:
 	  using byte_type = std::byte;
 	  using size_type = size_t;
+	  using clock_type = std::chrono::steady_clock;
 
 	  virtual ~memory_block() override
 	  {
@@ -30,26 +184,39 @@ namespace nonstd
 	    std::cout << __PRETTY_FUNCTION__ << ": " << --count << std::endl;
 #endif
 	    std::lock_guard<std::mutex> lock(_mutex);
+	    if (_high_water)
+	      _tag->profile().record(_high_water);
 	    if (_storage)
+	    {
+	      NONSTD_ASAN_UNPOISON(_storage, static_cast<size_t>(_storage_end - _storage));
 	      _upstream->deallocate(const_cast<byte_type *>(_storage), static_cast<size_t>(_storage_end - _storage));
+	    }
 	  }
 
-	  memory_block(std::pmr::memory_resource * upstream = std::pmr::get_default_resource())
+	  memory_block(std::pmr::memory_resource * upstream = nonstd::pmr::get_default_resource())
 	    : _upstream(upstream)
 	  {}
 
-	  memory_block(size_type bytes, std::pmr::memory_resource * upstream = std::pmr::get_default_resource())
+	  //! Sized upon the first request at the tag's learned high-water mark, N times the request until there is one
+	  memory_block(adaptive_t, std::pmr::memory_resource * upstream = nonstd::pmr::get_default_resource())
 	    : _upstream(upstream)
-	    , _storage(static_cast<byte_type *>(upstream->allocate(N * bytes)))
-	    , _storage_end(_storage + N * bytes)
+	    , _adaptive(true)
+	  {}
+
+	  memory_block(size_type bytes, std::pmr::memory_resource * upstream = nonstd::pmr::get_default_resource())
+	    : _upstream(upstream)
+	    , _storage(static_cast<byte_type *>(upstream->allocate(details::asan_padded(N * bytes, bytes))))
+	    , _storage_end(_storage + details::asan_padded(N * bytes, bytes))
 	    , _end(_storage)
+	    , _dirty_end(_storage)
 	    {
 #ifdef MEMORY_BLOCK_TRACING
 	      std::cout << __PRETTY_FUNCTION__ << ": " << ++count << std::endl;
 #endif
+	      NONSTD_ASAN_POISON(_storage, static_cast<size_type>(_storage_end - _storage));
 	    }
 
-	  bool is_pointed_by(const void * p, size_type size = 0) const noexcept
+	  bool is_pointed_by(const void * p, size_type size = 0) const noexcept override
 	  {
 	    std::lock_guard<std::mutex> lock(_mutex);
 	    return (initialized()
@@ -74,41 +241,155 @@ namespace nonstd
 	    return _stored.load();
 	  }
 
+	  size_type capacity() const
+	  {
+	    std::lock_guard<std::mutex> lock(_mutex);
+	    return static_cast<size_type>(_storage_end - _storage);
+	  }
+
+	  //! Most bytes held, or asked for and refused, at once so far
+	  size_type high_water() const
+	  {
+	    std::lock_guard<std::mutex> lock(_mutex);
+	    return _high_water;
+	  }
+
+	  //! Tag charged for the allocations, current one upon construction
+	  allocation_tag& tag() const
+	  {
+	    return *_tag;
+	  }
+
+	  //! Sets the time an empty block stays resident, zero purges right upon emptying
+	  void set_decay(std::chrono::milliseconds decay)
+	  {
+	    std::lock_guard<std::mutex> lock(_mutex);
+	    _decay = decay;
+	  }
+
+	  std::chrono::milliseconds decay() const
+	  {
+	    std::lock_guard<std::mutex> lock(_mutex);
+	    return _decay;
+	  }
+
+	  //! Returns pages of an empty block idle for longer than decay to the OS
+	  size_type purge()
+	  {
+	    std::lock_guard<std::mutex> lock(_mutex);
+	    if (!initialized() || _stored.load() || clock_type::now() - _idle_since < _decay)
+	      return 0;
+	    return purge_pages();
+	  }
+
 	protected:
 
 	  void initialize(size_type bytes)
 	  {
-	    _storage = static_cast<byte_type *>(_upstream->allocate(N * bytes));
-	    _storage_end = _storage + N * bytes;
+	    // N chunks fit along with their redzones in ASan builds
+	    size_type size = details::asan_padded(N * bytes, bytes);
+	    if (_adaptive)
+	      size = std::max(bytes, details::asan_padded(_tag->profile().suggest(N * bytes), bytes));
+	    _storage = static_cast<byte_type *>(_upstream->allocate(size));
+	    _storage_end = _storage + size;
 	    _end = _storage;
+	    _dirty_end = _storage;
+	    NONSTD_ASAN_POISON(_storage, size);
 	  }
 
-	  void * do_allocate(size_type bytes, size_type alignment) override
+	  void * do_try_allocate(size_type bytes, size_type /*alignment*/) noexcept override
 	  {
 	    std::lock_guard<std::mutex> lock(_mutex);
 	    if (!initialized())
-	      initialize(bytes);
+	    {
+	      try
+	      {
+		initialize(bytes);
+	      }
+	      catch(...)
+	      {
+		return nullptr;
+	      }
+	    }
 
 	    void * p = nullptr;
 	    if (_end + bytes <= _storage_end)
 	    {
 	      p = _end;
-	      _end += bytes;
+	      bump(bytes);
 	      _stored += bytes;
+	      charge(bytes);
 #ifdef MEMORY_BLOCK_TRACING
 	      std::cout << __PRETTY_FUNCTION__ << ": allocated: " << bytes << std::endl;
 #endif
 	    }
-	    else 
+	    else
 	    {
+	      demand(bytes);
 #ifdef MEMORY_BLOCK_TRACING
 	      std::cerr << __PRETTY_FUNCTION__ << ": no room for: " << bytes << std::endl;
 #endif
-	      throw std::bad_alloc();
 	    }
 	    return p;
 	  }
 
+	  void * do_allocate(size_type bytes, size_type alignment) override
+	  {
+	    void * p = do_try_allocate(bytes, alignment);
+	    if (unlikely(!p))
+	      throw std::bad_alloc();
+	    return p;
+	  }
+
+	  //! Takes the lock once for the whole batch
+	  void do_allocate_bulk(size_type bytes, size_type count, void ** out, size_type /*alignment*/) override
+	  {
+	    std::lock_guard<std::mutex> lock(_mutex);
+	    if (!initialized())
+	      initialize(bytes);
+
+	    if (!count)
+	      return;
+	    // chunks are redzone apart in ASan builds
+	    const size_type stride = bytes + details::asan_redzone;
+	    const size_type span = stride * (count - 1) + bytes;
+	    if (unlikely(_end + span > _storage_end))
+	    {
+	      demand(bytes * count);
+	      throw std::bad_alloc();
+	    }
+
+	    byte_type * p = _end;
+	    bump(span);
+	    for (size_type i = 0; i < count; ++i)
+	    {
+	      out[i] = p + i * stride;
+	      if (details::asan_redzone)
+		NONSTD_ASAN_POISON(p + i * stride + bytes, details::asan_redzone);
+	    }
+	    _stored += bytes * count;
+	    charge(bytes * count, count);
+	  }
+
+	  //! Takes the lock once for the whole batch
+	  void do_deallocate_bulk(void * const * ptrs, size_type count, size_type bytes, size_type /*alignment*/) override
+	  {
+	    std::lock_guard<std::mutex> lock(_mutex);
+	    if (!initialized() || _stored.load() < bytes * count)
+	      throw std::invalid_argument("wrong pointer or size");
+
+	    for (size_type i = 0; i < count; ++i)
+	      if (!(_storage <= ptrs[i] && ptrs[i] < _end))
+		throw std::invalid_argument("wrong pointer or size");
+
+	    for (size_type i = 0; i < count; ++i)
+	      NONSTD_ASAN_POISON(ptrs[i], bytes);
+	    _stored -= bytes * count;
+	    _tag->credit(bytes * count);
+	    if (!_stored.load())
+	      rewind();
+	  }
+
 	  void do_deallocate(void * p, size_type size, size_type alignment) override
 	  {
 	    std::lock_guard<std::mutex> lock(_mutex);
@@ -117,7 +398,11 @@ namespace nonstd
 #ifdef MEMORY_BLOCK_TRACING
 	      std::cout << __PRETTY_FUNCTION__ << ": " << size << std::endl;
 #endif
+	      NONSTD_ASAN_POISON(p, size);
 	      _stored -= size;
+	      _tag->credit(size);
+	      if (!_stored.load())
+		rewind();
 	    }
 	    else
 	      throw std::invalid_argument("wrong pointer or size");
@@ -128,14 +413,138 @@ namespace nonstd
 	    return (this == &other);
 	  }
 
+	  //! Grants bytes, or the whole tail when it couldn't fit as many bytes again
+	  allocation_result<void *, size_type> do_allocate_at_least(size_type bytes, size_type /*alignment*/) override
+	  {
+	    std::lock_guard<std::mutex> lock(_mutex);
+	    if (!initialized())
+	      initialize(bytes);
+
+	    const size_type left = static_cast<size_type>(_storage_end - _end);
+	    if (unlikely(bytes > left))
+	    {
+	      demand(bytes);
+	      throw std::bad_alloc();
+	    }
+
+	    const size_type n = details::bump_grant(bytes, left);
+	    void * p = _end;
+	    bump(n);
+	    _stored += n;
+	    charge(n);
+	    return {p, n};
+	  }
+
+	  //! Only the most recent allocation can be resized
+	  bool do_try_expand(void * p, size_type old_size, size_type new_size) noexcept override
+	  {
+	    std::lock_guard<std::mutex> lock(_mutex);
+	    byte_type * top = static_cast<byte_type *>(p);
+	    if (!initialized() || !on_top(top, old_size) || _stored.load() < old_size
+		|| new_size > static_cast<size_type>(_storage_end - top))
+	      return false;
+
+	    if (new_size < old_size)
+	      NONSTD_ASAN_POISON(top + new_size, old_size - new_size);
+	    _end = top;
+	    bump(new_size);
+	    _stored += new_size;
+	    _stored -= old_size;
+	    if (new_size > old_size)
+	      charge(new_size - old_size, 0);
+	    else
+	      _tag->credit(old_size - new_size);
+	    return true;
+	  }
+
+	  bool do_release(size_type bytes) noexcept override
+	  {
+	    std::lock_guard<std::mutex> lock(_mutex);
+	    if (!initialized() || !bytes || _stored.load() != bytes)
+	      return false;
+	    _tag->credit(bytes);
+	    _stored = 0;
+	    rewind();
+	    return true;
+	  }
+
+	private:
+	  //! Hands out n bytes at _end, followed by a poisoned redzone in ASan builds
+	  void bump(size_type n)
+	  {
+	    NONSTD_ASAN_UNPOISON(_end, n);
+	    _end += n;
+	    const size_type tail = static_cast<size_type>(_storage_end - _end);
+	    _end += tail < details::asan_redzone ? tail : details::asan_redzone;
+	  }
+
+	  //! Whether the size bytes at top are the latest allocation
+	  bool on_top(const byte_type * top, size_type size) const
+	  {
+	    if (top < _storage || size > static_cast<size_type>(_storage_end - top))
+	      return false;
+	    const size_type tail = static_cast<size_type>(_storage_end - top) - size;
+	    return (_end == top + size + (tail < details::asan_redzone ? tail : details::asan_redzone));
+	  }
+
+	  void charge(size_type bytes, size_type count = 1)
+	  {
+	    _tag->charge(bytes, count);
+	    if (_stored.load() > _high_water)
+	      _high_water = _stored.load();
+	  }
+
+	  //! A refused allocation raises the high-water mark too, the next block makes room for it
+	  void demand(size_type bytes)
+	  {
+	    if (_stored.load() + bytes > _high_water)
+	      _high_water = _stored.load() + bytes;
+	  }
+
+	  static resource_usage usage(const void * self)
+	  {
+	    const memory_block& b = *static_cast<const memory_block *>(self);
+	    std::lock_guard<std::mutex> lock(b._mutex);
+	    const size_type capacity = static_cast<size_type>(b._storage_end - b._storage);
+	    const size_type touched = static_cast<size_type>(b._end - b._storage);
+	    const size_type used = b._stored.load();
+	    return {capacity, used, touched > used ? touched - used : 0};
+	  }
+
+	  //! Makes the whole space of an empty block available again
+	  void rewind()
+	  {
+	    if (_dirty_end < _end)
+	      _dirty_end = _end;
+	    NONSTD_ASAN_POISON(_storage, static_cast<size_type>(_storage_end - _storage));
+	    _end = _storage;
+	    _idle_since = clock_type::now();
+	    if (_decay.count() == 0)
+	      purge_pages();
+	  }
+
+	  size_type purge_pages()
+	  {
+	    const size_type purged = details::purge_pages(_storage, _dirty_end);
+	    _dirty_end = _storage;
+	    return purged;
+	  }
+
 	private:
 	  std::pmr::memory_resource * _upstream = nullptr;
 	  byte_type * _storage = nullptr;     //! block's beginning
 	  byte_type * _storage_end = nullptr; //! block's end
 	  byte_type * _end = nullptr;               //! end of space used at least once
+	  byte_type * _dirty_end = nullptr;         //! end of space touched since the last purge
 	  std::atomic<size_type> _stored{};
 	  std::atomic<size_type> _refcnt{1};
 	  mutable std::mutex _mutex{};
+	  clock_type::time_point _idle_since{};     //! last time the block became empty
+	  std::chrono::milliseconds _decay{std::chrono::seconds(10)}; //! idle time before purging
+	  allocation_tag * const _tag = &allocation_tag::current(); //! charged for every allocation
+	  size_type _high_water = 0;                //! most bytes held or asked for at once
+	  const bool _adaptive = false;             //! sized from the tag's profile
+	  resource_registry::entry _registration{"pmr::memory_block", this, &memory_block::usage}; //! kept last
 
 #ifdef MEMORY_BLOCK_TRACING
 	  static std::atomic_int count;
@@ -0,0 +1,233 @@
+#pragma once
+
+#include "per_thread.h"
+#include "pmr_default_resource.h"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if __cplusplus > 201402L
+#include <memory_resource>
+
+namespace nonstd
+{
+  namespace details
+  {
+    //! Leaves the released objects as they are
+    struct no_reset
+    {
+      template<typename T>
+	void operator()(T&) const noexcept
+	{}
+    };
+  } // details
+
+  namespace pmr
+  {
+    /**
+     * @class object_cache
+     * @brief Cache of constructed T in the style of the kernel's kmem_cache.
+     *
+     * Objects are default-constructed once per slot of a slab of slab_size
+     * of them, carved from the upstream resource (a memory_block typically),
+     * and handed out already initialised. release() runs the reset hook
+     * instead of destroying and constructing the object again, so whatever
+     * the constructor set up (say, preallocated buffers) is retained. Every
+     * object is destroyed along with the cache, none may be in use by then.
+     *
+     * Released objects go to a thread-local magazine first, a full magazine
+     * spills half of its objects to the shared depot and an empty one
+     * refills from it, growing the depot by a slab when it runs dry, so
+     * acquire() and release() take no lock most of the time. Magazines of
+     * the threads gone are kept for the next ones. Reset must not throw. A
+     * thread that can't get a magazine releases straight to the depot, which
+     * always has room for every object.
+     */
+    template<typename T, typename Reset = nonstd::details::no_reset>
+      class object_cache
+      {
+	public:
+	  using value_type = T;
+	  using size_type = std::size_t;
+
+	  static constexpr size_type magazine_size = 16;
+
+	  //! Hands the object back to the cache it came from
+	  struct releaser
+	  {
+	    void operator()(T * object) const noexcept
+	    {
+	      cache->release(object);
+	    }
+
+	    object_cache * cache;
+	  };
+
+	  using handle = std::unique_ptr<T, releaser>;
+
+	  explicit object_cache(size_type slab_size, Reset reset = Reset(), std::pmr::memory_resource * upstream = nonstd::pmr::get_default_resource())
+	    : _slab_size(slab_size ? slab_size : 1)
+	    , _reset(std::move(reset))
+	    , _upstream(upstream)
+	  {}
+
+	  object_cache(const object_cache&) = delete;
+	  object_cache& operator=(const object_cache&) = delete;
+
+	  ~object_cache()
+	  {
+	    for (const slab& s : _depot.slabs)
+	    {
+	      T * objects = static_cast<T *>(s.memory);
+	      for (size_type i = 0; i < s.count; ++i)
+		objects[i].~T();
+	      _upstream->deallocate(s.memory, _slab_size * sizeof(T), alignof(T));
+	    }
+	  }
+
+	  //! Constructed object, a new slab's first one when none is free
+	  T * acquire()
+	  {
+	    magazine& m = _magazines.local();
+	    if (!m.count)
+	      refill(m);
+	    return m.objects[--m.count];
+	  }
+
+	  //! Takes back an object of the cache after running the reset hook on it
+	  void release(T * object) noexcept
+	  {
+	    if (!object)
+	      return;
+
+	    _reset(*object);
+	    magazine * m = local_magazine();
+	    if (!m)
+	    {
+	      std::lock_guard<std::mutex> lock(_depot.mutex);
+	      _depot.objects.push_back(object);
+	      return;
+	    }
+	    if (m->count == magazine_size)
+	      flush(*m, magazine_size / 2);
+	    m->objects[m->count++] = object;
+	  }
+
+	  //! acquire() handing the object back upon destruction
+	  handle get()
+	  {
+	    return handle(acquire(), releaser{this});
+	  }
+
+	  size_type slab_size() const
+	  {
+	    return _slab_size;
+	  }
+
+	  //! Objects constructed so far, in use or not
+	  size_type capacity() const
+	  {
+	    std::lock_guard<std::mutex> lock(_depot.mutex);
+	    return _depot.slabs.size() * _slab_size;
+	  }
+
+	  //! Objects held by the shared depot
+	  size_type cached() const
+	  {
+	    std::lock_guard<std::mutex> lock(_depot.mutex);
+	    return _depot.objects.size();
+	  }
+
+	private:
+	  struct magazine
+	  {
+	    T * objects[magazine_size];
+	    size_type count = 0;
+	  };
+
+	  struct slab
+	  {
+	    void * memory;
+	    size_type count; //! objects constructed
+	  };
+
+	  struct depot
+	  {
+	    mutable std::mutex mutex;
+	    std::vector<T *> objects;
+	    std::vector<slab> slabs;
+	  };
+
+	  //! Calling thread's magazine, nullptr when claiming one runs out of memory
+	  magazine * local_magazine() noexcept
+	  {
+	    try
+	    {
+	      return &_magazines.local();
+	    }
+	    catch(...)
+	    {
+	      return nullptr;
+	    }
+	  }
+
+	  //! Takes up to half a magazine of objects from the depot, growing it by a slab when empty
+	  void refill(magazine& m)
+	  {
+	    std::lock_guard<std::mutex> lock(_depot.mutex);
+	    if (_depot.objects.empty())
+	      grow();
+	    while (m.count < magazine_size / 2 && !_depot.objects.empty())
+	    {
+	      m.objects[m.count++] = _depot.objects.back();
+	      _depot.objects.pop_back();
+	    }
+	  }
+
+	  //! Moves n objects to the depot
+	  void flush(magazine& m, size_type n) noexcept
+	  {
+	    std::lock_guard<std::mutex> lock(_depot.mutex);
+	    for (; n; --n)
+	      _depot.objects.push_back(m.objects[--m.count]);
+	  }
+
+	  //! Constructs a new slab of objects into the depot, which stays as it was should it throw
+	  void grow()
+	  {
+	    // room for every object, flush() never reallocates
+	    _depot.slabs.reserve(_depot.slabs.size() + 1);
+	    _depot.objects.reserve((_depot.slabs.size() + 1) * _slab_size);
+	    T * objects = static_cast<T *>(_upstream->allocate(_slab_size * sizeof(T), alignof(T)));
+	    size_type i = 0;
+	    try
+	    {
+	      for (; i < _slab_size; ++i)
+		::new (static_cast<void *>(objects + i)) T();
+	    }
+	    catch(...)
+	    {
+	      while (i)
+		objects[--i].~T();
+	      _upstream->deallocate(objects, _slab_size * sizeof(T), alignof(T));
+	      throw;
+	    }
+	    _depot.slabs.push_back(slab{objects, _slab_size});
+	    for (i = _slab_size; i; --i)
+	      _depot.objects.push_back(objects + i - 1);
+	  }
+
+	  const size_type _slab_size;
+	  Reset _reset;
+	  std::pmr::memory_resource * const _upstream;
+	  depot _depot;
+	  nonstd::details::per_thread<magazine> _magazines;
+      };
+  } // pmr
+} // nonstd
+
+#endif // __cplusplus > 201402L
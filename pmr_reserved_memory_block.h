@@ -0,0 +1,288 @@
+#pragma once
+
+#include "unlikely.h"
+#include "pmr_memory_block.h"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if __cplusplus > 201402L && (defined(__unix__) || defined(__APPLE__))
+#include <memory_resource>
+
+namespace nonstd
+{
+  namespace pmr
+  {
+    /**
+     * @class reserved_memory_block
+     * @brief Contigious memory block reserving its whole range upfront and committing it on demand.
+     *
+     * The address range is mapped inaccessible on construction and made
+     * accessible granule by granule as the allocations advance, so the block
+     * grows in place and never moves. All but the first granule are decommitted
+     * once the block is emptied. In ASan builds the committed space is poisoned
+     * but for the chunks handed out.
+     */
+    class reserved_memory_block : public memory_block_base
+    {
+      public:
+	using byte_type = std::byte;
+
+	static constexpr size_type default_granularity = 64 * 1024;
+
+	explicit reserved_memory_block(size_type reserve, size_type granularity = default_granularity)
+	  : _granularity(round_up(granularity ? granularity : 1, page_size()))
+	{
+	  const size_type bytes = round_up(reserve, _granularity);
+	  void * p = mmap(nullptr, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	  if (p == MAP_FAILED)
+	    throw std::bad_alloc();
+
+	  // the registry may already be asking for the usage
+	  std::lock_guard<std::mutex> lock(_mutex);
+	  _storage = static_cast<byte_type *>(p);
+	  _storage_end = _storage + bytes;
+	  _end = _storage;
+	  _committed = _storage;
+	  _peak_committed = _storage;
+	}
+
+	reserved_memory_block(const reserved_memory_block&) = delete;
+	reserved_memory_block& operator=(const reserved_memory_block&) = delete;
+
+	virtual ~reserved_memory_block() override
+	{
+	  NONSTD_ASAN_UNPOISON(_storage, static_cast<size_type>(_committed - _storage));
+	  munmap(_storage, static_cast<size_type>(_storage_end - _storage));
+	}
+
+	bool is_pointed_by(const void * p, size_type size = 0) const noexcept override
+	{
+	  return ((_storage <= reinterpret_cast<const byte_type *>(p))
+	      && (reinterpret_cast<const byte_type *>(p) < _storage_end)
+	      && (size == 0 || reinterpret_cast<const byte_type *>(p) + size <= _storage_end)
+	      );
+	}
+
+	bool empty() const
+	{
+	  return (_stored.load() == 0);
+	}
+
+	size_type size() const
+	{
+	  return _stored.load();
+	}
+
+	//! Bytes of address space reserved
+	size_type reserved() const
+	{
+	  return static_cast<size_type>(_storage_end - _storage);
+	}
+
+	//! Bytes of address space currently accessible
+	size_type committed() const
+	{
+	  std::lock_guard<std::mutex> lock(_mutex);
+	  return static_cast<size_type>(_committed - _storage);
+	}
+
+	//! Holds off every other user of the block, e.g. across a fork()
+	void lock() const
+	{
+	  _mutex.lock();
+	}
+
+	void unlock() const
+	{
+	  _mutex.unlock();
+	}
+
+	//! Most bytes of address space accessible at once
+	size_type peak_committed() const
+	{
+	  std::lock_guard<std::mutex> lock(_mutex);
+	  return static_cast<size_type>(_peak_committed - _storage);
+	}
+
+      protected:
+	void * do_try_allocate(size_type bytes, size_type alignment) noexcept override
+	{
+	  std::lock_guard<std::mutex> lock(_mutex);
+	  byte_type * p = align(_end, alignment);
+	  if (unlikely(p + bytes > _storage_end || p + bytes < p))
+	    return nullptr;
+	  if (p + bytes > _committed && !commit(p + bytes))
+	    return nullptr;
+
+	  NONSTD_ASAN_UNPOISON(p, bytes);
+	  _end = p + bytes;
+	  _stored += bytes;
+	  return p;
+	}
+
+	void * do_allocate(size_type bytes, size_type alignment) override
+	{
+	  void * p = do_try_allocate(bytes, alignment);
+	  if (unlikely(!p))
+	    throw std::bad_alloc();
+	  return p;
+	}
+
+	//! Commits and hands out the whole batch under a single lock
+	void do_allocate_bulk(size_type bytes, size_type count, void ** out, size_type alignment) override
+	{
+	  byte_type * p = static_cast<byte_type *>(do_try_allocate(bytes * count, alignment));
+	  if (unlikely(!p))
+	    throw std::bad_alloc();
+	  for (size_type i = 0; i < count; ++i)
+	    out[i] = p + i * bytes;
+	}
+
+	void do_deallocate(void * p, size_type size, size_type /*alignment*/) override
+	{
+	  std::lock_guard<std::mutex> lock(_mutex);
+	  if (!(_storage <= p && p < _end) || _stored.load() < size)
+	    throw std::invalid_argument("wrong pointer or size");
+
+	  NONSTD_ASAN_POISON(p, size);
+	  _stored -= size;
+	  if (!_stored.load())
+	    rewind();
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+	  return (this == &other);
+	}
+
+	//! Grants bytes padded to the alignment, or the whole reserved tail when it couldn't fit as many again
+	allocation_result<void *, size_type> do_allocate_at_least(size_type bytes, size_type alignment) override
+	{
+	  std::lock_guard<std::mutex> lock(_mutex);
+	  byte_type * p = align(_end, alignment);
+	  const size_type left = p < _storage_end ? static_cast<size_type>(_storage_end - p) : 0;
+	  if (unlikely(bytes > left))
+	    throw std::bad_alloc();
+
+	  const size_type padded = (bytes + alignment - 1) / alignment * alignment;
+	  const size_type n = details::bump_grant(padded < left ? padded : left, left);
+	  if (p + n > _committed && !commit(p + n))
+	    throw std::bad_alloc();
+
+	  NONSTD_ASAN_UNPOISON(p, n);
+	  _end = p + n;
+	  _stored += n;
+	  return {p, n};
+	}
+
+	//! Only the most recent allocation can be resized, committing more pages as needed
+	bool do_try_expand(void * p, size_type old_size, size_type new_size) noexcept override
+	{
+	  std::lock_guard<std::mutex> lock(_mutex);
+	  byte_type * top = static_cast<byte_type *>(p);
+	  if (top + old_size != _end || _stored.load() < old_size
+	      || top < _storage || new_size > static_cast<size_type>(_storage_end - top))
+	    return false;
+	  if (top + new_size > _committed && !commit(top + new_size))
+	    return false;
+
+	  if (new_size < old_size)
+	    NONSTD_ASAN_POISON(top + new_size, old_size - new_size);
+	  else
+	    NONSTD_ASAN_UNPOISON(top + old_size, new_size - old_size);
+	  _end = top + new_size;
+	  _stored += new_size;
+	  _stored -= old_size;
+	  return true;
+	}
+
+	bool do_release(size_type bytes) noexcept override
+	{
+	  std::lock_guard<std::mutex> lock(_mutex);
+	  if (!bytes || _stored.load() != bytes)
+	    return false;
+	  _stored = 0;
+	  rewind();
+	  return true;
+	}
+
+      private:
+	static resource_usage usage(const void * self)
+	{
+	  const reserved_memory_block& b = *static_cast<const reserved_memory_block *>(self);
+	  std::lock_guard<std::mutex> lock(b._mutex);
+	  const size_type touched = static_cast<size_type>(b._end - b._storage);
+	  const size_type used = b._stored.load();
+	  return {static_cast<size_type>(b._committed - b._storage), used, touched > used ? touched - used : 0};
+	}
+
+	static size_type page_size()
+	{
+	  static const size_type page = static_cast<size_type>(sysconf(_SC_PAGESIZE));
+	  return page;
+	}
+
+	static size_type round_up(size_type n, size_type granularity)
+	{
+	  return (n + granularity - 1) / granularity * granularity;
+	}
+
+	static byte_type * align(byte_type * p, size_type alignment)
+	{
+	  const std::uintptr_t a = alignment ? alignment : 1;
+	  return reinterpret_cast<byte_type *>((reinterpret_cast<std::uintptr_t>(p) + a - 1) / a * a);
+	}
+
+	//! Makes the range up to end accessible, granule by granule
+	bool commit(byte_type * end)
+	{
+	  byte_type * committed = _storage + round_up(static_cast<size_type>(end - _storage), _granularity);
+	  if (committed > _storage_end)
+	    committed = _storage_end;
+	  if (mprotect(_committed, static_cast<size_type>(committed - _committed), PROT_READ | PROT_WRITE))
+	    return false;
+	  NONSTD_ASAN_POISON(_committed, static_cast<size_type>(committed - _committed));
+	  _committed = committed;
+	  if (_committed > _peak_committed)
+	    _peak_committed = _committed;
+	  return true;
+	}
+
+	//! Returns all but the first granule to the OS and makes it inaccessible again
+	void rewind()
+	{
+	  _end = _storage;
+	  byte_type * retained = _storage + _granularity;
+	  NONSTD_ASAN_POISON(_storage, static_cast<size_type>((_committed < retained ? _committed : retained) - _storage));
+	  if (_committed > retained)
+	  {
+	    const size_type bytes = static_cast<size_type>(_committed - retained);
+	    NONSTD_ASAN_UNPOISON(retained, bytes);
+	    madvise(retained, bytes, MADV_DONTNEED);
+	    mprotect(retained, bytes, PROT_NONE);
+	    _committed = retained;
+	  }
+	}
+
+	const size_type _granularity;
+	byte_type * _storage = nullptr;     //! reserved range's beginning
+	byte_type * _storage_end = nullptr; //! reserved range's end
+	byte_type * _end = nullptr;         //! end of space in use
+	byte_type * _committed = nullptr;   //! end of accessible space
+	byte_type * _peak_committed = nullptr; //! furthest _committed has been
+	std::atomic<size_type> _stored{};
+	mutable std::mutex _mutex{};
+	resource_registry::entry _registration{"pmr::reserved_memory_block", this, &reserved_memory_block::usage}; //! kept last
+    };
+  } // pmr
+} // nonstd
+
+#endif // __cplusplus > 201402L && POSIX
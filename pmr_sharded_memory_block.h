@@ -0,0 +1,255 @@
+#pragma once
+
+#include "unlikely.h"
+#include "pmr_memory_block.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#if __cplusplus > 201402L
+#include <memory_resource>
+
+namespace nonstd
+{
+  namespace pmr
+  {
+    /**
+     * @class sharded_memory_block
+     * @brief Per-CPU set of contigious bump shards of N times the chunk size each.
+     *
+     * Every thread allocates from the shard of the CPU it runs on, picked by
+     * sched_getcpu() (which glibc serves from the rseq area where registered),
+     * and falls back to the other shards once its own is full. The shards are
+     * carved out of a single upstream allocation so the ownership check is a
+     * single range compare, each shard's state lives on its own cache line.
+     */
+    template<size_t N>
+      class sharded_memory_block : public memory_block_base
+      {
+	public:
+	  using byte_type = std::byte;
+	  using size_type = size_t;
+
+	  static constexpr size_type cache_line_size = 64;
+
+	  virtual ~sharded_memory_block() override
+	  {
+	    NONSTD_ASAN_UNPOISON(_storage, _shard_bytes * _shard_count);
+	    _upstream->deallocate(_storage, _shard_bytes * _shard_count, cache_line_size);
+	  }
+
+	  sharded_memory_block(
+	      size_type bytes
+	      , size_type shards = std::thread::hardware_concurrency()
+	      , std::pmr::memory_resource * upstream = nonstd::pmr::get_default_resource()
+	      )
+	    : _upstream(upstream)
+	    , _shard_count(shards ? shards : 1)
+	    , _shard_bytes((N * bytes + cache_line_size - 1) / cache_line_size * cache_line_size)
+	    , _shards(new shard[_shard_count])
+	  {
+	    _storage = static_cast<byte_type *>(_upstream->allocate(_shard_bytes * _shard_count, cache_line_size));
+	    _storage_end = _storage + _shard_bytes * _shard_count;
+	    NONSTD_ASAN_POISON(_storage, _shard_bytes * _shard_count);
+	    for (size_type i = 0; i < _shard_count; ++i)
+	      _shards[i].initialize(_storage + i * _shard_bytes, _shard_bytes);
+	  }
+
+	  sharded_memory_block(const sharded_memory_block&) = delete;
+	  sharded_memory_block& operator=(const sharded_memory_block&) = delete;
+
+	  bool is_pointed_by(const void * p, size_type size = 0) const noexcept override
+	  {
+	    return ((_storage <= reinterpret_cast<const byte_type *>(p))
+		&& (reinterpret_cast<const byte_type *>(p) < _storage_end)
+		&& (size == 0 || reinterpret_cast<const byte_type *>(p) + size <= _storage_end)
+		);
+	  }
+
+	  bool empty() const
+	  {
+	    return (size() == 0);
+	  }
+
+	  size_type size() const
+	  {
+	    size_type stored = 0;
+	    for (size_type i = 0; i < _shard_count; ++i)
+	      stored += _shards[i]._stored.load(std::memory_order_relaxed);
+	    return stored;
+	  }
+
+	  size_type shards() const
+	  {
+	    return _shard_count;
+	  }
+
+	  //! Shard the calling thread allocates from first
+	  size_type current_shard() const
+	  {
+#if defined(__linux__)
+	    const int cpu = sched_getcpu();
+	    if (cpu >= 0)
+	      return static_cast<size_type>(cpu) % _shard_count;
+#endif
+	    static thread_local const size_type hashed = std::hash<std::thread::id>{}(std::this_thread::get_id());
+	    return hashed % _shard_count;
+	  }
+
+	protected:
+
+	  void * do_try_allocate(size_type bytes, size_type alignment) noexcept override
+	  {
+	    const size_type first = current_shard();
+	    for (size_type i = 0; i < _shard_count; ++i)
+	    {
+	      void * p = _shards[(first + i) % _shard_count].allocate(bytes, 1, alignment);
+	      if (p)
+		return p;
+	    }
+	    return nullptr;
+	  }
+
+	  void * do_allocate(size_type bytes, size_type alignment) override
+	  {
+	    void * p = do_try_allocate(bytes, alignment);
+	    if (unlikely(!p))
+	      throw std::bad_alloc();
+	    return p;
+	  }
+
+	  void do_deallocate(void * p, size_type size, size_type /*alignment*/) override
+	  {
+	    if (unlikely(!is_pointed_by(p, size)))
+	      throw std::invalid_argument("wrong pointer or size");
+	    owner(p).deallocate(p, size, 1);
+	  }
+
+	  //! Takes a single shard lock for the whole batch
+	  void do_allocate_bulk(size_type bytes, size_type count, void ** out, size_type alignment) override
+	  {
+	    if (!count)
+	      return;
+	    const size_type first = current_shard();
+	    for (size_type i = 0; i < _shard_count; ++i)
+	    {
+	      byte_type * p = static_cast<byte_type *>(_shards[(first + i) % _shard_count].allocate(bytes, count, alignment));
+	      if (p)
+	      {
+		for (size_type j = 0; j < count; ++j)
+		  out[j] = p + j * stride(bytes, alignment);
+		return;
+	      }
+	    }
+	    throw std::bad_alloc();
+	  }
+
+	  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	  {
+	    return (this == &other);
+	  }
+
+	private:
+	  struct alignas(cache_line_size) shard
+	  {
+	    void initialize(byte_type * storage, size_type bytes)
+	    {
+	      std::lock_guard<std::mutex> lock(_mutex);
+	      _storage = storage;
+	      _storage_end = storage + bytes;
+	      _end = storage;
+	    }
+
+	    //! count chunks of bytes each, stride() apart from the first one aligned on alignment
+	    void * allocate(size_type bytes, size_type count, size_type alignment)
+	    {
+	      const size_type n = stride(bytes, alignment) * (count - 1) + bytes;
+	      std::lock_guard<std::mutex> lock(_mutex);
+	      byte_type * p = align(_end, alignment);
+	      if (p > _storage_end || n > static_cast<size_type>(_storage_end - p))
+		return nullptr;
+	      NONSTD_ASAN_UNPOISON(p, n);
+	      _end = p + n;
+	      _stored.fetch_add(bytes * count, std::memory_order_relaxed);
+	      return p;
+	    }
+
+	    void deallocate(void * p, size_type bytes, size_type count)
+	    {
+	      const size_type n = bytes * count;
+	      std::lock_guard<std::mutex> lock(_mutex);
+	      if (!(_storage <= p && p < _end) || _stored.load(std::memory_order_relaxed) < n)
+		throw std::invalid_argument("wrong pointer or size");
+	      NONSTD_ASAN_POISON(p, n);
+	      if (_stored.fetch_sub(n, std::memory_order_relaxed) == n)
+		_end = _storage;
+	    }
+
+	    resource_usage usage()
+	    {
+	      std::lock_guard<std::mutex> lock(_mutex);
+	      const size_type touched = static_cast<size_type>(_end - _storage);
+	      const size_type used = _stored.load(std::memory_order_relaxed);
+	      return {static_cast<size_type>(_storage_end - _storage), used, touched > used ? touched - used : 0};
+	    }
+
+	    std::mutex _mutex{};
+	    byte_type * _storage = nullptr;
+	    byte_type * _storage_end = nullptr;
+	    byte_type * _end = nullptr;
+	    std::atomic<size_type> _stored{};
+	  };
+
+	  static byte_type * align(byte_type * p, size_type alignment)
+	  {
+	    const std::uintptr_t a = alignment ? alignment : 1;
+	    return reinterpret_cast<byte_type *>((reinterpret_cast<std::uintptr_t>(p) + a - 1) / a * a);
+	  }
+
+	  //! Distance between the chunks of a batch, each aligned as the first one
+	  static size_type stride(size_type bytes, size_type alignment)
+	  {
+	    const size_type a = alignment ? alignment : 1;
+	    return (bytes + a - 1) / a * a;
+	  }
+
+	  static resource_usage usage(const void * self)
+	  {
+	    const sharded_memory_block& b = *static_cast<const sharded_memory_block *>(self);
+	    resource_usage total{0, 0, 0};
+	    for (size_type i = 0; i < b._shard_count; ++i)
+	    {
+	      const resource_usage u = b._shards[i].usage();
+	      total.capacity += u.capacity;
+	      total.used += u.used;
+	      total.dead += u.dead;
+	    }
+	    return total;
+	  }
+
+	  shard& owner(const void * p) const
+	  {
+	    return _shards[static_cast<size_type>(reinterpret_cast<const byte_type *>(p) - _storage) / _shard_bytes];
+	  }
+
+	  std::pmr::memory_resource * _upstream = nullptr;
+	  const size_type _shard_count = 1;
+	  const size_type _shard_bytes = 0;
+	  std::unique_ptr<shard[]> _shards;
+	  byte_type * _storage = nullptr;     //! first shard's beginning
+	  byte_type * _storage_end = nullptr; //! last shard's end
+	  resource_registry::entry _registration{"pmr::sharded_memory_block", this, &sharded_memory_block::usage}; //! kept last
+      };
+
+  } // pmr
+} // nonstd
+
+#endif // __cplusplus > 201402L
@@ -0,0 +1,242 @@
+#pragma once
+
+#include "per_thread.h"
+#include "pmr_default_resource.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if __cplusplus > 201402L
+#include <memory_resource>
+
+namespace nonstd
+{
+  namespace pmr
+  {
+    //! Traced operation, the file stores them in the native byte order after trace_magic
+    struct trace_event
+    {
+      enum kind_type : std::uint8_t { allocate = 0, deallocate = 1 };
+
+      std::uint64_t timestamp; //! nanoseconds since the trace began
+      std::uint64_t address;   //! identifies the chunk within the trace
+      std::uint64_t size;
+      std::uint32_t thread;    //! small sequential thread number
+      std::uint16_t alignment;
+      kind_type kind;
+      std::uint8_t reserved;
+    };
+
+    static_assert(sizeof(trace_event) == 32, "trace_event must stay compact");
+
+    constexpr char trace_magic[8] = {'N', 'S', 'T', 'D', 'T', 'R', 'C', '1'};
+
+    //! Loads a whole trace file written by tracing_resource
+    inline std::vector<trace_event> read_trace(const std::string& path)
+    {
+      std::FILE * file = std::fopen(path.c_str(), "rb");
+      if (!file)
+	throw std::runtime_error("can't open trace " + path);
+
+      char magic[sizeof(trace_magic)];
+      if (std::fread(magic, sizeof(magic), 1, file) != 1 || std::memcmp(magic, trace_magic, sizeof(magic)))
+      {
+	std::fclose(file);
+	throw std::runtime_error("not a trace file " + path);
+      }
+
+      std::vector<trace_event> events;
+      trace_event buffer[1024];
+      for (size_t n; (n = std::fread(buffer, sizeof(trace_event), 1024, file)); )
+	events.insert(events.end(), buffer, buffer + n);
+      std::fclose(file);
+      return events;
+    }
+
+    /**
+     * @class tracing_resource
+     * @brief Memory resource adapter recording every allocation and deallocation to a file.
+     *
+     * The events land in a lock-free single-producer ring of the calling thread,
+     * a background writer drains the rings to the file every millisecond or so.
+     * A thread finding its ring full wakes the writer and yields for a while,
+     * then drops the event rather than stalling any longer, see dropped().
+     * Deallocations are recorded before they reach the upstream so a chunk's
+     * reuse never precedes its release in the timestamp order.
+     */
+    class tracing_resource : public std::pmr::memory_resource
+    {
+      public:
+	using size_type = size_t;
+
+	//! Events buffered per thread
+	static constexpr size_type ring_size = 16384;
+
+	//! Yields a thread waits for the writer to make room in its ring
+	static constexpr unsigned max_stall = 1024;
+
+	explicit tracing_resource(const std::string& path, std::pmr::memory_resource * upstream = nonstd::pmr::get_default_resource())
+	  : _upstream(upstream)
+	  , _file(std::fopen(path.c_str(), "wb"))
+	  , _start(clock_type::now())
+	{
+	  if (!_file)
+	    throw std::runtime_error("can't open trace " + path);
+	  std::fwrite(trace_magic, sizeof(trace_magic), 1, _file);
+	  _writer = std::thread([this]() { write(); });
+	}
+
+	tracing_resource(const tracing_resource&) = delete;
+	tracing_resource& operator=(const tracing_resource&) = delete;
+
+	//! No thread may use the resource by now
+	~tracing_resource() override
+	{
+	  {
+	    std::lock_guard<std::mutex> lock(_mutex);
+	    _stop = true;
+	  }
+	  _wake.notify_one();
+	  _writer.join();
+	  flush();
+	  std::fclose(_file);
+	}
+
+	std::pmr::memory_resource * upstream() const
+	{
+	  return _upstream;
+	}
+
+	//! Events lost to full rings
+	std::uint64_t dropped() const
+	{
+	  return _dropped.load(std::memory_order_relaxed);
+	}
+
+	//! Writes out the events buffered so far
+	void flush()
+	{
+	  std::lock_guard<std::mutex> lock(_drain_mutex);
+	  _rings.for_each([this](ring& r) { r.drain(_file); });
+	  std::fflush(_file);
+	}
+
+      protected:
+	void * do_allocate(size_type bytes, size_type alignment) override
+	{
+	  void * p = _upstream->allocate(bytes, alignment);
+	  record(trace_event::allocate, p, bytes, alignment);
+	  return p;
+	}
+
+	void do_deallocate(void * p, size_type bytes, size_type alignment) override
+	{
+	  record(trace_event::deallocate, p, bytes, alignment);
+	  _upstream->deallocate(p, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+	  return (this == &other);
+	}
+
+      private:
+	using clock_type = std::chrono::steady_clock;
+
+	//! Single-producer single-consumer ring of a thread's events
+	struct ring
+	{
+	  bool push(const trace_event& e)
+	  {
+	    const std::uint64_t tail = _tail.load(std::memory_order_relaxed);
+	    if (tail - _head.load(std::memory_order_acquire) == ring_size)
+	      return false;
+	    _events[tail % ring_size] = e;
+	    _tail.store(tail + 1, std::memory_order_release);
+	    return true;
+	  }
+
+	  void drain(std::FILE * file)
+	  {
+	    std::uint64_t head = _head.load(std::memory_order_relaxed);
+	    const std::uint64_t tail = _tail.load(std::memory_order_acquire);
+	    while (head != tail)
+	    {
+	      const std::uint64_t first = head % ring_size;
+	      const std::uint64_t n = (tail - head < ring_size - first) ? tail - head : ring_size - first;
+	      std::fwrite(&_events[first], sizeof(trace_event), n, file);
+	      head += n;
+	    }
+	    _head.store(head, std::memory_order_release);
+	  }
+
+	  trace_event _events[ring_size];
+	  std::atomic<std::uint64_t> _head{0};
+	  std::atomic<std::uint64_t> _tail{0};
+	};
+
+	void record(trace_event::kind_type kind, const void * p, size_type bytes, size_type alignment)
+	{
+	  trace_event e{};
+	  e.timestamp = static_cast<std::uint64_t>(
+	      std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - _start).count()
+	      );
+	  e.address = reinterpret_cast<std::uintptr_t>(p);
+	  e.size = bytes;
+	  e.thread = thread_number();
+	  e.alignment = static_cast<std::uint16_t>(alignment);
+	  e.kind = kind;
+	  ring& r = _rings.local();
+	  for (unsigned stall = 0; !r.push(e); ++stall)
+	  {
+	    if (stall == max_stall)
+	    {
+	      _dropped.fetch_add(1, std::memory_order_relaxed);
+	      return;
+	    }
+	    _wake.notify_one();
+	    std::this_thread::yield();
+	  }
+	}
+
+	void write()
+	{
+	  std::unique_lock<std::mutex> lock(_mutex);
+	  while (!_stop)
+	  {
+	    _wake.wait_for(lock, std::chrono::milliseconds(1));
+	    flush();
+	  }
+	}
+
+	static std::uint32_t thread_number()
+	{
+	  static std::atomic<std::uint32_t> count{0};
+	  static thread_local const std::uint32_t number = count++;
+	  return number;
+	}
+
+	std::pmr::memory_resource * const _upstream;
+	std::FILE * const _file;
+	const clock_type::time_point _start;
+	nonstd::details::per_thread<ring> _rings;
+	std::atomic<std::uint64_t> _dropped{0};
+	std::mutex _drain_mutex;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	bool _stop = false;
+	std::thread _writer;
+    };
+  } // pmr
+} // nonstd
+
+#endif // __cplusplus > 201402L
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace nonstd
+{
+  namespace details
+  {
+    /**
+     * Returns the whole pages lying within [begin, end) to the OS.
+     *
+     * The range content is lost, the pages are faulted in again on the next touch.
+     * Returns the number of bytes released (zero where madvise isn't available).
+     */
+    inline std::size_t purge_pages(void * begin, void * end) noexcept
+    {
+#ifdef MADV_DONTNEED
+      static const std::uintptr_t page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+      const std::uintptr_t first = (reinterpret_cast<std::uintptr_t>(begin) + page - 1) & ~(page - 1);
+      const std::uintptr_t last = reinterpret_cast<std::uintptr_t>(end) & ~(page - 1);
+      if (first < last && !madvise(reinterpret_cast<void *>(first), last - first, MADV_DONTNEED))
+	return static_cast<std::size_t>(last - first);
+#else
+      (void)begin;
+      (void)end;
+#endif
+      return 0;
+    }
+  } // details
+} // nonstd
@@ -0,0 +1,242 @@
+#include "pmr_tracing_resource.h"
+#include "pmr_memory_block.h"
+#include "pmr_fallback_resource.h"
+#include "pmr_sharded_memory_block.h"
+#include "pmr_reserved_memory_block.h"
+#include "pmr_humble_allocator.h"
+#include "benchmark.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <memory_resource>
+
+// Replays a trace recorded by nonstd::pmr::tracing_resource against the
+// resources of the project, single-threaded in the timestamp order. Reports the
+// replay time, the peak memory each resource took from its upstream and the
+// fragmentation, i.e. the share of that peak not holding live chunks. The
+// resources mapping or allocating their memory on their own add their peak
+// footprint to what they took from the upstream.
+
+namespace
+{
+  //! Upstream of the resources under test keeping track of what they hold
+  class counting_resource : public std::pmr::memory_resource
+  {
+    public:
+      size_t peak() const
+      {
+	return _peak;
+      }
+
+    protected:
+      void * do_allocate(size_t bytes, size_t alignment) override
+      {
+	void * p = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	_current += bytes;
+	_peak = std::max(_peak, _current);
+	return p;
+      }
+
+      void do_deallocate(void * p, size_t bytes, size_t alignment) override
+      {
+	std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+	_current -= bytes;
+      }
+
+      bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+      {
+	return (this == &other);
+      }
+
+    private:
+      size_t _current = 0;
+      size_t _peak = 0;
+  };
+
+  /**
+   * Memory resource over a humble allocator of max_align_t units, spilling to
+   * the upstream once the humble's block is full or for stricter alignments.
+   */
+  class humble_resource : public std::pmr::memory_resource
+  {
+    public:
+      using unit = std::max_align_t;
+      using humble = nonstd::pmr::humble<unit, 1 << 16>;
+
+      explicit humble_resource(std::pmr::memory_resource * upstream)
+	: _upstream(upstream)
+      {
+	_humble.prepare();
+      }
+
+      //! Bytes of the humble's block
+      size_t capacity() const
+      {
+	return _humble.storage_ ? _humble.storage_->capacity() : 0;
+      }
+
+    protected:
+      void * do_allocate(size_t bytes, size_t alignment) override
+      {
+	if (alignment <= alignof(unit))
+	  if (void * p = _humble.try_allocate(units(bytes)))
+	    return p;
+	return _upstream->allocate(bytes, alignment);
+      }
+
+      void do_deallocate(void * p, size_t bytes, size_t alignment) override
+      {
+	if (_humble.storage_ && _humble.storage_->is_pointed_by(p))
+	  _humble.deallocate(static_cast<unit *>(p), units(bytes));
+	else
+	  _upstream->deallocate(p, bytes, alignment);
+      }
+
+      bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+      {
+	return (this == &other);
+      }
+
+    private:
+      static size_t units(size_t bytes)
+      {
+	return bytes ? (bytes + sizeof(unit) - 1) / sizeof(unit) : 1;
+      }
+
+      humble _humble;
+      std::pmr::memory_resource * _upstream;
+  };
+
+  //! Resource under test built on the given upstream, kept alive by the holder
+  struct candidate
+  {
+    const char * name;
+    std::function<std::pmr::memory_resource *(counting_resource&, std::vector<std::shared_ptr<void>>&)> make;
+    //! Peak bytes the resource got other than from the upstream, none if empty
+    std::function<size_t(std::pmr::memory_resource *)> footprint = {};
+  };
+
+  template<typename Resource, typename... Args>
+    Resource * hold(std::vector<std::shared_ptr<void>>& holder, Args&&... args)
+    {
+      auto r = std::make_shared<Resource>(std::forward<Args>(args)...);
+      holder.push_back(r);
+      return r.get();
+    }
+
+  const std::vector<candidate> candidates =
+  {
+    {"new_delete", [](counting_resource& upstream, auto&) -> std::pmr::memory_resource * { return &upstream; }},
+    {"unsync_pool", [](counting_resource& upstream, auto& holder) -> std::pmr::memory_resource *
+      { return hold<std::pmr::unsynchronized_pool_resource>(holder, &upstream); }},
+    {"sync_pool", [](counting_resource& upstream, auto& holder) -> std::pmr::memory_resource *
+      { return hold<std::pmr::synchronized_pool_resource>(holder, &upstream); }},
+    {"monotonic", [](counting_resource& upstream, auto& holder) -> std::pmr::memory_resource *
+      { return hold<std::pmr::monotonic_buffer_resource>(holder, &upstream); }},
+    {"memory_block", [](counting_resource& upstream, auto& holder) -> std::pmr::memory_resource *
+      {
+	auto block = hold<nonstd::pmr::memory_block<1024>>(holder, &upstream);
+	return hold<nonstd::pmr::fallback_resource>(holder, block, &upstream);
+      }},
+    {"sharded_block", [](counting_resource& upstream, auto& holder) -> std::pmr::memory_resource *
+      {
+	auto block = hold<nonstd::pmr::sharded_memory_block<1024>>(holder, size_t{256}, std::thread::hardware_concurrency(), &upstream);
+	return hold<nonstd::pmr::fallback_resource>(holder, block, &upstream);
+      }},
+    {"reserved_block", [](counting_resource& upstream, auto& holder) -> std::pmr::memory_resource *
+      {
+	auto block = hold<nonstd::pmr::reserved_memory_block>(holder, size_t{1} << 30);
+	return hold<nonstd::pmr::fallback_resource>(holder, block, &upstream);
+      }
+      , [](std::pmr::memory_resource * resource) -> size_t
+      {
+	auto fallback = static_cast<nonstd::pmr::fallback_resource *>(resource);
+	return static_cast<nonstd::pmr::reserved_memory_block *>(fallback->primary())->peak_committed();
+      }},
+    {"humble", [](counting_resource& upstream, auto& holder) -> std::pmr::memory_resource *
+      { return hold<humble_resource>(holder, &upstream); }
+      , [](std::pmr::memory_resource * resource) -> size_t
+      { return static_cast<humble_resource *>(resource)->capacity(); }},
+  };
+
+  struct live_chunk
+  {
+    void * p;
+    size_t size;
+    size_t alignment;
+  };
+}
+
+int main(int argc, char ** argv)
+{
+  if (argc != 2)
+  {
+    std::cerr << "usage: " << argv[0] << " <trace file>\n";
+    return 1;
+  }
+
+  std::vector<nonstd::pmr::trace_event> events = nonstd::pmr::read_trace(argv[1]);
+  std::stable_sort(events.begin(), events.end(), [](const auto& a, const auto& b) { return a.timestamp < b.timestamp; });
+
+  // the live bytes are a property of the trace alone
+  size_t live = 0, peak_live = 0, allocations = 0, unmatched = 0;
+  {
+    std::unordered_map<std::uint64_t, std::uint64_t> sizes;
+    for (const auto& e : events)
+      if (e.kind == nonstd::pmr::trace_event::allocate)
+      {
+	sizes[e.address] = e.size;
+	live += e.size;
+	peak_live = std::max(peak_live, live);
+	++allocations;
+      }
+      else if (sizes.erase(e.address))
+	live -= e.size;
+      else
+	++unmatched;
+  }
+
+  std::cout << events.size() << " events, " << allocations << " allocations, "
+    << unmatched << " unmatched deallocations, peak live " << peak_live << " bytes\n";
+  std::cout << "resource          time ms    peak bytes   fragmentation\n";
+
+  for (const auto& c : candidates)
+  {
+    counting_resource upstream;
+    std::vector<std::shared_ptr<void>> holder;
+    std::pmr::memory_resource * resource = c.make(upstream, holder);
+    std::unordered_map<std::uint64_t, live_chunk> chunks;
+    chunks.reserve(allocations);
+
+    const auto start = nonstd::bench::clock_type::now();
+    for (const auto& e : events)
+      if (e.kind == nonstd::pmr::trace_event::allocate)
+	chunks[e.address] = live_chunk{resource->allocate(e.size, e.alignment), e.size, e.alignment};
+      else
+      {
+	auto found = chunks.find(e.address);
+	if (found == chunks.end())
+	  continue;
+	resource->deallocate(found->second.p, found->second.size, found->second.alignment);
+	chunks.erase(found);
+      }
+    for (const auto& chunk : chunks)
+      resource->deallocate(chunk.second.p, chunk.second.size, chunk.second.alignment);
+    const double seconds = std::chrono::duration<double>(nonstd::bench::clock_type::now() - start).count();
+
+    const size_t peak = upstream.peak() + (c.footprint ? c.footprint(resource) : 0);
+    std::cout << std::left << std::setw(16) << c.name << std::right
+      << std::fixed << std::setprecision(2) << std::setw(9) << seconds * 1e3
+      << std::setw(14) << peak
+      << std::setw(15) << (peak ? 100.0 * (1.0 - static_cast<double>(peak_live) / static_cast<double>(peak)) : 0.0) << "%\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace nonstd
+{
+  //! Figures a registered resource reports about itself
+  struct resource_usage
+  {
+    std::size_t capacity; //! bytes the resource holds
+    std::size_t used;     //! bytes handed out and not returned yet
+    std::size_t dead;     //! bytes returned but not reusable until the resource rewinds
+  };
+
+  //! Point-in-time view of a live resource
+  struct resource_stats
+  {
+    const char * kind;
+    const void * address;
+    resource_usage usage;
+    std::chrono::steady_clock::duration age;
+  };
+
+  /**
+   * @class resource_registry
+   * @brief Process-wide list of the live memory blocks and resources.
+   *
+   * A resource registers by holding an entry as its last member. The entry
+   * links before the constructor's body runs and unlinks after the
+   * destructor's body is done, so snapshot() may meet a resource still being
+   * built or torn down. The usage function must therefore only read fields the
+   * resource sets under its own lock, or before its entry. The list is
+   * intrusive and touched once per construction and destruction.
+   */
+  class resource_registry
+  {
+    public:
+      using clock_type = std::chrono::steady_clock;
+      using usage_function = resource_usage (*)(const void * resource);
+
+      class entry
+      {
+	public:
+	  entry(const char * kind, const void * resource, usage_function usage)
+	    : _kind(kind)
+	    , _resource(resource)
+	    , _usage(usage)
+	    , _created(clock_type::now())
+	  {
+	    instance().link(this);
+	  }
+
+	  entry(const entry&) = delete;
+	  entry& operator=(const entry&) = delete;
+
+	  ~entry()
+	  {
+	    instance().unlink(this);
+	  }
+
+	private:
+	  friend class resource_registry;
+
+	  const char * const _kind;
+	  const void * const _resource;
+	  const usage_function _usage;
+	  const clock_type::time_point _created;
+	  entry * _prev = nullptr;
+	  entry * _next = nullptr;
+      };
+
+      //! Usage of every live resource, most recently registered first
+      static std::vector<resource_stats> snapshot()
+      {
+	resource_registry& r = instance();
+	std::vector<resource_stats> stats;
+	const auto now = clock_type::now();
+	std::lock_guard<std::mutex> lock(r._mutex);
+	stats.reserve(r._count);
+	for (const entry * e = r._head; e; e = e->_next)
+	  stats.push_back(resource_stats{e->_kind, e->_resource, e->_usage(e->_resource), now - e->_created});
+	return stats;
+      }
+
+      //! Live resources
+      static std::size_t count()
+      {
+	resource_registry& r = instance();
+	std::lock_guard<std::mutex> lock(r._mutex);
+	return r._count;
+      }
+
+    private:
+      resource_registry() = default;
+
+      //! Never destroyed so resources outliving the static destruction still unregister,
+      //! and never malloc'ed so the malloc shim's own block may register as well
+      static resource_registry& instance()
+      {
+	alignas(resource_registry) static unsigned char storage[sizeof(resource_registry)];
+	static resource_registry& r = *new(storage) resource_registry;
+	return r;
+      }
+
+      void link(entry * e)
+      {
+	std::lock_guard<std::mutex> lock(_mutex);
+	e->_next = _head;
+	if (_head)
+	  _head->_prev = e;
+	_head = e;
+	++_count;
+      }
+
+      void unlink(entry * e)
+      {
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (e->_prev)
+	  e->_prev->_next = e->_next;
+	else
+	  _head = e->_next;
+	if (e->_next)
+	  e->_next->_prev = e->_prev;
+	--_count;
+      }
+
+      std::mutex _mutex;
+      entry * _head = nullptr;
+      std::size_t _count = 0;
+  };
+} // nonstd
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "resource_registry.h"
+#include "allocation_tag.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nonstd
+{
+  namespace details
+  {
+    //! Label value with the backslashes, double quotes and line feeds escaped
+    inline std::string prometheus_label(const std::string& value)
+    {
+      std::string escaped;
+      escaped.reserve(value.size());
+      for (const char c : value)
+	switch (c)
+	{
+	  case '\\': escaped += "\\\\"; break;
+	  case '"': escaped += "\\\""; break;
+	  case '\n': escaped += "\\n"; break;
+	  default: escaped += c;
+	}
+      return escaped;
+    }
+  } // details
+
+  /**
+   * Writes the snapshot in the Prometheus text exposition format, one series per
+   * kind summing its resources (the age is the oldest one's). A resource's
+   * address is an unbounded label, per_resource series are only for debugging.
+   */
+  inline void write_prometheus(std::ostream& out, const std::vector<resource_stats>& stats, bool per_resource = false)
+  {
+    struct total
+    {
+      std::size_t count = 0;
+      resource_stats sum{};
+    };
+    std::map<std::string, total> kinds;
+    for (const auto& s : stats)
+    {
+      total& t = kinds[s.kind];
+      ++t.count;
+      t.sum.kind = s.kind;
+      t.sum.usage.capacity += s.usage.capacity;
+      t.sum.usage.used += s.usage.used;
+      t.sum.usage.dead += s.usage.dead;
+      if (s.age > t.sum.age)
+	t.sum.age = s.age;
+    }
+
+    out << "# HELP nonstd_resources Live resources by kind.\n"
+	<< "# TYPE nonstd_resources gauge\n";
+    for (const auto& k : kinds)
+      out << "nonstd_resources{kind=\"" << details::prometheus_label(k.first) << "\"} " << k.second.count << '\n';
+
+    struct metric
+    {
+      const char * name;
+      const char * help;
+      double (*value)(const resource_stats&);
+    };
+    const metric metrics[] =
+    {
+      {"nonstd_resource_capacity_bytes", "Bytes the resource holds.",
+	[](const resource_stats& s) { return static_cast<double>(s.usage.capacity); }},
+      {"nonstd_resource_used_bytes", "Bytes handed out and not returned yet.",
+	[](const resource_stats& s) { return static_cast<double>(s.usage.used); }},
+      {"nonstd_resource_dead_bytes", "Bytes returned but not reusable until the resource rewinds.",
+	[](const resource_stats& s) { return static_cast<double>(s.usage.dead); }},
+      {"nonstd_resource_age_seconds", "Time since the resource was constructed.",
+	[](const resource_stats& s) { return std::chrono::duration<double>(s.age).count(); }},
+    };
+    // byte counts stay exact up to 2^53
+    const auto precision = out.precision(17);
+    for (const auto& m : metrics)
+    {
+      out << "# HELP " << m.name << ' ' << m.help << '\n'
+	  << "# TYPE " << m.name << " gauge\n";
+      if (per_resource)
+	for (const auto& s : stats)
+	  out << m.name << "{kind=\"" << details::prometheus_label(s.kind) << "\",resource=\"" << s.address << "\"} " << m.value(s) << '\n';
+      else
+	for (const auto& k : kinds)
+	  out << m.name << "{kind=\"" << details::prometheus_label(k.first) << "\"} " << m.value(k.second.sum) << '\n';
+    }
+    out.precision(precision);
+  }
+
+  //! Writes the tags' counters in the Prometheus text exposition format
+  inline void write_prometheus(std::ostream& out, const std::vector<tag_stats>& stats)
+  {
+    out << "# HELP nonstd_tag_bytes Live bytes charged to the tag.\n"
+	<< "# TYPE nonstd_tag_bytes gauge\n";
+    for (const auto& s : stats)
+      out << "nonstd_tag_bytes{tag=\"" << details::prometheus_label(s.name) << "\"} " << s.bytes << '\n';
+    out << "# HELP nonstd_tag_peak_bytes Most live bytes charged to the tag at once.\n"
+	<< "# TYPE nonstd_tag_peak_bytes gauge\n";
+    for (const auto& s : stats)
+      out << "nonstd_tag_peak_bytes{tag=\"" << details::prometheus_label(s.name) << "\"} " << s.peak << '\n';
+    out << "# HELP nonstd_tag_allocations_total Allocations charged to the tag.\n"
+	<< "# TYPE nonstd_tag_allocations_total counter\n";
+    for (const auto& s : stats)
+      out << "nonstd_tag_allocations_total{tag=\"" << details::prometheus_label(s.name) << "\"} " << s.count << '\n';
+  }
+
+  /**
+   * @class stats_exporter
+   * @brief Background thread dumping the registry and the tags to a file every interval.
+   *
+   * Each dump goes to a temporary file renamed over the target, so a scraper
+   * never reads a partial one. The last dump happens upon destruction. The
+   * resources are summed by kind unless per_resource is set.
+   */
+  class stats_exporter
+  {
+    public:
+      explicit stats_exporter(const std::string& path, std::chrono::milliseconds interval = std::chrono::seconds(10), bool per_resource = false)
+	: _path(path)
+	, _interval(interval)
+	, _per_resource(per_resource)
+      {
+	_writer = std::thread([this]() { run(); });
+      }
+
+      stats_exporter(const stats_exporter&) = delete;
+      stats_exporter& operator=(const stats_exporter&) = delete;
+
+      ~stats_exporter()
+      {
+	{
+	  std::lock_guard<std::mutex> lock(_mutex);
+	  _stop = true;
+	}
+	_wake.notify_one();
+	_writer.join();
+	export_now();
+      }
+
+      //! Dumps the registry and the tags right away, false if the file can't be written
+      bool export_now() const
+      {
+	const std::string temporary = _path + ".tmp";
+	{
+	  std::ofstream out(temporary, std::ios::trunc);
+	  write_prometheus(out, resource_registry::snapshot(), _per_resource);
+	  write_prometheus(out, allocation_tag::report());
+	  if (!out.flush())
+	    return false;
+	}
+	return std::rename(temporary.c_str(), _path.c_str()) == 0;
+      }
+
+    private:
+      void run()
+      {
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (!_wake.wait_for(lock, _interval, [this]() { return _stop; }))
+	  export_now();
+      }
+
+      const std::string _path;
+      const std::chrono::milliseconds _interval;
+      const bool _per_resource;
+      std::mutex _mutex;
+      std::condition_variable _wake;
+      bool _stop = false;
+      std::thread _writer;
+  };
+} // nonstd
@@ -0,0 +1,111 @@
+#include "pmr_memory_block.h"
+#include "legacy_memory_block.h"
+#include "pmr_humble_allocator.h"
+#include "compact_list.h"
+#include "list.h"
+
+#include <cstddef>
+
+#define BOOST_TEST_MODULE test_asan_redzones
+
+#include <boost/test/unit_test.hpp>
+
+// Built with the default redzone, unlike the layout-exact suites, so in ASan
+// builds the blocks leave a poisoned gap after every chunk. The expectations
+// are written in terms of asan_redzone and hold in plain builds as well.
+
+using nonstd::details::asan_enabled;
+using nonstd::details::asan_redzone;
+using nonstd::details::asan_padded;
+using nonstd::details::asan_poisoned;
+
+BOOST_AUTO_TEST_SUITE(test_suite_redzones)
+
+  BOOST_AUTO_TEST_CASE(test_pmr_block_leaves_poisoned_redzones)
+  {
+    nonstd::pmr::memory_block<4> b(64);
+    BOOST_CHECK(b.capacity() == asan_padded(4 * 64, 64));
+    char * p[4];
+    for (auto& q : p)
+      q = static_cast<char *>(b.allocate(64));
+    for (int i = 0; i < 3; ++i)
+    {
+      BOOST_CHECK(p[i + 1] - p[i] == static_cast<std::ptrdiff_t>(64 + asan_redzone));
+      BOOST_CHECK(!asan_poisoned(p[i] + 63));
+      BOOST_CHECK(asan_poisoned(p[i] + 64) == asan_enabled);
+    }
+    // the padding fits N chunks, not one more
+    BOOST_CHECK(b.try_allocate(64) == nullptr);
+    for (auto& q : p)
+      b.deallocate(q, 64);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_pmr_block_expands_across_the_redzone)
+  {
+    nonstd::pmr::memory_block<4> b(64);
+    char * p = static_cast<char *>(b.allocate(64));
+    const std::size_t grown = 64 + asan_redzone + 8;
+    BOOST_REQUIRE(b.try_expand(p, 64, grown));
+    BOOST_CHECK(!asan_poisoned(p + 64));
+    BOOST_CHECK(!asan_poisoned(p + grown - 1));
+    BOOST_CHECK(asan_poisoned(p + grown) == asan_enabled);
+    char * q = static_cast<char *>(b.allocate(16));
+    BOOST_CHECK(q == p + grown + asan_redzone);
+    // p isn't on top any more
+    BOOST_CHECK(!b.try_expand(p, grown, grown + 8));
+
+    BOOST_REQUIRE(b.try_expand(q, 16, 8));
+    BOOST_CHECK(asan_poisoned(q + 8) == asan_enabled);
+    char * r = static_cast<char *>(b.allocate(8));
+    BOOST_CHECK(r == q + 8 + asan_redzone);
+    b.deallocate(r, 8);
+    b.deallocate(q, 8);
+    b.deallocate(p, grown);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_pmr_block_bulk_strides_over_redzones)
+  {
+    nonstd::pmr::memory_block<8> b(32);
+    void * out[8];
+    b.allocate_bulk(32, 8, out);
+    for (int i = 0; i < 7; ++i)
+    {
+      BOOST_CHECK(static_cast<char *>(out[i + 1]) - static_cast<char *>(out[i]) == static_cast<std::ptrdiff_t>(32 + asan_redzone));
+      BOOST_CHECK(asan_poisoned(static_cast<char *>(out[i]) + 32) == asan_enabled);
+    }
+    BOOST_CHECK(!asan_poisoned(static_cast<char *>(out[7]) + 31));
+    b.deallocate_bulk(out, 8, 32);
+    BOOST_CHECK(asan_poisoned(out[0]) == asan_enabled);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_legacy_block_redzones)
+  {
+    nonstd::legacy::memory_block b(asan_padded(4 * 16, 16));
+    char * p[4];
+    BOOST_REQUIRE(b.allocate_bulk(16, 4, p));
+    for (int i = 0; i < 3; ++i)
+    {
+      BOOST_CHECK(p[i + 1] - p[i] == static_cast<std::ptrdiff_t>(16 + asan_redzone));
+      BOOST_CHECK(asan_poisoned(p[i] + 16) == asan_enabled);
+    }
+    BOOST_CHECK(b.allocate(16) == nullptr);
+    BOOST_CHECK(b.try_expand(p[3], 16, 8));
+    BOOST_CHECK(asan_poisoned(p[3] + 8) == asan_enabled);
+    BOOST_CHECK(b.deallocate(p[3], 8));
+    BOOST_CHECK(b.deallocate_bulk(p, 3, 16));
+  }
+
+  BOOST_AUTO_TEST_CASE(test_padded_containers_fit_n_nodes)
+  {
+    nonstd::compact_list<int, 8> c;
+    for (int i = 0; i < 8; ++i)
+      c.push_back(i);
+    BOOST_CHECK_THROW(c.push_back(8), std::bad_alloc);
+
+    nonstd::list<int, nonstd::pmr::humble<int, 8>> l;
+    for (int i = 0; i < 8; ++i)
+      l.push_back(int(i));
+    BOOST_CHECK(l.size() == 8);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,10 +1,26 @@
 #include "legacy_humble_allocator.h"
 #include "list.h"
+#include "concurrent_list.h"
+#include "compact_list.h"
+#include "vector.h"
+#include "btree_map.h"
+#include "flat_hash_map.h"
 
 #include <list>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <string>
 #include <functional>
+#include <cstring>
+#include <numeric>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <random>
+
+#include <sys/wait.h>
+#include <unistd.h>
 
 #define BOOST_TEST_MODULE test_main
 
@@ -168,6 +184,703 @@ BOOST_AUTO_TEST_SUITE(test_suite_main)
     BOOST_CHECK(it->num == 3);
   }
 
+  BOOST_AUTO_TEST_CASE(test_memory_block_rewinds_when_emptied)
+  {
+    nonstd::legacy::memory_block b(64);
+    void * p1 = b.allocate(32);
+    void * p2 = b.allocate(32);
+    BOOST_CHECK(b.allocate(1) == nullptr);
+    BOOST_CHECK(b.deallocate(p1, 32));
+    BOOST_CHECK(b.deallocate(p2, 32));
+    BOOST_CHECK(b.empty());
+    BOOST_CHECK(b.allocate(64) == p1);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_memory_block_purges_idle_pages)
+  {
+    constexpr size_t size = 1 << 20;
+    nonstd::legacy::memory_block b(size);
+    b.set_decay(std::chrono::hours(1));
+    void * p = b.allocate(size);
+    std::memset(p, 1, size);
+    BOOST_CHECK(b.purge() == 0);
+    BOOST_CHECK(b.deallocate(p, size));
+    BOOST_CHECK(b.purge() == 0);
+    b.set_decay(std::chrono::milliseconds(0));
+    BOOST_CHECK(b.purge() > 0);
+    BOOST_CHECK(b.purge() == 0);
+    BOOST_CHECK(b.allocate(size) == p);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_memory_block_bulk_allocation)
+  {
+    nonstd::legacy::memory_block b(64);
+    int * p[4] = {};
+    BOOST_CHECK(!b.allocate_bulk(sizeof(int), 17, p));
+    BOOST_CHECK(b.allocate_bulk(sizeof(int), 4, p));
+    BOOST_CHECK(b.size() == 4 * sizeof(int));
+    BOOST_CHECK(p[1] == p[0] + 1 && p[3] == p[0] + 3);
+    BOOST_CHECK(b.deallocate_bulk(p, 4, sizeof(int)));
+    BOOST_CHECK(b.empty());
+    BOOST_CHECK(!b.deallocate_bulk(p, 4, sizeof(int)));
+  }
+
+  BOOST_AUTO_TEST_CASE(test_in_nonstd_list_of_ints_bulk_range)
+  {
+    std::vector<int> v(200);
+    std::iota(v.begin(), v.end(), 0);
+    nonstd::list<int, alloc<int, 200>> l1(v.begin(), v.end());
+    nonstd::list<int, alloc<int, 200>> l2(l1);
+    BOOST_CHECK(l1.size() == 200);
+    BOOST_CHECK(l2.size() == 200);
+    BOOST_CHECK(std::equal(v.begin(), v.end(), l1.begin(), l1.end()));
+    BOOST_CHECK(std::equal(v.begin(), v.end(), l2.begin(), l2.end()));
+  }
+
+  BOOST_AUTO_TEST_CASE(test_in_nonstd_list_of_ints_moving_with_std_allocator)
+  {
+    nonstd::list<int> empty;
+    nonstd::list<int> l(empty);
+    BOOST_CHECK(l.empty());
+    nonstd::list<int> l1{0,1,2,3,4,5,6,7,8,9};
+    nonstd::list<int> l2(std::move(l1));
+    BOOST_CHECK(l1.empty());
+    BOOST_CHECK(l2.size() == 10);
+    l2.push_back(10);
+    BOOST_CHECK(l2.back() == 10);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_nonstd_list_push_and_pop_front)
+  {
+    nonstd::list<int, alloc<int, 10>> l{1,2};
+    l.push_front(0);
+    BOOST_CHECK(l.front() == 0);
+    BOOST_CHECK(l.size() == 3);
+    l.pop_front();
+    l.pop_front();
+    BOOST_CHECK(l.front() == 2);
+    BOOST_CHECK(l.back() == 2);
+    l.pop_front();
+    BOOST_CHECK(l.empty());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_nonstd_list_sort_is_stable)
+  {
+    using value = std::pair<int, int>;
+    std::mt19937 random(7);
+    std::vector<value> v;
+    for (int i = 0; i < 1000; ++i)
+      v.emplace_back(static_cast<int>(random() % 20), i);
+    // the block is full: sorting, reversing and merging may not allocate
+    nonstd::list<value, alloc<value, 1000>> l(v.begin(), v.end());
+    auto by_key = [](const value& lhs, const value& rhs) { return lhs.first < rhs.first; };
+    l.sort(by_key);
+    std::stable_sort(v.begin(), v.end(), by_key);
+    BOOST_CHECK(l.size() == 1000);
+    BOOST_CHECK(std::equal(v.begin(), v.end(), l.begin(), l.end()));
+    l.reverse();
+    BOOST_CHECK(std::equal(v.rbegin(), v.rend(), l.begin(), l.end()));
+    l.sort();
+    std::sort(v.begin(), v.end());
+    BOOST_CHECK(std::equal(v.begin(), v.end(), l.begin(), l.end()));
+    BOOST_CHECK_THROW(l.push_front(value{}), std::bad_alloc);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_nonstd_list_merge_and_unique)
+  {
+    using value = std::pair<int, int>;
+    auto by_key = [](const value& lhs, const value& rhs) { return lhs.first < rhs.first; };
+    nonstd::list<value> l1{{0, 1}, {2, 1}, {2, 2}, {5, 1}};
+    nonstd::list<value> l2{{1, 2}, {2, 3}, {6, 2}, {7, 2}};
+    const value * relinked = &l2.back();
+    l1.merge(l2, by_key);
+    std::vector<value> merged{{0, 1}, {1, 2}, {2, 1}, {2, 2}, {2, 3}, {5, 1}, {6, 2}, {7, 2}};
+    BOOST_CHECK(l2.empty());
+    BOOST_CHECK(&l1.back() == relinked);
+    BOOST_CHECK(std::equal(merged.begin(), merged.end(), l1.begin(), l1.end()));
+    BOOST_CHECK(l1.unique([](const value& lhs, const value& rhs) { return lhs.first == rhs.first; }) == 2);
+    BOOST_CHECK(l1.size() == 6);
+    merged.erase(merged.begin() + 3, merged.begin() + 5);
+    BOOST_CHECK(std::equal(merged.begin(), merged.end(), l1.begin(), l1.end()));
+
+    // distinct humble blocks: the values move over instead of the nodes
+    nonstd::list<int, alloc<int, 20>> h1{1, 1, 3, 5, 5};
+    nonstd::list<int, alloc<int, 20>> h2{0, 1, 4, 9};
+    h1.merge(std::move(h2));
+    BOOST_CHECK(h2.empty());
+    BOOST_CHECK((h1 == nonstd::list<int, alloc<int, 20>>{0, 1, 1, 1, 3, 4, 5, 5, 9}));
+    BOOST_CHECK(h1.unique() == 3);
+    BOOST_CHECK((h1 == nonstd::list<int, alloc<int, 20>>{0, 1, 3, 4, 5, 9}));
+    h1.reverse();
+    BOOST_CHECK(h1.front() == 9 && h1.back() == 0);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_nonstd_list_reuses_spare_nodes)
+  {
+    auto churn = [](auto& l)
+      {
+        for (int i = 1; i < 1000; ++i)
+        {
+          l.push_back(int(i));
+          l.pop_front();
+        }
+      };
+    // no spare nodes, no room taken for them
+    static_assert(sizeof(nonstd::list<int, alloc<int, 10>>) == sizeof(alloc<int, 10>) + sizeof(nonstd::list_details::header), "");
+    static_assert(sizeof(nonstd::list<int, alloc<int, 10>, 2>) == sizeof(nonstd::list<int, alloc<int, 10>>) + sizeof(nonstd::list_details::spare_chain), "");
+
+    // the bump block can't reuse a node popped while others live
+    nonstd::list<int, alloc<int, 4>> drained{0};
+    BOOST_CHECK_THROW(churn(drained), std::bad_alloc);
+
+    nonstd::list<int, alloc<int, 4>, 2> l{0};
+    churn(l);
+    BOOST_CHECK(l.size() == 1 && l.front() == 999);
+    BOOST_CHECK(l.spare_size() == 1);
+    l.pop_front();
+    l.pop_front();
+    BOOST_CHECK(l.spare_size() == 2 && l.spare_limit() == 2);
+    l.push_back(1);
+    l.push_back(2);
+    l.push_back(3);
+    BOOST_CHECK(l.spare_size() == 0 && l.size() == 3);
+    l.pop_front();
+    l.shrink_spare();
+    BOOST_CHECK(l.spare_size() == 0);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_concurrent_list_erase)
+  {
+    nonstd::concurrent_list<int, alloc<int, 10>> l;
+    for (int i = 0; i < 5; ++i)
+      l.push_front(i);
+    BOOST_CHECK(l.erase(2));
+    BOOST_CHECK(!l.erase(2));
+    BOOST_CHECK(!l.contains(2));
+    BOOST_CHECK(l.contains(4) && l.contains(0));
+    BOOST_CHECK(l.size() == 4);
+
+    std::vector<int> values;
+    l.for_each([&values](int v) { values.push_back(v); });
+    BOOST_CHECK((values == std::vector<int>{4,3,1,0}));
+
+    int v = -1;
+    BOOST_CHECK(l.try_pop_front(v) && v == 4);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_concurrent_list_producers_and_consumers)
+  {
+    constexpr int threads = 4;
+    constexpr int values = 2000;
+    nonstd::concurrent_list<int, alloc<int, threads * values + 1>> l;
+    std::atomic<long> pushed{0};
+    std::atomic<long> popped{0};
+    std::atomic<int> count{0};
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t)
+    {
+      pool.emplace_back([&, t]()
+          {
+            for (int i = 1; i <= values; ++i)
+            {
+              l.push_front(t * values + i);
+              pushed += t * values + i;
+            }
+          });
+      pool.emplace_back([&]()
+          {
+            int v = 0;
+            while (count.load() < threads * values)
+              if (l.try_pop_front(v))
+              {
+                popped += v;
+                ++count;
+              }
+          });
+    }
+    for (auto& t : pool)
+      t.join();
+
+    BOOST_CHECK(l.empty());
+    BOOST_CHECK(pushed.load() == popped.load());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_compact_node_halves_the_node)
+  {
+    static_assert(sizeof(nonstd::list_details::compact_node<int>) == 2 * sizeof(int), "");
+    BOOST_CHECK(2 * sizeof(nonstd::list_details::compact_node<int>) <= sizeof(nonstd::list_details::node<int>));
+  }
+
+  BOOST_AUTO_TEST_CASE(test_compact_list_of_ints)
+  {
+    nonstd::compact_list<int, 10> l1{1,2,3};
+    l1.push_front(0);
+    l1.emplace_back(4);
+    BOOST_CHECK(l1.size() == 5);
+    BOOST_CHECK(l1.front() == 0 && l1.back() == 4);
+
+    nonstd::compact_list<int, 10> l2(l1);
+    BOOST_CHECK(l1 == l2);
+    nonstd::compact_list<int, 10> l3(std::move(l2));
+    BOOST_CHECK(l1 == l3);
+    BOOST_CHECK(l2.empty());
+
+    std::vector<int> v{0,1,2,3,4};
+    BOOST_CHECK(std::equal(v.begin(), v.end(), l3.begin(), l3.end()));
+
+    while (!l3.empty())
+      l3.pop_front();
+    for (int i = 0; i < 10; ++i)
+      l3.push_back(i);
+    BOOST_CHECK_THROW(l3.push_back(10), std::bad_alloc);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_compact_list_moved_from_stays_usable)
+  {
+    nonstd::compact_list<int, 4> l1{1,2,3,4};
+    nonstd::compact_list<int, 4> l2(std::move(l1));
+    BOOST_CHECK(l1.empty() && l2.size() == 4);
+    for (int i = 0; i < 4; ++i)
+      l1.push_back(i);
+    BOOST_CHECK((l1 == nonstd::compact_list<int, 4>{0,1,2,3}));
+    BOOST_CHECK_THROW(l1.emplace_front(4), std::bad_alloc);
+    l2 = std::move(l1);
+    BOOST_CHECK(l1.empty() && l2.front() == 0);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_humble_try_allocate)
+  {
+    alloc<int, 4> a;
+    BOOST_CHECK(a.try_allocate(3) != nullptr);
+    BOOST_CHECK(a.try_allocate(2) == nullptr);
+    BOOST_CHECK(a.try_allocate(1) != nullptr);
+    BOOST_CHECK_THROW(a.allocate(1), std::bad_alloc);
+    using extensions = nonstd::allocator_extensions<alloc<int, 4>>;
+    BOOST_CHECK(extensions::try_allocate(a, 1) == nullptr);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_humble_prepare)
+  {
+    using extensions = nonstd::allocator_extensions<alloc<int, 4>>;
+    alloc<int, 4> a;
+    BOOST_CHECK(a.storage_ == nullptr);
+    BOOST_CHECK(extensions::prepare(a));
+    BOOST_CHECK(a.storage_ != nullptr && a.size() == 0);
+    BOOST_CHECK(a.try_allocate(4) != nullptr);
+    std::allocator<int> s;
+    BOOST_CHECK(nonstd::allocator_extensions<std::allocator<int>>::prepare(s));
+  }
+
+  BOOST_AUTO_TEST_CASE(test_humble_release)
+  {
+    alloc<int, 4> a;
+    (void)a.allocate(3);
+    (void)a.allocate(1);
+    using extensions = nonstd::allocator_extensions<alloc<int, 4>>;
+    BOOST_CHECK(extensions::release(a));
+    BOOST_CHECK(a.size() == 0);
+    BOOST_CHECK(a.try_allocate(4) != nullptr);
+
+    std::allocator<int> s;
+    BOOST_CHECK(!nonstd::allocator_extensions<std::allocator<int>>::release(s));
+  }
+
+  BOOST_AUTO_TEST_CASE(test_in_nonstd_list_of_ints_winking_out)
+  {
+    nonstd::list<int, alloc<int, 10>> l{0,1,2,3,4,5,6,7,8,9};
+    l = nonstd::list<int, alloc<int, 10>>{};
+    BOOST_CHECK(l.empty());
+    for (int i = 0; i < 10; ++i)
+      l.emplace_back(i);
+    BOOST_CHECK(l.size() == 10 && l.back() == 9);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_humble_try_expand)
+  {
+    alloc<int, 8> a;
+    int * p = a.allocate(2);
+    BOOST_CHECK(a.try_expand(p, 2, 4));
+    BOOST_CHECK(a.size() == 4 * sizeof(int));
+    BOOST_CHECK(!a.try_expand(p, 4, 9));
+    int * q = a.allocate(1);
+    BOOST_CHECK(!a.try_expand(p, 4, 5));
+    BOOST_CHECK(a.try_expand(q, 1, 4));
+    BOOST_CHECK(a.size() == 8 * sizeof(int));
+  }
+
+  BOOST_AUTO_TEST_CASE(test_in_nonstd_vector_of_ints_growing_in_place)
+  {
+    // relocating growth would need 1 + 2 + ... + 128 ints
+    nonstd::vector<int, alloc<int, 128>> v;
+    v.push_back(0);
+    const int * data = v.data();
+    for (int i = 1; i < 128; ++i)
+      v.push_back(i);
+    BOOST_CHECK(v.data() == data);
+    BOOST_CHECK(v.size() == 128 && v.capacity() == 128);
+    BOOST_CHECK(v.back() == 127 && v[64] == 64);
+    BOOST_CHECK_THROW(v.push_back(128), std::bad_alloc);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_in_nonstd_vector_of_strings_relocating)
+  {
+    nonstd::vector<std::string> v{"a", "b"};
+    for (int i = 0; i < 100; ++i)
+      v.emplace_back(v[0]);
+    BOOST_CHECK(v.size() == 102 && v.back() == "a");
+    nonstd::vector<std::string> v2(v);
+    BOOST_CHECK(v2 == v);
+    v.resize(1);
+    v.shrink_to_fit();
+    BOOST_CHECK(v.size() == 1 && v.capacity() >= 1);
+    v2 = std::move(v);
+    BOOST_CHECK(v2.size() == 1 && v.empty());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_humble_allocate_at_least)
+  {
+    alloc<int, 12> a;
+    auto r = a.allocate_at_least(3);
+    BOOST_CHECK(r.ptr != nullptr && r.count == 3);
+    // the 4 left past 5 more couldn't fit another 5
+    r = a.allocate_at_least(5);
+    BOOST_CHECK(r.ptr != nullptr && r.count == 9);
+    BOOST_CHECK_THROW(a.allocate_at_least(1), std::bad_alloc);
+
+    alloc<int, 12> b;
+    BOOST_CHECK(b.allocate_at_least(9).count == 12);
+
+    std::allocator<int> s;
+    auto e = nonstd::allocator_extensions<std::allocator<int>>::allocate_at_least(s, 3);
+    BOOST_CHECK(e.count == 3);
+    s.deallocate(e.ptr, e.count);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_in_nonstd_vector_of_ints_taking_slack)
+  {
+    // the 3 left past 5 couldn't fit another 5: the vector takes them
+    nonstd::vector<int, alloc<int, 8>> v{0,1,2,3,4};
+    BOOST_CHECK(v.capacity() == 8);
+    nonstd::vector<int, alloc<int, 16>> v2{0,1,2,3,4};
+    BOOST_CHECK(v2.capacity() == 5);
+    v2.reserve(9);
+    BOOST_CHECK(v2.capacity() == 9);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_block_cache_recycles_blocks)
+  {
+    using cache = nonstd::block_cache<64>;
+    auto * b = cache::acquire();
+    BOOST_REQUIRE(b != nullptr);
+    BOOST_CHECK(b->allocate(64) != nullptr);
+    cache::release(b);
+    auto * c = cache::acquire();
+    BOOST_CHECK(c == b);
+    BOOST_CHECK(c->empty() && c->_refcnt == 1);
+    BOOST_CHECK(c->allocate(64) != nullptr);
+    c->deallocate(c->_storage, 64);
+
+    std::vector<nonstd::legacy::memory_block *> blocks;
+    for (size_t i = 0; i < 2 * cache::magazine_size; ++i)
+      blocks.push_back(cache::acquire());
+    for (auto * block : blocks)
+      cache::release(block);
+    BOOST_CHECK(cache::cached() >= cache::magazine_size / 2);
+    cache::release(c);
+  }
+
+#ifndef NONSTD_ASAN_ENABLED
+  // ASan's own allocator may deadlock the child, the shim doesn't run underneath it anyway
+  BOOST_AUTO_TEST_CASE(test_fork_while_other_threads_allocate)
+  {
+    // run on top of the malloc shim, the child must not find a lock held forever
+    std::atomic<bool> done{false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+      threads.emplace_back([&done]()
+          {
+            while (!done)
+            {
+              std::vector<std::vector<int>> v(64, std::vector<int>(16));
+              v.resize(8);
+            }
+          });
+    for (int i = 0; i < 20; ++i)
+    {
+      const pid_t pid = fork();
+      if (!pid)
+      {
+        nonstd::list<int, alloc<int, 24>> l{0,1,2};
+        std::vector<std::vector<int>> v(64, std::vector<int>(16));
+        _exit(l.size() == 3 && v.size() == 64 ? 0 : 1);
+      }
+      BOOST_REQUIRE(pid > 0);
+      int status = 0;
+      BOOST_REQUIRE(waitpid(pid, &status, 0) == pid);
+      BOOST_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    done = true;
+    for (auto& t : threads)
+      t.join();
+  }
+#endif
+
+  BOOST_AUTO_TEST_CASE(test_block_cache_outlives_the_thread_magazine)
+  {
+    using list = nonstd::list<int, alloc<int, 24>>;
+    using cache = list::allocator_type::cache;
+    const size_t cached = cache::cached();
+    std::thread([]()
+        {
+          // constructed before the magazine, so destroyed after it
+          static thread_local list l;
+          l.push_back(1);
+        }).join();
+    BOOST_CHECK(cache::cached() == cached + 1);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_humble_reuses_released_block)
+  {
+    const void * storage = nullptr;
+    {
+      nonstd::list<int, alloc<int, 1000>> l{0,1,2,3,4,5,6,7,8,9};
+      storage = &l.front();
+    }
+    nonstd::list<int, alloc<int, 1000>> l{0,1,2};
+    BOOST_CHECK(&l.front() == storage);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_legacy_block_registers_itself)
+  {
+    const size_t before = nonstd::resource_registry::count();
+    {
+      nonstd::legacy::memory_block b(128);
+      BOOST_CHECK(nonstd::resource_registry::count() == before + 1);
+      b.allocate(32);
+      void * p = b.allocate(32);
+      b.deallocate(p, 32);
+      const auto stats = nonstd::resource_registry::snapshot();
+      const auto found = std::find_if(stats.begin(), stats.end(), [&b](const nonstd::resource_stats& s) { return s.address == &b; });
+      BOOST_REQUIRE(found != stats.end());
+      BOOST_CHECK(std::string(found->kind) == "legacy::memory_block");
+      BOOST_CHECK(found->usage.capacity == 128);
+      BOOST_CHECK(found->usage.used == 32);
+      BOOST_CHECK(found->usage.dead == 32);
+    }
+    BOOST_CHECK(nonstd::resource_registry::count() == before);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_humble_charges_its_tag)
+  {
+    nonstd::allocation_tag explicit_tag("explicit"), scoped_tag("scoped");
+    {
+      alloc<int, 16> a(explicit_tag);
+      int * p = a.allocate(4);
+      BOOST_CHECK(explicit_tag.bytes() == 4 * sizeof(int));
+      BOOST_CHECK(explicit_tag.count() == 1);
+
+      // rebound copies keep the tag
+      std::list<int, alloc<int, 16>> l(a);
+      l.push_back(1);
+      l.push_back(2);
+      BOOST_CHECK(explicit_tag.count() == 3);
+
+      {
+        nonstd::scoped_allocation_tag scope(scoped_tag);
+        alloc<int, 16> b;
+        b.deallocate(b.allocate(2), 2);
+      }
+      BOOST_CHECK(scoped_tag.count() == 1);
+      BOOST_CHECK(scoped_tag.bytes() == 0);
+      BOOST_CHECK(scoped_tag.peak() == 2 * sizeof(int));
+      BOOST_CHECK(&nonstd::allocation_tag::current() == &nonstd::allocation_tag::untagged());
+
+      a.deallocate(p, 4);
+    }
+    BOOST_CHECK(explicit_tag.bytes() == 0);
+    BOOST_CHECK(explicit_tag.peak() > 4 * sizeof(int));
+
+    const auto report = nonstd::allocation_tag::report();
+    BOOST_CHECK(std::count_if(report.begin(), report.end(), [](const nonstd::tag_stats& s) { return s.name == "explicit"; }) == 1);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_adaptive_humble_learns_from_overflow)
+  {
+    nonstd::allocation_tag tag("overflowing_legacy");
+    {
+      alloc<int, 16> a(nonstd::adaptive, tag);
+      int * p = a.allocate(10);
+      BOOST_CHECK(a.storage_->capacity() == 16 * sizeof(int));
+      BOOST_CHECK_THROW(a.allocate(10), std::bad_alloc);
+      BOOST_CHECK(a.storage_->high_water() == 20 * sizeof(int));
+      a.deallocate(p, 10);
+    }
+    BOOST_CHECK(tag.profile().samples() == 1);
+
+    // 80 bytes land in the bucket up to 87
+    alloc<int, 16> a(nonstd::adaptive, tag);
+    int * p = a.allocate(10);
+    int * q = a.allocate(10);
+    BOOST_CHECK(a.storage_->capacity() == 87);
+    a.deallocate(q, 10);
+    a.deallocate(p, 10);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_adaptive_humble_learns_block_size)
+  {
+    nonstd::allocation_tag tag("adaptive_legacy");
+    for (int round = 0; round < 4; ++round)
+    {
+      alloc<int, 1024> a(nonstd::adaptive, tag);
+      int * p = a.allocate(100);
+      // 400 bytes land in the bucket up to 415
+      BOOST_CHECK(a.storage_->capacity() == (round ? 415 : 1024 * sizeof(int)));
+      a.deallocate(p, 100);
+    }
+    BOOST_CHECK(tag.profile().samples() == 4);
+
+    // fixed-size allocators keep their size but still teach the profile
+    {
+      alloc<int, 1024> a(tag);
+      a.deallocate(a.allocate(100), 100);
+      BOOST_CHECK(a.storage_->capacity() == 1024 * sizeof(int));
+    }
+    BOOST_CHECK(tag.profile().samples() == 5);
+
+    const std::string path = "nonstd_test_profile.txt";
+    BOOST_REQUIRE(nonstd::block_profile::global().save(path));
+    BOOST_REQUIRE(nonstd::block_profile::global().load(path));
+    std::remove(path.c_str());
+    BOOST_CHECK(tag.profile().samples() == 10);
+    BOOST_CHECK(!nonstd::block_profile::global().load(path));
+  }
+
+  BOOST_AUTO_TEST_CASE(test_btree_map_matches_std_map)
+  {
+    // three values per node so the tree gets deep and rebalances a lot
+    using small_btree = nonstd::btree_map<int, int, std::less<int>, std::allocator<std::pair<const int, int>>, 16>;
+    BOOST_CHECK(small_btree::slot_count == 3);
+
+    small_btree b;
+    std::map<int, int> m;
+    std::mt19937 random(42);
+    for (int i = 0; i < 20000; ++i)
+    {
+      const int key = static_cast<int>(random() % 2000);
+      if (random() % 3)
+        BOOST_CHECK(b.insert({key, i}).second == m.insert({key, i}).second);
+      else
+      {
+        const auto it = m.find(key);
+        const auto next = it == m.end() ? m.end() : std::next(it);
+        const auto found = b.find(key);
+        BOOST_REQUIRE((found == b.end()) == (it == m.end()));
+        if (it != m.end())
+        {
+          const auto after = b.erase(found);
+          m.erase(it);
+          BOOST_REQUIRE((after == b.end()) == (next == m.end()));
+          BOOST_CHECK(after == b.end() || after->first == next->first);
+        }
+      }
+    }
+    BOOST_CHECK(b.size() == m.size());
+    BOOST_CHECK(std::equal(b.begin(), b.end(), m.begin(), m.end()));
+    BOOST_CHECK(std::equal(b.rbegin(), b.rend(), m.rbegin(), m.rend()));
+    for (int key = -1; key <= 2000; key += 7)
+    {
+      const auto lower = b.lower_bound(key);
+      BOOST_CHECK((lower == b.end()) == (m.lower_bound(key) == m.end()));
+      BOOST_CHECK(lower == b.end() || lower->first == m.lower_bound(key)->first);
+      const auto upper = b.upper_bound(key);
+      BOOST_CHECK(upper == b.end() || upper->first == m.upper_bound(key)->first);
+    }
+
+    while (!b.empty())
+      b.erase(b.begin());
+    BOOST_CHECK(b.begin() == b.end() && b.height() == 0);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_btree_map_bulk_loads_sorted_input)
+  {
+    std::vector<std::pair<const int, int>> sorted;
+    for (int i = 0; i < 10000; ++i)
+      sorted.emplace_back(2 * i, i);
+
+    nonstd::btree_map<int, int> b(nonstd::sorted_unique, sorted.begin(), sorted.end());
+    BOOST_CHECK(b.size() == sorted.size());
+    BOOST_CHECK(std::equal(b.begin(), b.end(), sorted.begin(), sorted.end()));
+    // 30 values per node packed full
+    BOOST_CHECK(b.height() == 3);
+    BOOST_CHECK(b.lower_bound(4999)->first == 5000);
+    BOOST_CHECK(b.at(19998) == 9999);
+
+    for (int i = 0; i < 10000; i += 2)
+      BOOST_CHECK(b.erase(2 * i) == 1);
+    BOOST_CHECK(b.size() == 5000);
+    BOOST_CHECK(b.begin()->first == 2 && std::prev(b.end())->first == 19998);
+
+    nonstd::btree_map<int, int> copy(b);
+    BOOST_CHECK(copy == b);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_btree_map_on_humble)
+  {
+    nonstd::btree_map<int, std::string, std::less<int>, alloc<std::pair<const int, std::string>, 1000>> b;
+    for (int i = 999; i >= 0; --i)
+      b[i] = std::to_string(i);
+    BOOST_CHECK(b.size() == 1000);
+    BOOST_CHECK(b.begin()->second == "0" && b.rbegin()->second == "999");
+    BOOST_CHECK(b.try_emplace(500, "x").second == false);
+    BOOST_CHECK(b.erase(b.find(500), b.find(600))->first == 600);
+    BOOST_CHECK(b.size() == 900 && b.count(599) == 0);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_flat_hash_map_matches_std_unordered_map)
+  {
+    nonstd::flat_hash_map<int, int> h;
+    std::unordered_map<int, int> m;
+    std::mt19937 random(7);
+    for (int i = 0; i < 50000; ++i)
+    {
+      const int key = static_cast<int>(random() % 5000);
+      if (random() % 2)
+        BOOST_CHECK(h.insert({key, i}).second == m.insert({key, i}).second);
+      else
+        BOOST_CHECK(h.erase(key) == m.erase(key));
+    }
+    BOOST_CHECK(h.size() == m.size());
+    BOOST_CHECK(h.load_factor() <= h.max_load_factor());
+    BOOST_CHECK(static_cast<size_t>(std::distance(h.begin(), h.end())) == m.size());
+    for (const auto& v : m)
+      BOOST_CHECK(h.at(v.first) == v.second);
+    for (const auto& v : h)
+      BOOST_CHECK(m.at(v.first) == v.second);
+
+    nonstd::flat_hash_map<int, int> copy(h);
+    BOOST_CHECK(copy == h);
+    for (auto it = h.begin(); it != h.end(); )
+      it = (it->first % 2) ? h.erase(it) : std::next(it);
+    BOOST_CHECK(h.size() == static_cast<size_t>(std::count_if(m.begin(), m.end(), [](const auto& v) { return v.first % 2 == 0; })));
+    h.clear();
+    BOOST_CHECK(h.empty() && h.begin() == h.end() && h.find(0) == h.end());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_flat_hash_map_grows_in_place_on_humble)
+  {
+    // slots and control bytes of 1023 slots fit, along with no smaller table
+    nonstd::flat_hash_map<int, std::string, std::hash<int>, std::equal_to<int>, alloc<std::pair<const int, std::string>, 1200>> h;
+    for (int i = 0; i < 800; ++i)
+      h[i] = std::to_string(i);
+    BOOST_CHECK(h.capacity() == 1023);
+    BOOST_CHECK(h.size() == 800);
+    for (int i = 0; i < 800; ++i)
+      BOOST_CHECK(h.at(i) == std::to_string(i));
+    BOOST_CHECK(h.try_emplace(5, "x").second == false);
+    BOOST_CHECK(h.count(800) == 0);
+  }
+
   // initializer_list<hard> required copy-ctor
   // BOOST_AUTO_TEST_CASE(test_initializer_list_in_list_with_non_copyable_humble)
   // {
@@ -1,10 +1,29 @@
 #include "pmr_memory_block.h"
 #include "pmr_list.h"
+#include "pmr_humble_allocator.h"
+#include "pmr_sharded_memory_block.h"
+#include "pmr_epoch.h"
+#include "pmr_fallback_resource.h"
+#include "pmr_reserved_memory_block.h"
+#include "pmr_default_resource.h"
+#include "pmr_tracing_resource.h"
+#include "stats_exporter.h"
+#include "flat_hash_map.h"
+#include "pmr_object_cache.h"
 
 #include <list>
 #include <vector>
 #include <map>
 #include <functional>
+#include <cstring>
+#include <numeric>
+#include <thread>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <random>
+#include <optional>
 
 #define BOOST_TEST_MODULE test_main
 
@@ -16,6 +35,7 @@
 #ifdef MEMORY_BLOCK_TRACING
 template<>
 std::atomic_int nonstd::pmr::memory_block<10>::count{};
+std::atomic_int nonstd::legacy::memory_block::count{};
 #endif
 
 #endif // __cplusplus > 201402L
@@ -25,6 +45,25 @@ using alloc = std::pmr::polymorphic_allocator<std::byte>;
 template<size_t N>
 using memblock = nonstd::pmr::memory_block<N>;
 
+//! Costly to construct: preallocates its buffer, counts the live instances
+struct buffered
+{
+  buffered()
+  {
+    buffer.reserve(64);
+    ++live;
+  }
+
+  ~buffered()
+  {
+    --live;
+  }
+
+  std::vector<int> buffer;
+  std::atomic<bool> taken{false};
+  static inline std::atomic<int> live{0};
+};
+
 BOOST_AUTO_TEST_SUITE(test_suite_main)
 
   BOOST_AUTO_TEST_CASE(test_in_list_contruction_and_destruction)
@@ -147,6 +186,688 @@ BOOST_AUTO_TEST_SUITE(test_suite_main)
     BOOST_CHECK(std::equal(m.begin(), m.end(), m2.begin(), m2.end()));
   }
 
+  BOOST_AUTO_TEST_CASE(test_memory_block_rewinds_when_emptied)
+  {
+    nonstd::pmr::memory_block<2> b;
+    void * p1 = b.allocate(32);
+    void * p2 = b.allocate(32);
+    BOOST_CHECK_THROW((void)b.allocate(1), std::bad_alloc);
+    b.deallocate(p1, 32);
+    b.deallocate(p2, 32);
+    BOOST_CHECK(b.empty());
+    BOOST_CHECK(b.allocate(64) == p1);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_memory_block_purges_idle_pages)
+  {
+    constexpr size_t size = 1 << 20;
+    nonstd::pmr::memory_block<1> b;
+    b.set_decay(std::chrono::hours(1));
+    void * p = b.allocate(size);
+    std::memset(p, 1, size);
+    BOOST_CHECK(b.purge() == 0);
+    b.deallocate(p, size);
+    BOOST_CHECK(b.purge() == 0);
+    b.set_decay(std::chrono::milliseconds(0));
+    BOOST_CHECK(b.purge() > 0);
+    BOOST_CHECK(b.purge() == 0);
+    BOOST_CHECK(b.allocate(size) == p);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_humble_reuses_emptied_block)
+  {
+    std::list<int, nonstd::pmr::humble<int, 10>> l;
+    for (int round = 0; round < 3; ++round)
+    {
+      for (int i = 0; i < 10; ++i)
+        l.push_back(i);
+      BOOST_CHECK(l.size() == 10);
+      l.clear();
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE(test_memory_block_bulk_allocation)
+  {
+    nonstd::pmr::memory_block<4> b;
+    void * p[4] = {};
+    b.allocate_bulk(sizeof(int), 4, p);
+    BOOST_CHECK(b.size() == 4 * sizeof(int));
+    BOOST_CHECK(static_cast<int *>(p[3]) == static_cast<int *>(p[0]) + 3);
+    BOOST_CHECK_THROW(b.allocate_bulk(sizeof(int), 1, p), std::bad_alloc);
+    b.deallocate_bulk(p, 4, sizeof(int));
+    BOOST_CHECK(b.empty());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_in_nonstd_list_of_ints_bulk_range)
+  {
+    std::vector<int> v(200);
+    std::iota(v.begin(), v.end(), 0);
+    nonstd::pmr::memory_block<200> b;
+    {
+      nonstd::pmr::list<int> l(v.begin(), v.end(), &b);
+      BOOST_CHECK(l.size() == 200);
+      BOOST_CHECK(std::equal(v.begin(), v.end(), l.begin(), l.end()));
+      nonstd::pmr::list<int> l2(l);
+      BOOST_CHECK(l2 == l);
+    }
+    BOOST_CHECK(b.empty());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_sharded_memory_block_honours_alignment)
+  {
+    nonstd::pmr::sharded_memory_block<8> b(64, 1);
+    void * odd = b.allocate(3, 1);
+    void * p = b.allocate(8, 8);
+    BOOST_CHECK(reinterpret_cast<std::uintptr_t>(p) % 8 == 0);
+    BOOST_CHECK(static_cast<std::byte *>(p) >= static_cast<std::byte *>(odd) + 3);
+
+    void * q = b.allocate(1, 1);
+    void * out[3];
+    b.allocate_bulk(12, 3, out, 16);
+    for (void * r : out)
+      BOOST_CHECK(reinterpret_cast<std::uintptr_t>(r) % 16 == 0);
+    BOOST_CHECK(static_cast<std::byte *>(out[1]) - static_cast<std::byte *>(out[0]) == 16);
+    BOOST_CHECK(b.size() == 3 + 8 + 1 + 3 * 12);
+
+    b.deallocate_bulk(out, 3, 12, 16);
+    b.deallocate(q, 1, 1);
+    b.deallocate(p, 8, 8);
+    b.deallocate(odd, 3, 1);
+    BOOST_CHECK(b.empty());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_sharded_memory_block_falls_back_to_other_shards)
+  {
+    nonstd::pmr::sharded_memory_block<2> b(64, 2);
+    BOOST_CHECK(b.shards() == 2);
+    std::vector<void *> p;
+    for (int i = 0; i < 4; ++i)
+      p.push_back(b.allocate(64));
+    BOOST_CHECK_THROW((void)b.allocate(64), std::bad_alloc);
+    BOOST_CHECK(b.size() == 4 * 64);
+    for (void * q : p)
+      BOOST_CHECK(b.is_pointed_by(q, 64));
+    BOOST_CHECK_THROW(b.deallocate(&p, 64), std::invalid_argument);
+    for (void * q : p)
+      b.deallocate(q, 64);
+    BOOST_CHECK(b.empty());
+    BOOST_CHECK(b.allocate(64) != nullptr);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_in_nonstd_list_of_ints_on_sharded_memory_block)
+  {
+    nonstd::pmr::sharded_memory_block<64> b(sizeof(nonstd::list_details::node<int>), 4);
+    nonstd::pmr::list<int> l({0,1,2,3,4,5,6,7,8,9}, &b);
+    BOOST_CHECK(l.size() == 10);
+    BOOST_CHECK(b.size() == 10 * sizeof(nonstd::list_details::node<int>));
+  }
+
+  BOOST_AUTO_TEST_CASE(test_epoch_domain_defers_reclamation_while_pinned)
+  {
+    using node = nonstd::list_details::node<int>;
+    nonstd::pmr::memory_block<4> b;
+    nonstd::pmr::epoch_domain<int> domain(&b);
+    {
+      nonstd::epoch_domain::guard guard(domain);
+      for (int i = 0; i < 4; ++i)
+        domain.retire(new (b.allocate(sizeof(node), alignof(node))) node(i));
+      domain.synchronize();
+      BOOST_CHECK(b.size() == 4 * sizeof(node));
+    }
+    domain.synchronize();
+    BOOST_CHECK(b.empty());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_epoch_domain_returns_nodes_from_many_threads)
+  {
+    using node = nonstd::list_details::node<int>;
+    constexpr int threads = 4;
+    constexpr int nodes = 1000;
+    nonstd::pmr::memory_block<threads * nodes> b;
+    {
+      nonstd::pmr::epoch_domain<int> domain(&b);
+      std::vector<std::thread> pool;
+      for (int t = 0; t < threads; ++t)
+        pool.emplace_back([&]()
+            {
+              for (int i = 0; i < nodes; ++i)
+              {
+                nonstd::epoch_domain::guard guard(domain);
+                domain.retire(new (b.allocate(sizeof(node), alignof(node))) node(i));
+              }
+            });
+      for (auto& t : pool)
+        t.join();
+      BOOST_CHECK(domain.epoch() > 0);
+    }
+    BOOST_CHECK(b.empty());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_memory_block_try_allocate)
+  {
+    nonstd::pmr::memory_block<2> b;
+    void * p = b.try_allocate(16);
+    BOOST_CHECK(p != nullptr);
+    BOOST_CHECK(b.try_allocate(16) != nullptr);
+    BOOST_CHECK(b.try_allocate(16) == nullptr);
+    BOOST_CHECK(b.size() == 32);
+
+    nonstd::pmr::humble<int, 2> h;
+    BOOST_CHECK(h.try_allocate(2) != nullptr);
+    BOOST_CHECK(h.try_allocate(1) == nullptr);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_fallback_resource_spills_to_upstream)
+  {
+    nonstd::pmr::memory_block<4> primary;
+    nonstd::pmr::memory_block<4> secondary;
+    nonstd::pmr::fallback_resource chained(&secondary, std::pmr::null_memory_resource());
+    nonstd::pmr::fallback_resource r(&primary, &chained);
+
+    std::vector<void *> p;
+    for (int i = 0; i < 8; ++i)
+      p.push_back(r.allocate(16));
+    BOOST_CHECK(r.spills() == 4);
+    BOOST_CHECK(chained.spills() == 0);
+    BOOST_CHECK(r.try_allocate(16) == nullptr);
+    BOOST_CHECK_THROW((void)r.allocate(16), std::bad_alloc);
+    BOOST_CHECK(r.is_pointed_by(p[7]));
+    BOOST_CHECK(primary.size() == 64 && secondary.size() == 64);
+
+    for (void * q : p)
+      r.deallocate(q, 16);
+    BOOST_CHECK(primary.empty() && secondary.empty());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_in_vector_of_ints_on_fallback_resource)
+  {
+    nonstd::pmr::memory_block<4> primary;
+    nonstd::pmr::fallback_resource r(&primary);
+    std::pmr::vector<int> v(&r);
+    for (int i = 0; i < 100; ++i)
+      v.push_back(i);
+    BOOST_CHECK(v.size() == 100 && v.back() == 99);
+    BOOST_CHECK(r.spills() > 0);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_reserved_memory_block_commits_on_demand)
+  {
+    constexpr size_t granule = 64 * 1024;
+    nonstd::pmr::reserved_memory_block b(64 * granule, granule);
+    BOOST_CHECK(b.reserved() == 64 * granule);
+    BOOST_CHECK(b.committed() == 0);
+
+    std::vector<char *> p;
+    for (int i = 0; i < 8; ++i)
+    {
+      p.push_back(static_cast<char *>(b.allocate(granule)));
+      std::memset(p.back(), i, granule);
+    }
+    for (int i = 1; i < 8; ++i)
+      BOOST_CHECK(p[i] == p[i - 1] + granule);
+    BOOST_CHECK(b.committed() == 8 * granule);
+    BOOST_CHECK(b.is_pointed_by(p[7], granule));
+    BOOST_CHECK(b.try_allocate(64 * granule) == nullptr);
+    BOOST_CHECK_THROW((void)b.allocate(64 * granule), std::bad_alloc);
+
+    for (char * q : p)
+      b.deallocate(q, granule);
+    BOOST_CHECK(b.empty());
+    BOOST_CHECK(b.committed() == granule);
+    BOOST_CHECK(static_cast<char *>(b.allocate(16)) == p[0]);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_in_nonstd_list_of_ints_on_reserved_memory_block)
+  {
+    nonstd::pmr::reserved_memory_block b(1 << 24);
+    {
+      // the range constructor appends in batches, push_back would walk the list each time
+      std::vector<int> v(100000);
+      std::iota(v.begin(), v.end(), 0);
+      nonstd::pmr::list<int> l(v.begin(), v.end(), &b);
+      BOOST_CHECK(l.size() == 100000 && l.back() == 99999);
+      BOOST_CHECK(b.committed() >= 100000 * sizeof(nonstd::list_details::node<int>));
+    }
+    BOOST_CHECK(b.empty());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_in_nonstd_list_of_ints_winking_out)
+  {
+    nonstd::pmr::memory_block<20> b;
+    {
+      nonstd::pmr::list<int> l1(size_t{10}, 1, &b);
+      {
+        nonstd::pmr::list<int> l2(size_t{10}, 2, &b);
+        BOOST_CHECK(!b.release(10 * sizeof(nonstd::list_details::node<int>)));
+      }
+      BOOST_CHECK(b.size() == 10 * sizeof(nonstd::list_details::node<int>));
+    }
+    BOOST_CHECK(b.empty());
+
+    nonstd::pmr::list<int> l(size_t{20}, 3, &b);
+    BOOST_CHECK(l.size() == 20 && l.back() == 3);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_nonstd_list_sorts_and_merges_in_place)
+  {
+    using node = nonstd::list_details::node<int>;
+    std::vector<int> v(100);
+    std::iota(v.begin(), v.end(), 0);
+    std::shuffle(v.begin(), v.end(), std::mt19937(3));
+    nonstd::pmr::memory_block<200> b;
+    nonstd::pmr::list<int> l1(v.begin(), v.begin() + 50, &b);
+    nonstd::pmr::list<int> l2(v.begin() + 50, v.end(), &b);
+    l1.sort();
+    l2.sort(std::greater<int>());
+    l2.reverse();
+    l1.merge(l2);
+    BOOST_CHECK(l2.empty() && l1.size() == 100);
+    BOOST_CHECK(std::is_sorted(l1.begin(), l1.end()));
+    BOOST_CHECK(b.size() == 100 * sizeof(node));
+
+    // another resource: the values move over instead of the nodes
+    nonstd::pmr::memory_block<4> other;
+    nonstd::pmr::list<int> l3({0, 0, 99, 99}, &other);
+    l1.merge(l3);
+    BOOST_CHECK(l3.empty() && other.empty());
+    BOOST_CHECK(l1.size() == 104 && l1.front() == 0 && l1.back() == 99);
+    BOOST_CHECK(l1.unique() == 4);
+    BOOST_CHECK(b.size() == 100 * sizeof(node));
+    std::sort(v.begin(), v.end());
+    BOOST_CHECK(std::equal(l1.begin(), l1.end(), v.begin(), v.end()));
+  }
+
+  BOOST_AUTO_TEST_CASE(test_nonstd_list_reuses_spare_nodes)
+  {
+    using node = nonstd::list_details::node<int>;
+    nonstd::pmr::memory_block<4> b;
+    nonstd::pmr::list<int> l(&b);
+    l.spare_limit(1);
+    l.push_back(0);
+    for (int i = 1; i < 1000; ++i)
+    {
+      l.push_back(i);
+      l.pop_front();
+    }
+    BOOST_CHECK(l.size() == 1 && l.front() == 999);
+    BOOST_CHECK(l.spare_size() == 1);
+    BOOST_CHECK(b.size() == 2 * sizeof(node));
+    l.spare_limit(0);
+    BOOST_CHECK(l.spare_size() == 0 && b.size() == sizeof(node));
+    l.push_front(1);
+    l.pop_front();
+    BOOST_CHECK(l.spare_size() == 0 && l.front() == 999);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_object_cache_retains_initialisation)
+  {
+    auto clear = [](buffered& object) { object.buffer.clear(); };
+    using cache_type = nonstd::pmr::object_cache<buffered, decltype(clear)>;
+    nonstd::pmr::memory_block<2> b;
+    const int live = buffered::live;
+    {
+      cache_type cache(8, clear, &b);
+      buffered * first = cache.acquire();
+      BOOST_CHECK(buffered::live - live == 8 && cache.capacity() == 8);
+      first->buffer.assign(10, 1);
+      const int * data = first->buffer.data();
+      cache.release(first);
+      BOOST_CHECK(first->buffer.empty());
+      buffered * again = cache.acquire();
+      BOOST_CHECK(again == first && again->buffer.data() == data);
+      cache.release(again);
+
+      // the block has room for two slabs
+      std::vector<cache_type::handle> held;
+      for (int i = 0; i < 16; ++i)
+        held.push_back(cache.get());
+      BOOST_CHECK(cache.capacity() == 16 && buffered::live - live == 16);
+      BOOST_CHECK_THROW(cache.acquire(), std::bad_alloc);
+      held.clear();
+      for (int i = 0; i < 16; ++i)
+        held.push_back(cache.get());
+      BOOST_CHECK(cache.capacity() == 16);
+      held.clear();
+      BOOST_CHECK(cache.acquire()->buffer.capacity() >= 64);
+    }
+    BOOST_CHECK(buffered::live == live);
+    BOOST_CHECK(b.empty());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_object_cache_from_many_threads)
+  {
+    using cache_type = nonstd::pmr::object_cache<buffered>;
+    constexpr size_t threads = 4;
+    constexpr size_t held = 20;
+    cache_type cache(32);
+    std::atomic<int> shared{0};
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t)
+      pool.emplace_back([&cache, &shared]()
+          {
+            std::vector<buffered *> objects;
+            for (int round = 0; round < 1000; ++round)
+            {
+              for (size_t i = 0; i < held; ++i)
+              {
+                objects.push_back(cache.acquire());
+                if (objects.back()->taken.exchange(true))
+                  ++shared;
+              }
+              for (buffered * object : objects)
+              {
+                object->taken = false;
+                cache.release(object);
+              }
+              objects.clear();
+            }
+          });
+    for (auto& t : pool)
+      t.join();
+    BOOST_CHECK(shared == 0);
+    // in use, in the magazines or in the depot, which only grows when empty
+    BOOST_CHECK(cache.capacity() <= threads * (held + cache_type::magazine_size) + cache.slab_size());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_memory_block_try_expand)
+  {
+    nonstd::pmr::memory_block<8> b;
+    void * p = b.allocate(16);
+    BOOST_CHECK(b.try_expand(p, 16, 64));
+    BOOST_CHECK(b.size() == 64);
+    BOOST_CHECK(!b.try_expand(p, 64, 129));
+    void * q = b.allocate(16);
+    BOOST_CHECK(!b.try_expand(p, 64, 80));
+    b.deallocate(q, 16);
+    b.deallocate(p, 64);
+    BOOST_CHECK(b.empty());
+
+    nonstd::pmr::reserved_memory_block r(1 << 20, 4096);
+    p = r.allocate(16);
+    BOOST_CHECK(r.try_expand(p, 16, 1 << 19));
+    static_cast<char *>(p)[(1 << 19) - 1] = 1;
+    BOOST_CHECK(r.committed() == 1 << 19);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_memory_block_allocate_at_least)
+  {
+    nonstd::pmr::memory_block<4> b;
+    auto r = b.allocate_at_least(24);
+    BOOST_CHECK(r.ptr != nullptr && r.count == 24);
+    auto q = b.allocate_at_least(40);
+    BOOST_CHECK(q.ptr != nullptr && q.count == 72);
+    BOOST_CHECK_THROW(b.allocate_at_least(1), std::bad_alloc);
+    b.deallocate(q.ptr, q.count);
+    b.deallocate(r.ptr, r.count);
+    BOOST_CHECK(b.empty());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_scoped_default_resource)
+  {
+    using node = nonstd::list_details::node<int>;
+    nonstd::pmr::memory_block<16> outer;
+    nonstd::pmr::memory_block<16> inner;
+    BOOST_CHECK(nonstd::pmr::get_default_resource() == std::pmr::get_default_resource());
+    {
+      nonstd::pmr::scoped_default_resource scope(&outer);
+      nonstd::pmr::list<int> l{0,1,2};
+      BOOST_CHECK(l.get_allocator().resource() == &outer);
+      BOOST_CHECK(outer.size() == 3 * sizeof(node));
+      {
+        nonstd::pmr::scoped_default_resource nested(&inner);
+        nonstd::pmr::list<int> l2;
+        l2.push_back(3);
+        BOOST_CHECK(inner.size() == sizeof(node));
+
+        std::pmr::memory_resource * other = nullptr;
+        std::thread([&other]() { other = nonstd::pmr::get_default_resource(); }).join();
+        BOOST_CHECK(other == std::pmr::get_default_resource());
+      }
+      BOOST_CHECK(nonstd::pmr::get_default_resource() == &outer);
+    }
+    BOOST_CHECK(outer.empty() && inner.empty());
+    BOOST_CHECK(nonstd::pmr::get_default_resource() == std::pmr::get_default_resource());
+  }
+
+  BOOST_AUTO_TEST_CASE(test_tracing_resource_records_events)
+  {
+    const std::string path = (std::filesystem::temp_directory_path() / "nonstd_test_trace.bin").string();
+    constexpr size_t threads = 4;
+    constexpr size_t allocations = 1000;
+    {
+      nonstd::pmr::reserved_memory_block b(1 << 20);
+      nonstd::pmr::tracing_resource r(path, &b);
+      std::vector<std::thread> pool;
+      for (size_t t = 0; t < threads; ++t)
+        pool.emplace_back([&r, t]()
+            {
+              std::vector<void *> p;
+              for (size_t i = 0; i < allocations; ++i)
+                p.push_back(r.allocate(16 * (t + 1), 8));
+              for (void * q : p)
+                r.deallocate(q, 16 * (t + 1), 8);
+            });
+      for (auto& t : pool)
+        t.join();
+      BOOST_CHECK(r.dropped() == 0);
+    }
+
+    const auto events = nonstd::pmr::read_trace(path);
+    std::filesystem::remove(path);
+    BOOST_REQUIRE(events.size() == 2 * threads * allocations);
+    std::map<std::uint32_t, size_t> per_thread;
+    size_t allocated = 0;
+    for (const auto& e : events)
+    {
+      BOOST_CHECK(e.alignment == 8 && e.size % 16 == 0);
+      ++per_thread[e.thread];
+      allocated += (e.kind == nonstd::pmr::trace_event::allocate);
+    }
+    BOOST_CHECK(per_thread.size() == threads);
+    BOOST_CHECK(allocated == threads * allocations);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_registry_snapshots_live_blocks)
+  {
+    const auto find = [](const void * address)
+      {
+        const auto stats = nonstd::resource_registry::snapshot();
+        const auto found = std::find_if(stats.begin(), stats.end(), [address](const auto& s) { return s.address == address; });
+        BOOST_REQUIRE(found != stats.end());
+        return *found;
+      };
+
+    const size_t before = nonstd::resource_registry::count();
+    {
+      nonstd::pmr::memory_block<4> b(64);
+      nonstd::pmr::reserved_memory_block r(1 << 20);
+      BOOST_CHECK(nonstd::resource_registry::count() == before + 2);
+
+      void * p = b.allocate(64);
+      void * q = b.allocate(64);
+      b.deallocate(p, 64);
+      const auto stats = find(&b);
+      BOOST_CHECK(std::string(stats.kind) == "pmr::memory_block");
+      BOOST_CHECK(stats.usage.capacity == 256);
+      BOOST_CHECK(stats.usage.used == 64);
+      BOOST_CHECK(stats.usage.dead == 64);
+      b.deallocate(q, 64);
+      BOOST_CHECK(find(&b).usage.dead == 0);
+
+      (void)r.allocate(100);
+      BOOST_CHECK(find(&r).usage.used == 100);
+      BOOST_CHECK(find(&r).usage.capacity >= 100);
+
+      std::ostringstream out;
+      nonstd::write_prometheus(out, nonstd::resource_registry::snapshot());
+      BOOST_CHECK(out.str().find("nonstd_resources{kind=\"pmr::reserved_memory_block\"} ") != std::string::npos);
+      BOOST_CHECK(out.str().find("# TYPE nonstd_resource_dead_bytes gauge") != std::string::npos);
+      BOOST_CHECK(out.str().find("resource=") == std::string::npos);
+
+      std::ostringstream detailed;
+      nonstd::write_prometheus(detailed, nonstd::resource_registry::snapshot(), true);
+      std::ostringstream address;
+      address << static_cast<const void *>(&r);
+      BOOST_CHECK(detailed.str().find("nonstd_resource_used_bytes{kind=\"pmr::reserved_memory_block\",resource=\"" + address.str() + "\"} 100\n") != std::string::npos);
+    }
+    BOOST_CHECK(nonstd::resource_registry::count() == before);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_write_prometheus_sums_kinds_and_escapes_labels)
+  {
+    const std::vector<nonstd::resource_stats> stats =
+    {
+      {"a\"b\\c\nd", nullptr, {100, 60, 10}, std::chrono::seconds(1)},
+      {"a\"b\\c\nd", nullptr, {50, 20, 5}, std::chrono::seconds(3)},
+    };
+    std::ostringstream out;
+    nonstd::write_prometheus(out, stats);
+    const std::string text = out.str();
+    BOOST_CHECK(text.find("nonstd_resources{kind=\"a\\\"b\\\\c\\nd\"} 2\n") != std::string::npos);
+    BOOST_CHECK(text.find("nonstd_resource_capacity_bytes{kind=\"a\\\"b\\\\c\\nd\"} 150\n") != std::string::npos);
+    BOOST_CHECK(text.find("nonstd_resource_used_bytes{kind=\"a\\\"b\\\\c\\nd\"} 80\n") != std::string::npos);
+    BOOST_CHECK(text.find("nonstd_resource_dead_bytes{kind=\"a\\\"b\\\\c\\nd\"} 15\n") != std::string::npos);
+    BOOST_CHECK(text.find("nonstd_resource_age_seconds{kind=\"a\\\"b\\\\c\\nd\"} 3\n") != std::string::npos);
+
+    std::ostringstream tags;
+    nonstd::write_prometheus(tags, std::vector<nonstd::tag_stats>{{"x\"y", 8, 16, 2}});
+    BOOST_CHECK(tags.str().find("nonstd_tag_bytes{tag=\"x\\\"y\"} 8\n") != std::string::npos);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_stats_exporter_writes_periodically)
+  {
+    const std::string path = (std::filesystem::temp_directory_path() / "nonstd_test_stats.prom").string();
+    nonstd::pmr::memory_block<4> b(64);
+    (void)b.allocate(64);
+    {
+      nonstd::stats_exporter exporter(path, std::chrono::milliseconds(1));
+      for (int i = 0; i < 1000 && !std::filesystem::exists(path); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      BOOST_CHECK(std::filesystem::exists(path));
+    }
+
+    std::ifstream in(path);
+    const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::filesystem::remove(path);
+    BOOST_CHECK(text.find("nonstd_resource_used_bytes{kind=\"pmr::memory_block\"") != std::string::npos);
+    BOOST_CHECK(text.find("} 64\n") != std::string::npos);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_memory_block_charges_the_scoped_tag)
+  {
+    nonstd::allocation_tag tag("pmr_test");
+    {
+      std::optional<nonstd::pmr::memory_block<16>> b;
+      {
+        nonstd::scoped_allocation_tag scope(tag);
+        b.emplace();
+      }
+      BOOST_CHECK(&b->tag() == &tag);
+
+      std::pmr::vector<int> v(&*b);
+      v.reserve(8);
+      BOOST_CHECK(tag.bytes() == 8 * sizeof(int));
+      BOOST_CHECK(tag.count() == 1);
+
+      void * ptrs[4];
+      b->allocate_bulk(4, 4, ptrs);
+      BOOST_CHECK(tag.count() == 5);
+      b->deallocate_bulk(ptrs, 4, 4);
+      BOOST_CHECK(tag.bytes() == 8 * sizeof(int));
+      BOOST_CHECK(tag.peak() == 8 * sizeof(int) + 16);
+    }
+    BOOST_CHECK(tag.bytes() == 0);
+
+    std::ostringstream out;
+    nonstd::write_prometheus(out, nonstd::allocation_tag::report());
+    BOOST_CHECK(out.str().find("nonstd_tag_allocations_total{tag=\"pmr_test\"} 5\n") != std::string::npos);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_adaptive_memory_block_learns_from_overflow)
+  {
+    nonstd::allocation_tag tag("overflowing_pmr");
+    nonstd::scoped_allocation_tag scope(tag);
+    {
+      nonstd::pmr::memory_block<2> b(nonstd::adaptive);
+      void * p = b.allocate(64);
+      void * q = b.allocate(64);
+      BOOST_CHECK(b.try_allocate(64) == nullptr);
+      BOOST_CHECK(b.high_water() == 192);
+      b.deallocate(q, 64);
+      b.deallocate(p, 64);
+    }
+
+    // the refused chunk counts towards the learned size
+    nonstd::pmr::memory_block<2> b(nonstd::adaptive);
+    b.deallocate(b.allocate(64), 64);
+    BOOST_CHECK(b.capacity() == 207);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_adaptive_memory_block_learns_its_size)
+  {
+    nonstd::allocation_tag tag("adaptive_pmr");
+    nonstd::scoped_allocation_tag scope(tag);
+    for (int round = 0; round < 3; ++round)
+    {
+      nonstd::pmr::memory_block<16> b(nonstd::adaptive);
+      void * p[3];
+      for (auto& q : p)
+        q = b.allocate(64);
+      BOOST_CHECK(b.high_water() == 192);
+      // the learned mark lands in a bucket of a power of two split in eight
+      BOOST_CHECK(b.capacity() == (round ? 207 : 16 * 64));
+      for (auto& q : p)
+        b.deallocate(q, 64);
+    }
+    BOOST_CHECK(tag.profile().samples() == 3);
+    BOOST_CHECK(tag.profile().percentile(50) == 207);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_memory_block_poisons_its_free_space)
+  {
+    nonstd::pmr::memory_block<4> b(64);
+    char * p = static_cast<char *>(b.allocate(64));
+    char * q = static_cast<char *>(b.allocate(64));
+    BOOST_CHECK(!nonstd::details::asan_poisoned(p));
+    BOOST_CHECK(!nonstd::details::asan_poisoned(p + 63));
+    // built without redzones the chunks are adjacent, test_asan_redzones checks the gaps
+    BOOST_CHECK(p + 64 == q);
+    // the tail is poisoned
+    BOOST_CHECK(nonstd::details::asan_poisoned(q + 64) == nonstd::details::asan_enabled);
+    b.deallocate(p, 64);
+    BOOST_CHECK(nonstd::details::asan_poisoned(p) == nonstd::details::asan_enabled);
+    BOOST_CHECK(!nonstd::details::asan_poisoned(q));
+    BOOST_CHECK(b.try_expand(q, 64, 128));
+    BOOST_CHECK(!nonstd::details::asan_poisoned(q + 127));
+    b.deallocate(q, 128);
+    BOOST_CHECK(nonstd::details::asan_poisoned(q) == nonstd::details::asan_enabled);
+
+    nonstd::pmr::reserved_memory_block r(1 << 20);
+    char * c = static_cast<char *>(r.allocate(64));
+    BOOST_CHECK(!nonstd::details::asan_poisoned(c + 63));
+    BOOST_CHECK(nonstd::details::asan_poisoned(c + 64) == nonstd::details::asan_enabled);
+    r.deallocate(c, 64);
+    BOOST_CHECK(nonstd::details::asan_poisoned(c) == nonstd::details::asan_enabled);
+  }
+
+  BOOST_AUTO_TEST_CASE(test_flat_hash_map_grows_in_place_on_memory_block)
+  {
+    using map = nonstd::flat_hash_map<int, int, std::hash<int>, std::equal_to<int>, std::pmr::polymorphic_allocator<std::pair<const int, int>>>;
+    // room for the table of 1023 slots, not for it next to the previous one
+    nonstd::pmr::memory_block<1> b(9600);
+    map h(&b);
+    for (int i = 0; i < 800; ++i)
+      h.emplace(i, -i);
+    BOOST_CHECK(h.capacity() == 1023);
+    BOOST_CHECK(h.at(799) == -799);
+    for (int i = 0; i < 800; i += 2)
+      h.erase(i);
+    for (int i = 800; i < 1200; ++i)
+      h.emplace(i, -i);
+    BOOST_CHECK(h.size() == 800 && h.capacity() == 1023);
+    BOOST_CHECK(h.count(2) == 0 && h.at(1) == -1 && h.at(1199) == -1199);
+  }
+
   // following doesn't compile since the Allocator type induces the Container type
   // BOOST_AUTO_TEST_CASE(test_in_list_of_ints_copying_with_different_humble)
   // {
@@ -0,0 +1,384 @@
+#pragma once
+
+#include "allocator_extensions.h"
+
+#include <memory>
+#include <utility>
+#include <initializer_list>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+
+namespace nonstd
+{
+  /**
+   * @class vector
+   * @brief Contigious sequence growing its buffer in place where the allocator allows.
+   *
+   * Asks the allocator to try_expand the buffer before relocating it, which a
+   * memory block does in O(1) with no copy while the buffer is its latest allocation,
+   * and takes all the capacity allocate_at_least grants for a new buffer.
+   */
+  template <
+    typename T
+    , typename Allocator = std::allocator<T>
+    >
+  class vector
+  {
+    public:
+      using value_type = T;
+      using reference = T&;
+      using const_reference = const T&;
+      using pointer = T*;
+      using const_pointer = const T*;
+      using difference_type = std::ptrdiff_t;
+      using size_type = size_t;
+      using iterator = T*;
+      using const_iterator = const T*;
+      using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+
+    public:
+
+      vector() = default;
+
+      explicit vector(const allocator_type& alloc)
+	: _allocator(alloc)
+      {}
+
+      vector(std::initializer_list<value_type> l)
+      {
+	append(l.begin(), l.end());
+      }
+
+      template<typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+	vector(InputIt first, InputIt last)
+	{
+	  append(first, last);
+	}
+
+      vector(const vector& other)
+	: _allocator(allocator_traits::select_on_container_copy_construction(other._allocator))
+      {
+	append(other.begin(), other.end());
+      }
+
+      vector(vector&& other)
+	: _allocator(std::move(other._allocator))
+      {
+	swap(other);
+      }
+
+      vector& operator=(const vector& other)
+      {
+	if (&other != this)
+	{
+	  clear();
+	  append(other.begin(), other.end());
+	}
+	return *this;
+      }
+
+      vector& operator=(vector&& other)
+      {
+	if (&other != this)
+	{
+	  clear();
+	  if (_allocator == other._allocator)
+	    swap(other);
+	  else
+	    append(std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+	}
+	return *this;
+      }
+
+      ~vector()
+      {
+	clear();
+	if (_begin)
+	  allocator_traits::deallocate(_allocator, _begin, capacity());
+      }
+
+      allocator_type get_allocator() const
+      {
+	return _allocator;
+      }
+
+      //! Swaps the buffers only, the allocators are expected to be equal
+      void swap(vector& other)
+      {
+	using std::swap;
+	swap(other._begin, _begin);
+	swap(other._end, _end);
+	swap(other._capacity_end, _capacity_end);
+      }
+
+      friend void swap(vector& lhs, vector& rhs)
+      {
+	lhs.swap(rhs);
+      }
+
+      friend bool operator==(const vector& lhs, const vector& rhs)
+      {
+	return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+      }
+
+      friend bool operator!=(const vector& lhs, const vector& rhs)
+      {
+	return !(lhs == rhs);
+      }
+
+      iterator begin()
+      {
+	return _begin;
+      }
+
+      const_iterator begin() const
+      {
+	return _begin;
+      }
+
+      iterator end()
+      {
+	return _end;
+      }
+
+      const_iterator end() const
+      {
+	return _end;
+      }
+
+      const_iterator cbegin() const
+      {
+	return begin();
+      }
+
+      const_iterator cend() const
+      {
+	return end();
+      }
+
+      size_type max_size() const
+      {
+	return allocator_traits::max_size(_allocator);
+      }
+
+      size_type size() const
+      {
+	return static_cast<size_type>(_end - _begin);
+      }
+
+      size_type capacity() const
+      {
+	return static_cast<size_type>(_capacity_end - _begin);
+      }
+
+      bool empty() const
+      {
+	return (_begin == _end);
+      }
+
+      pointer data()
+      {
+	return _begin;
+      }
+
+      const_pointer data() const
+      {
+	return _begin;
+      }
+
+      reference operator[](size_type i)
+      {
+	return _begin[i];
+      }
+
+      const_reference operator[](size_type i) const
+      {
+	return _begin[i];
+      }
+
+      reference at(size_type i)
+      {
+	if (i >= size())
+	  throw std::out_of_range("vector index out of range");
+	return _begin[i];
+      }
+
+      const_reference at(size_type i) const
+      {
+	if (i >= size())
+	  throw std::out_of_range("vector index out of range");
+	return _begin[i];
+      }
+
+      reference front()
+      {
+	return *_begin;
+      }
+
+      const_reference front() const
+      {
+	return *_begin;
+      }
+
+      reference back()
+      {
+	return *(_end - 1);
+      }
+
+      const_reference back() const
+      {
+	return *(_end - 1);
+      }
+
+      void reserve(size_type count)
+      {
+	if (count > capacity() && !expand(count))
+	  relocate(count);
+      }
+
+      //! Non-binding: gives the unused capacity back only where it can be done in place
+      void shrink_to_fit()
+      {
+	if (_begin != _end && _end != _capacity_end
+	    && allocator_extensions::try_expand(_allocator, _begin, capacity(), size()))
+	  _capacity_end = _end;
+      }
+
+      void push_back(const value_type& value)
+      {
+	emplace_back(value);
+      }
+
+      void push_back(value_type&& value)
+      {
+	emplace_back(std::forward<value_type>(value));
+      }
+
+      template<typename... Args>
+      reference emplace_back(Args&&... args)
+      {
+	if (_end == _capacity_end && !expand(grown()))
+	{
+	  relocate(grown(), 1, [&](pointer p)
+	      {
+		allocator_traits::construct(_allocator, p, std::forward<Args>(args)...);
+	      });
+	  return back();
+	}
+	allocator_traits::construct(_allocator, _end, std::forward<Args>(args)...);
+	return *_end++;
+      }
+
+      void pop_back()
+      {
+	allocator_traits::destroy(_allocator, --_end);
+      }
+
+      void resize(size_type count)
+      {
+	while (size() > count)
+	  pop_back();
+	reserve(count);
+	while (size() < count)
+	  emplace_back();
+      }
+
+      void clear()
+      {
+	while (_end != _begin)
+	  pop_back();
+      }
+
+    private:
+      using allocator_traits = std::allocator_traits<allocator_type>;
+      using allocator_extensions = nonstd::allocator_extensions<allocator_type>;
+
+      size_type grown() const
+      {
+	return capacity() ? 2 * capacity() : 1;
+      }
+
+      //! Grows the buffer in place, always succeeds for the very first buffer
+      bool expand(size_type count)
+      {
+	if (!_begin)
+	{
+	  auto buffer = allocator_extensions::allocate_at_least(_allocator, count);
+	  _begin = buffer.ptr;
+	  _end = _begin;
+	  _capacity_end = _begin + buffer.count;
+	  return true;
+	}
+	if (!allocator_extensions::try_expand(_allocator, _begin, capacity(), count))
+	  return false;
+
+	_capacity_end = _begin + count;
+	return true;
+      }
+
+      //! Moves the elements to a new buffer of count or more
+      void relocate(size_type count)
+      {
+	relocate(count, 0, [](pointer) {});
+      }
+
+      //! Moves the elements to a new buffer of count or more after constructing extra more past them
+      template<typename Construct>
+	void relocate(size_type count, size_type extra, Construct construct)
+	{
+	  auto allocated = allocator_extensions::allocate_at_least(_allocator, count);
+	  pointer buffer = allocated.ptr;
+	  pointer first = buffer + size();
+	  pointer last = first;
+	  try
+	  {
+	    for (; last != first + extra; ++last)
+	      construct(last);
+	    for (pointer p = _end; p != _begin; --first)
+	      allocator_traits::construct(_allocator, first - 1, std::move_if_noexcept(*--p));
+	  }
+	  catch(...)
+	  {
+	    for (; first != last; ++first)
+	      allocator_traits::destroy(_allocator, first);
+	    allocator_traits::deallocate(_allocator, buffer, allocated.count);
+	    throw;
+	  }
+
+	  clear();
+	  if (_begin)
+	    allocator_traits::deallocate(_allocator, _begin, capacity());
+	  _begin = buffer;
+	  _end = last;
+	  _capacity_end = buffer + allocated.count;
+	}
+
+      template<typename InputIt>
+	void append(InputIt first, InputIt last)
+	{
+	  append(first, last, typename std::iterator_traits<InputIt>::iterator_category{});
+	}
+
+      template<typename InputIt>
+	void append(InputIt first, InputIt last, std::input_iterator_tag)
+	{
+	  for (; first != last; ++first)
+	    emplace_back(*first);
+	}
+
+      template<typename ForwardIt>
+	void append(ForwardIt first, ForwardIt last, std::forward_iterator_tag)
+	{
+	  reserve(size() + static_cast<size_type>(std::distance(first, last)));
+	  for (; first != last; ++first, ++_end)
+	    allocator_traits::construct(_allocator, _end, *first);
+	}
+
+    private:
+      allocator_type _allocator{};
+      pointer _begin = nullptr;
+      pointer _end = nullptr;
+      pointer _capacity_end = nullptr;
+  };
+}